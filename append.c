@@ -0,0 +1,78 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../convert/source.h"
+#include "../convert/fd/source.h"
+#include "../log/log.h"
+#include "common.h"
+#include "read.h"
+#include "append.h"
+
+bool tar_append_seek (unsigned long long * end, int fd)
+{
+    window_unsigned_char buffer = {0};
+    fd_source source = fd_source_init(.fd = fd, .contents = &buffer);
+    tar_state state = { .source = &source.source, .seek = { .enabled = true, .fd = fd } };
+    struct stat stat;
+    unsigned long long offset = 0;
+
+    if (fstat (fd, &stat))
+    {
+	perror ("fstat");
+	log_fatal ("Failed to examine the tar to be appended to");
+    }
+
+    if ((off_t) -1 == lseek (fd, 0, SEEK_SET))
+    {
+	perror ("lseek");
+	log_fatal ("The tar to be appended to is not seekable");
+    }
+
+    if (stat.st_size)
+    {
+	while (tar_update (&state))
+	{
+	    if (state.type == TAR_FILE && !tar_skip_file (&state))
+	    {
+		log_fatal ("Failed to skip the contents of %s", state.path.region.begin);
+	    }
+	}
+
+	if (state.type != TAR_END)
+	{
+	    log_fatal ("Failed to find the end of the tar to be appended to");
+	}
+
+	// the header offset of the end is that of its first zero block, which the source will have read past
+
+	offset = state.offset.header;
+
+	if ((off_t) -1 == lseek (fd, offset, SEEK_SET))
+	{
+	    perror ("lseek");
+	    log_fatal ("Failed to seek to the end of the tar");
+	}
+    }
+
+    if (end)
+    {
+	*end = offset;
+    }
+
+    tar_cleanup (&state);
+    window_clear (buffer);
+
+    return true;
+
+fail:
+    tar_cleanup (&state);
+    window_clear (buffer);
+    return false;
+}
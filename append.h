@@ -0,0 +1,24 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "common.h"
+#include "read.h"
+#endif
+
+/**
+   @file tar/append.h
+   Describes a function that prepares an existing tar file to have members added to its end, without reading its contents or rewriting any of it.
+   To append to a tar, open it for reading and writing, but without O_APPEND, and call tar_append_seek to move its file offset to the end of its last member. Then write new members to an fd_sink on the same descriptor with tar_write_sink_path or any of the other writers, and finish with tar_write_sink_end.
+*/
+
+bool tar_append_seek (unsigned long long * end, int fd);
+/**<
+   @brief Walks the headers of the uncompressed tar in fd, seeking past the contents of its members with lseek, and leaves the file offset of fd at the first of the zero blocks that end the tar. Members written from there overwrite the old end marker, and any zero blocks left beyond the new end marker are ignored by readers. An empty file is treated as an empty tar.
+   @return True if the end of the tar was found, false otherwise, in which case the file offset of fd is undefined
+   @param end If non-null, its destination is assigned the offset at which new members begin
+   @param fd A seekable file descriptor for the tar, which is read from its beginning
+*/
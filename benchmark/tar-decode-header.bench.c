@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../convert/source.h"
+#include "../../keyargs/keyargs.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../read.h"
+#include "../internal/spec.h"
+#include "../internal/decode.h"
+
+#define HEADER_COUNT 1000000
+#define ROUNDS 5
+
+static double now ()
+{
+    struct timespec time;
+    clock_gettime (CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void make_header (unsigned char * block, size_t index)
+{
+    struct posix_header * header = (void*) block;
+
+    memset (block, 0, TAR_BLOCK_SIZE);
+    snprintf (header->name, sizeof(header->name), "tiny/file-%zu", index);
+    snprintf (header->mode, sizeof(header->mode), "%07o", 0644);
+    snprintf (header->uid, sizeof(header->uid), "%07o", 1000);
+    snprintf (header->gid, sizeof(header->gid), "%07o", 1000);
+    snprintf (header->size, sizeof(header->size), "%011o", 0);
+    snprintf (header->mtime, sizeof(header->mtime), "%011llo", 1600000000ULL + index);
+    header->typeflag = REGTYPE;
+    memcpy (header->magic, "ustar ", 6);
+    memcpy (header->version, " ", 2);
+    memset (header->chksum, ' ', sizeof(header->chksum));
+
+    unsigned int checksum = 0;
+
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+    {
+	checksum += block[i];
+    }
+
+    snprintf (header->chksum, sizeof(header->chksum), "%06o", checksum);
+}
+
+static bool reference_decode (tar_header_fields * fields, const unsigned char * block)
+{
+    const struct posix_header * header = (const void*) block;
+    char * endptr;
+
+    for (const uint64_t * test = (const void*) block; (const void*) test < (const void*) (block + TAR_BLOCK_SIZE); test++)
+    {
+	if (*test)
+	{
+	    goto nonzero;
+	}
+    }
+
+    return false;
+
+nonzero:
+    fields->mode = strtol (header->mode, &endptr, 8);
+    fields->uid = strtol (header->uid, &endptr, 8);
+    fields->gid = strtol (header->gid, &endptr, 8);
+    fields->size = strtol (header->size, &endptr, 8);
+    fields->mtime = strtol (header->mtime, &endptr, 8);
+    fields->chksum = strtol (header->chksum, &endptr, 8);
+
+    fields->sum_unsigned = 0;
+
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+    {
+	fields->sum_unsigned += (i >= 148 && i < 156) ? ' ' : block[i];
+    }
+
+    return true;
+}
+
+static void report (const char * name, double seconds)
+{
+    printf ("%s\theaders/s\t%.0f\n", name, HEADER_COUNT * (double) ROUNDS / seconds);
+}
+
+int main ()
+{
+    unsigned char * archive = calloc (HEADER_COUNT + 2, TAR_BLOCK_SIZE);
+
+    for (size_t i = 0; i < HEADER_COUNT; i++)
+    {
+	make_header (archive + i * TAR_BLOCK_SIZE, i);
+    }
+
+    size_t checksum = 0;
+    double begin = now();
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+	for (size_t i = 0; i < HEADER_COUNT; i++)
+	{
+	    tar_header_fields fields;
+	    if (reference_decode (&fields, archive + i * TAR_BLOCK_SIZE))
+	    {
+		checksum += fields.mode + fields.size + (fields.chksum == fields.sum_unsigned);
+	    }
+	}
+    }
+
+    report ("strtol_decode", now() - begin);
+
+    begin = now();
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+	for (size_t i = 0; i < HEADER_COUNT; i++)
+	{
+	    tar_header_fields fields;
+	    tar_decode_header (&fields, archive + i * TAR_BLOCK_SIZE);
+	    checksum += fields.mode + fields.size + tar_header_checksum_matches (&fields);
+	}
+    }
+
+    report ("tar_decode_header", now() - begin);
+
+    begin = now();
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+	tar_state state = {0};
+	range_const_unsigned_char mem = { .begin = archive, .end = archive + (HEADER_COUNT + 2) * TAR_BLOCK_SIZE };
+	size_t count = 0;
+
+	while (tar_update_mem (&state, &mem))
+	{
+	    count += state.ready;
+	}
+
+	assert (count == HEADER_COUNT);
+	assert (state.type == TAR_END);
+	tar_cleanup (&state);
+    }
+
+    report ("tar_update_mem", now() - begin);
+
+    free (archive);
+
+    return checksum == 0;
+}
@@ -0,0 +1,239 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/sink.h"
+#include "../../keyargs/keyargs.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../read.h"
+#include "../write.h"
+
+/*
+  Measures tar_update and tar_read_file_part on synthetic archives. Each archive is a segment of members that is generated once with tar_write_header and then repeated by a source, so that millions of members or gigabytes of contents can be read without being held in memory. Results are printed as tab separated lines of workload, unit and value. An optional argument scales the size of every workload.
+*/
+
+#define SEGMENT_MEMBERS 1000
+#define ZERO_MEMBERS 2000000
+#define SMALL_MEMBERS 200000
+#define SMALL_SIZE 4096
+#define NESTED_MEMBERS 500000
+#define NESTED_DEPTH 12
+#define LARGE_SIZE (4ULL * 1024 * 1024 * 1024)
+#define LARGE_CHUNK_SIZE (1024 * 1024)
+
+typedef struct repeat_source repeat_source;
+struct repeat_source
+{
+    convert_source source;
+    range_const_unsigned_char prefix;
+    range_const_unsigned_char segment;
+    range_const_unsigned_char suffix;
+    size_t repeats;
+    size_t stage; ///< 0 for the prefix, 1 for the segment, 2 for the suffix and 3 when done
+};
+
+static bool repeat_source_read (bool * error, convert_source * source)
+{
+    repeat_source * repeat = (repeat_source*) source;
+
+    while (repeat->stage < 3)
+    {
+	const range_const_unsigned_char * part = repeat->stage == 0 ? &repeat->prefix
+	    : repeat->stage == 1 ? &repeat->segment
+	    : &repeat->suffix;
+
+	bool last = repeat->stage != 1 || !repeat->repeats || !--repeat->repeats;
+
+	if (last)
+	{
+	    repeat->stage++;
+	}
+
+	if (range_is_empty (*part))
+	{
+	    continue;
+	}
+
+	window_append_bytes (source->contents, part->begin, range_count (*part));
+	return true;
+    }
+
+    return false;
+}
+
+static double now ()
+{
+    struct timespec time;
+    clock_gettime (CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void report (const char * name, const char * unit, double value)
+{
+    printf ("%s\t%s\t%.0f\n", name, unit, value);
+    fflush (stdout);
+}
+
+static void report_rate (const char * name, const char * unit, double value)
+{
+    printf ("%s\t%s\t%.3f\n", name, unit, value);
+    fflush (stdout);
+}
+
+static void make_nested_name (char * name, size_t name_size, size_t index)
+{
+    int used = 0;
+
+    for (int level = 0; level < NESTED_DEPTH; level++)
+    {
+	used += snprintf (name + used, name_size - used, "nested-directory-%02d/", level);
+    }
+
+    snprintf (name + used, name_size - used, "file-%zu", index);
+}
+
+static void make_segment (window_unsigned_char * segment, size_t members, unsigned long long size, bool nested)
+{
+    char name[1024];
+    unsigned char * contents = calloc (1, size + 1);
+
+    for (size_t i = 0; i < members; i++)
+    {
+	if (nested)
+	{
+	    make_nested_name (name, sizeof(name), i);
+	}
+	else
+	{
+	    snprintf (name, sizeof(name), "synthetic/file-%zu", i);
+	}
+
+	assert (tar_write_header (.output = segment, .name = name, .mode = 0644, .uid = 1000, .gid = 1000, .size = size, .mtime = 1600000000, .type = TAR_FILE, .uname = "user", .gname = "group"));
+
+	window_append_bytes (segment, contents, size);
+	tar_write_padding (segment, size);
+    }
+
+    free (contents);
+}
+
+static void read_archive (const char * name, repeat_source * repeat, size_t members, unsigned long long total_bytes)
+{
+    window_unsigned_char buffer = {0};
+    repeat->source = (convert_source){ .contents = &buffer, .read = repeat_source_read };
+
+    tar_state state = { .source = &repeat->source };
+    size_t count = 0;
+    unsigned long long bytes = 0;
+    bool error = false;
+    range_const_unsigned_char part;
+
+    double begin = now();
+
+    while (tar_update (&state))
+    {
+	assert (state.type == TAR_FILE);
+	count++;
+
+	while (tar_read_file_part (&error, &part, &state))
+	{
+	    bytes += range_count (part);
+	}
+
+	assert (!error);
+    }
+
+    double seconds = now() - begin;
+
+    assert (state.type == TAR_END);
+    assert (count == members);
+    assert (bytes == total_bytes);
+
+    char label[256];
+
+    snprintf (label, sizeof(label), "%s_tar_update", name);
+    report (label, "headers/s", count / seconds);
+
+    if (total_bytes)
+    {
+	snprintf (label, sizeof(label), "%s_tar_read_file_part", name);
+	report_rate (label, "GB/s", bytes / seconds / 1e9);
+    }
+
+    tar_cleanup (&state);
+    window_clear (buffer);
+}
+
+static void members_workload (const char * name, size_t members, unsigned long long size, bool nested)
+{
+    window_unsigned_char segment = {0};
+    window_unsigned_char end = {0};
+
+    size_t repeats = members / SEGMENT_MEMBERS ? members / SEGMENT_MEMBERS : 1;
+
+    make_segment (&segment, SEGMENT_MEMBERS, size, nested);
+    tar_write_end (&end);
+
+    repeat_source repeat = {
+	.segment = segment.region.const_cast,
+	.suffix = end.region.const_cast,
+	.repeats = repeats,
+    };
+
+    read_archive (name, &repeat, repeats * SEGMENT_MEMBERS, repeats * SEGMENT_MEMBERS * size);
+
+    window_clear (segment);
+    window_clear (end);
+}
+
+static void large_workload (unsigned long long size)
+{
+    window_unsigned_char header = {0};
+    window_unsigned_char end = {0};
+    unsigned char * chunk = calloc (1, LARGE_CHUNK_SIZE);
+
+    size_t repeats = size / LARGE_CHUNK_SIZE ? size / LARGE_CHUNK_SIZE : 1;
+    size = repeats * LARGE_CHUNK_SIZE;
+
+    assert (tar_write_header (.output = &header, .name = "synthetic/large", .mode = 0644, .size = size, .mtime = 1600000000, .type = TAR_FILE, .uname = "user", .gname = "group"));
+    tar_write_end (&end);
+
+    repeat_source repeat = {
+	.prefix = header.region.const_cast,
+	.segment = { .begin = chunk, .end = chunk + LARGE_CHUNK_SIZE },
+	.suffix = end.region.const_cast,
+	.repeats = repeats,
+    };
+
+    read_archive ("large", &repeat, 1, size);
+
+    free (chunk);
+    window_clear (header);
+    window_clear (end);
+}
+
+int main (int argc, char * argv[])
+{
+    double scale = argc > 1 ? atof (argv[1]) : 1;
+
+    assert (scale > 0);
+
+    members_workload ("zero", ZERO_MEMBERS * scale, 0, false);
+    members_workload ("small", SMALL_MEMBERS * scale, SMALL_SIZE, false);
+    members_workload ("nested", NESTED_MEMBERS * scale, 0, true);
+    large_workload (LARGE_SIZE * scale);
+
+    return 0;
+}
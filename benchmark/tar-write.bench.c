@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/sink.h"
+#include "../../keyargs/keyargs.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../write.h"
+
+/*
+  Measures tar_write_header, tar_write_template_header and tar_write_sink_path. Headers are written to memory, and paths are written from files created in a temporary directory to a sink that discards its contents, so that the numbers reflect the library rather than the disk. The large file is created with ftruncate, so its contents are read from the page cache without using disk space. Results are printed as tab separated lines of workload, unit and value. An optional argument scales the size of every workload.
+*/
+
+#define HEADER_COUNT 2000000
+#define HEADER_FLUSH 1024
+#define ZERO_FILES 50000
+#define SMALL_FILES 20000
+#define SMALL_SIZE 4096
+#define NESTED_DEPTH 12
+#define LARGE_SIZE (4ULL * 1024 * 1024 * 1024)
+
+static double now ()
+{
+    struct timespec time;
+    clock_gettime (CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void report (const char * name, const char * unit, double value)
+{
+    printf ("%s\t%s\t%.0f\n", name, unit, value);
+    fflush (stdout);
+}
+
+static void report_rate (const char * name, const char * unit, double value)
+{
+    printf ("%s\t%s\t%.3f\n", name, unit, value);
+    fflush (stdout);
+}
+
+static bool null_sink_write (bool * error, convert_sink * sink)
+{
+    sink->contents->begin = sink->contents->end;
+    return true;
+}
+
+static void make_nested_name (char * name, size_t name_size, size_t index)
+{
+    int used = 0;
+
+    for (int level = 0; level < NESTED_DEPTH; level++)
+    {
+	used += snprintf (name + used, name_size - used, "nested-directory-%02d/", level);
+    }
+
+    snprintf (name + used, name_size - used, "file-%zu", index);
+}
+
+static void header_workload (const char * label, size_t count, bool nested, bool pax)
+{
+    window_unsigned_char output = {0};
+    tar_owner_cache owners = {0};
+    char name[1024];
+
+    double begin = now();
+
+    for (size_t i = 0; i < count; i++)
+    {
+	if (nested)
+	{
+	    make_nested_name (name, sizeof(name), i);
+	}
+	else
+	{
+	    snprintf (name, sizeof(name), "synthetic/file-%zu", i);
+	}
+
+	assert (tar_write_header (.output = &output, .name = name, .mode = 0644, .uid = 1000, .gid = 1000, .mtime = 1600000000, .type = TAR_FILE, .owners = &owners, .pax = pax));
+
+	if (i % HEADER_FLUSH == 0)
+	{
+	    window_rewrite (output);
+	}
+    }
+
+    report (label, "headers/s", count / (now() - begin));
+
+    tar_owner_cache_clear (&owners);
+    window_clear (output);
+}
+
+static void template_header_workload (const char * label, size_t count, bool nested, bool pax)
+{
+    window_unsigned_char output = {0};
+    window_unsigned_char expected = {0};
+    tar_owner_cache owners = {0};
+    tar_header_template template;
+    char name[1024];
+
+    assert (tar_header_template_init (.template = &template, .mode = 0644, .uid = 1000, .gid = 1000, .owners = &owners, .pax = pax));
+
+    // the first headers are checked against tar_write_header before anything is timed
+
+    for (size_t i = 0; i < HEADER_FLUSH; i++)
+    {
+	snprintf (name, sizeof(name), "synthetic/file-%zu", i);
+
+	window_rewrite (output);
+	window_rewrite (expected);
+
+	assert (tar_write_template_header (.output = &output, .template = &template, .name = name, .mtime = 1600000000 + i, .size = i * 4099, .type = i % 2 ? TAR_FILE : TAR_DIR));
+	assert (tar_write_header (.output = &expected, .name = name, .mode = 0644, .uid = 1000, .gid = 1000, .mtime = 1600000000 + i, .size = i * 4099, .type = i % 2 ? TAR_FILE : TAR_DIR, .owners = &owners, .pax = pax));
+
+	assert (range_count (output.region) == range_count (expected.region));
+	assert (!memcmp (output.region.begin, expected.region.begin, range_count (output.region)));
+    }
+
+    window_rewrite (output);
+
+    double begin = now();
+
+    for (size_t i = 0; i < count; i++)
+    {
+	if (nested)
+	{
+	    make_nested_name (name, sizeof(name), i);
+	}
+	else
+	{
+	    snprintf (name, sizeof(name), "synthetic/file-%zu", i);
+	}
+
+	assert (tar_write_template_header (.output = &output, .template = &template, .name = name, .mtime = 1600000000, .type = TAR_FILE));
+
+	if (i % HEADER_FLUSH == 0)
+	{
+	    window_rewrite (output);
+	}
+    }
+
+    report (label, "headers/s", count / (now() - begin));
+
+    tar_owner_cache_clear (&owners);
+    window_clear (output);
+    window_clear (expected);
+}
+
+static void create_files (const char * directory, const char * prefix, size_t count, unsigned long long size)
+{
+    char path[4096];
+    unsigned char * contents = calloc (1, size + 1);
+
+    memset (contents, 'x', size);
+
+    for (size_t i = 0; i < count; i++)
+    {
+	snprintf (path, sizeof(path), "%s/%s-%zu", directory, prefix, i);
+
+	int fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	assert (fd >= 0);
+	assert (size == (unsigned long long) write (fd, contents, size));
+	close (fd);
+    }
+
+    free (contents);
+}
+
+static void remove_files (const char * directory, const char * prefix, size_t count)
+{
+    char path[4096];
+
+    for (size_t i = 0; i < count; i++)
+    {
+	snprintf (path, sizeof(path), "%s/%s-%zu", directory, prefix, i);
+	unlink (path);
+    }
+}
+
+static void path_workload (const char * label, const char * directory, const char * prefix, size_t count, unsigned long long size)
+{
+    window_unsigned_char buffer = {0};
+    tar_owner_cache owners = {0};
+    convert_sink null_sink = { .write = null_sink_write };
+    char path[4096];
+    char name[256];
+
+    double begin = now();
+
+    for (size_t i = 0; i < count; i++)
+    {
+	snprintf (path, sizeof(path), "%s/%s-%zu", directory, prefix, i);
+	snprintf (name, sizeof(name), "synthetic/%s-%zu", prefix, i);
+
+	assert (tar_write_sink_path (.sink = &null_sink, .buffer = &buffer, .path = path, .override_name = name, .owners = &owners));
+    }
+
+    double seconds = now() - begin;
+
+    if (count > 1)
+    {
+	report (label, "files/s", count / seconds);
+    }
+
+    if (size)
+    {
+	report_rate (label, "GB/s", count * size / seconds / 1e9);
+    }
+
+    tar_owner_cache_clear (&owners);
+    window_clear (buffer);
+}
+
+int main (int argc, char * argv[])
+{
+    double scale = argc > 1 ? atof (argv[1]) : 1;
+
+    assert (scale > 0);
+
+    header_workload ("tar_write_header", HEADER_COUNT * scale, false, false);
+    header_workload ("nested_tar_write_header", HEADER_COUNT * scale, true, false);
+    header_workload ("nested_pax_tar_write_header", HEADER_COUNT * scale, true, true);
+    template_header_workload ("tar_write_template_header", HEADER_COUNT * scale, false, false);
+    template_header_workload ("pax_tar_write_template_header", HEADER_COUNT * scale, false, true);
+    template_header_workload ("nested_tar_write_template_header", HEADER_COUNT * scale, true, false);
+
+    char directory[] = "/tmp/tar-write-bench-XXXXXX";
+    assert (mkdtemp (directory));
+
+    size_t zero_files = ZERO_FILES * scale;
+    size_t small_files = SMALL_FILES * scale;
+    unsigned long long large_size = LARGE_SIZE * scale;
+
+    create_files (directory, "zero", zero_files, 0);
+    create_files (directory, "small", small_files, SMALL_SIZE);
+    create_files (directory, "large", 1, 0);
+
+    char large_path[4096];
+    snprintf (large_path, sizeof(large_path), "%s/large-0", directory);
+    assert (0 == truncate (large_path, large_size));
+
+    path_workload ("zero_tar_write_sink_path", directory, "zero", zero_files, 0);
+    path_workload ("small_tar_write_sink_path", directory, "small", small_files, SMALL_SIZE);
+    path_workload ("large_tar_write_sink_path", directory, "large", 1, large_size);
+
+    remove_files (directory, "zero", zero_files);
+    remove_files (directory, "small", small_files);
+    remove_files (directory, "large", 1);
+    rmdir (directory);
+
+    return 0;
+}
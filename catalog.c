@@ -0,0 +1,262 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../convert/source.h"
+#include "../keyargs/keyargs.h"
+#include "../log/log.h"
+#include "common.h"
+#include "read.h"
+#include "catalog.h"
+
+#define INITIAL_SLOT_COUNT 1024
+
+static uint32_t hash_component (uint32_t parent, const char * name, size_t name_size)
+{
+    uint32_t hash = 2166136261u ^ parent;
+
+    for (size_t i = 0; i < name_size; i++)
+    {
+	hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t * find_node_slot (uint32_t * slots, size_t slot_count, const tar_catalog * catalog, uint32_t parent, const char * name, size_t name_size)
+{
+    size_t mask = slot_count - 1;
+
+    for (size_t i = hash_component (parent, name, name_size) & mask; ; i = (i + 1) & mask)
+    {
+	if (!slots[i])
+	{
+	    return slots + i;
+	}
+
+	const tar_catalog_node * node = catalog->nodes.region.begin + slots[i] - 1;
+
+	if (node->parent == parent && node->name_size == name_size && !memcmp (catalog->names.region.begin + node->name_begin, name, name_size))
+	{
+	    return slots + i;
+	}
+    }
+}
+
+static void grow_node_slots (tar_catalog * catalog)
+{
+    size_t slot_count = catalog->node_slot_count ? catalog->node_slot_count * 2 : INITIAL_SLOT_COUNT;
+    uint32_t * slots = calloc (slot_count, sizeof(*slots));
+
+    assert (slots);
+
+    for (size_t i = 0; i < catalog->node_slot_count; i++)
+    {
+	if (catalog->node_slots[i])
+	{
+	    const tar_catalog_node * node = catalog->nodes.region.begin + catalog->node_slots[i] - 1;
+	    *find_node_slot (slots, slot_count, catalog, node->parent, catalog->names.region.begin + node->name_begin, node->name_size) = catalog->node_slots[i];
+	}
+    }
+
+    free (catalog->node_slots);
+    catalog->node_slots = slots;
+    catalog->node_slot_count = slot_count;
+}
+
+static bool intern_component (uint32_t * result, tar_catalog * catalog, uint32_t parent, const char * name, size_t name_size)
+{
+    // the table is kept at most half full, so probes stay short and always find an empty slot
+
+    if (((size_t) range_count (catalog->nodes.region) + 1) * 2 > catalog->node_slot_count)
+    {
+	grow_node_slots (catalog);
+    }
+
+    uint32_t * slot = find_node_slot (catalog->node_slots, catalog->node_slot_count, catalog, parent, name, name_size);
+
+    if (!*slot)
+    {
+	size_t name_begin = range_count (catalog->names.region);
+
+	if (range_count (catalog->nodes.region) >= UINT32_MAX - 1 || name_begin + name_size > UINT32_MAX)
+	{
+	    log_fatal ("The tar has too many distinct paths to be cataloged");
+	}
+
+	*window_push (catalog->nodes) = (tar_catalog_node){ .parent = parent, .name_begin = name_begin, .name_size = name_size };
+	window_append_bytes ((window_unsigned_char*) &catalog->names, (const unsigned char*) name, name_size);
+
+	*slot = range_count (catalog->nodes.region);
+    }
+
+    *result = *slot;
+
+    return true;
+
+fail:
+    return false;
+}
+
+static bool intern_path (uint32_t * result, tar_catalog * catalog, const char * path)
+{
+    size_t size = strlen (path);
+
+    if (size > 1 && path[size - 1] == '/')
+    {
+	size--;
+    }
+
+    const char * end = path + size;
+    uint32_t node = 0;
+
+    while (true)
+    {
+	const char * separator = memchr (path, '/', end - path);
+	const char * component_end = separator ? separator : end;
+
+	if (!intern_component (&node, catalog, node, path, component_end - path))
+	{
+	    return false;
+	}
+
+	if (!separator)
+	{
+	    break;
+	}
+
+	path = separator + 1;
+    }
+
+    *result = node;
+
+    return true;
+}
+
+static void write_node_path (window_char * output, const tar_catalog * catalog, uint32_t node)
+{
+    size_t size = 0;
+
+    for (uint32_t i = node; i; i = catalog->nodes.region.begin[i - 1].parent)
+    {
+	size += catalog->nodes.region.begin[i - 1].name_size + 1;
+    }
+
+    // the path is filled in from its last component, and the separator before the first component becomes the terminator
+
+    window_rewrite (*output);
+    char * begin = window_grow_bytes ((window_unsigned_char*) output, size ? size : 1);
+    char * end = begin + (size ? size : 1);
+
+    *--end = '\0';
+
+    for (uint32_t i = node; i; i = catalog->nodes.region.begin[i - 1].parent)
+    {
+	const tar_catalog_node * component = catalog->nodes.region.begin + i - 1;
+
+	end -= component->name_size;
+	memcpy (end, catalog->names.region.begin + component->name_begin, component->name_size);
+
+	if (end > begin)
+	{
+	    *--end = '/';
+	}
+    }
+
+    output->region.end--;
+}
+
+bool tar_catalog_build (tar_catalog * catalog, tar_state * state)
+{
+    while (tar_update (state))
+    {
+	uint32_t path = 0;
+	uint32_t link = 0;
+
+	if (!intern_path (&path, catalog, state->path.region.begin))
+	{
+	    log_fatal ("Failed to catalog %s", state->path.region.begin);
+	}
+
+	if ((state->type == TAR_HARDLINK || state->type == TAR_SYMLINK) && !intern_path (&link, catalog, state->link.path.region.begin))
+	{
+	    log_fatal ("Failed to catalog the link target of %s", state->path.region.begin);
+	}
+
+	*window_push (catalog->header_offset) = state->offset.header;
+	*window_push (catalog->data_offset) = state->offset.data;
+	*window_push (catalog->size) = state->type == TAR_FILE ? state->file.size : 0;
+	*window_push (catalog->mode) = state->mode;
+	*window_push (catalog->type) = state->type;
+	*window_push (catalog->path) = path;
+	*window_push (catalog->link) = link;
+
+	if (state->type == TAR_FILE && !tar_skip_file (state))
+	{
+	    log_fatal ("Failed to skip the contents of %s", state->path.region.begin);
+	}
+    }
+
+    if (state->type != TAR_END)
+    {
+	log_fatal ("Failed to read the tar to be cataloged");
+    }
+
+    return true;
+
+fail:
+    return false;
+}
+
+size_t tar_catalog_count (const tar_catalog * catalog)
+{
+    return range_count (catalog->type.region);
+}
+
+void tar_catalog_path (window_char * output, const tar_catalog * catalog, size_t index)
+{
+    assert (index < tar_catalog_count (catalog));
+
+    write_node_path (output, catalog, catalog->path.region.begin[index]);
+}
+
+bool tar_catalog_link (window_char * output, const tar_catalog * catalog, size_t index)
+{
+    assert (index < tar_catalog_count (catalog));
+
+    uint32_t node = catalog->link.region.begin[index];
+
+    if (!node)
+    {
+	window_rewrite (*output);
+	*window_push (*output) = '\0';
+	output->region.end--;
+	return false;
+    }
+
+    write_node_path (output, catalog, node);
+
+    return true;
+}
+
+void tar_catalog_clear (tar_catalog * catalog)
+{
+    window_clear (catalog->header_offset);
+    window_clear (catalog->data_offset);
+    window_clear (catalog->size);
+    window_clear (catalog->mode);
+    window_clear (catalog->type);
+    window_clear (catalog->path);
+    window_clear (catalog->link);
+    window_clear (catalog->nodes);
+    window_clear (catalog->names);
+    free (catalog->node_slots);
+    catalog->node_slots = NULL;
+    catalog->node_slot_count = 0;
+}
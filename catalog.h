@@ -0,0 +1,84 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "common.h"
+#include "read.h"
+#endif
+
+/**
+   @file tar/catalog.h
+   Describes a catalog of every member of a tar, which is held in a handful of contiguous arrays rather than one allocation per member so that very large listings stay small and can be traversed quickly.
+   Members are stored as a structure of arrays, in archive order, so that member i is described by the i'th element of each array. Paths are interned one component at a time, so that a directory shared by many members is stored once, and each member refers to the node of its last component. Full paths are rebuilt on demand with tar_catalog_path and tar_catalog_link.
+*/
+
+typedef struct tar_catalog_node tar_catalog_node;
+struct tar_catalog_node {
+    uint32_t parent; ///< The index of the node of the preceding path component, plus one, or 0 if this is the first component
+    uint32_t name_begin; ///< The offset of this component within the catalog's names
+    uint32_t name_size; ///< The length of this component
+};
+/**< @struct tar_catalog_node
+   A single interned path component
+*/
+
+range_typedef(tar_catalog_node, tar_catalog_node);
+window_typedef(tar_catalog_node, tar_catalog_node);
+range_typedef(unsigned long long, tar_catalog_ull);
+window_typedef(unsigned long long, tar_catalog_ull);
+range_typedef(uint32_t, tar_catalog_u32);
+window_typedef(uint32_t, tar_catalog_u32);
+
+typedef struct tar_catalog tar_catalog;
+struct tar_catalog {
+    window_tar_catalog_ull header_offset; ///< The offset of the first header block of each member, including any longname, longlink or pax headers
+    window_tar_catalog_ull data_offset; ///< The offset of each member's contents
+    window_tar_catalog_ull size; ///< The size of each member's contents
+    window_tar_catalog_u32 mode; ///< The permissions mode of each member
+    window_unsigned_char type; ///< The tar_type of each member
+    window_tar_catalog_u32 path; ///< The node of each member's path, plus one
+    window_tar_catalog_u32 link; ///< The node of each hardlink or symlink target, plus one, or 0 for other members
+    window_tar_catalog_node nodes; ///< The interned path components
+    window_char names; ///< The text of each interned path component, without separators or terminators
+    uint32_t * node_slots; ///< An open addressed hash table of nodes, plus one, keyed by parent and name, whose size is a power of two
+    size_t node_slot_count; ///< The number of node slots
+};
+/**< @struct tar_catalog
+   A catalog of the members of a tar. It should be zeroed before use.
+*/
+
+bool tar_catalog_build (tar_catalog * catalog, tar_state * state);
+/**<
+   @brief Reads the remainder of the tar described by state and appends each of its members to the given catalog. File contents are skipped with tar_skip_file, so enabling state->seek on a seekable tar reads little more than its headers.
+   @return True if the end of the tar was reached, false otherwise
+   @param catalog The catalog to add members to
+   @param state A state reading from the beginning of the tar to be cataloged
+*/
+
+size_t tar_catalog_count (const tar_catalog * catalog);
+/**<
+   @brief Gives the number of members in a catalog
+*/
+
+void tar_catalog_path (window_char * output, const tar_catalog * catalog, size_t index);
+/**<
+   @brief Rebuilds the path of a member, without any trailing slash, replacing the contents of output with it as a null terminated string
+   @param output The window to write the path to
+   @param catalog The catalog to read from
+   @param index The index of the member
+*/
+
+bool tar_catalog_link (window_char * output, const tar_catalog * catalog, size_t index);
+/**<
+   @brief Rebuilds the link target of a hardlink or symlink member, as tar_catalog_path does for its path
+   @return True if the member has a link target, false otherwise, in which case output is left empty
+*/
+
+void tar_catalog_clear (tar_catalog * catalog);
+/**<
+   @brief Frees all memory allocated to the given catalog, but not the catalog itself.
+*/
@@ -1,5 +1,7 @@
 #ifndef FLAT_INCLUDES
 #define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
 #endif
 
 /**
@@ -8,6 +10,7 @@
 */
 
 #define TAR_BLOCK_SIZE 512 ///< The size of a tar block
+#define TAR_PAX_DELETED "LIBTAR.deleted" ///< The key of a pax extended header record on a directory, listing the entries of the directory that were deleted since the snapshot an incremental tar was made against
 
 typedef enum
 {
@@ -18,6 +21,20 @@ typedef enum
     TAR_HARDLINK, ///< Indicates a hardlink
     TAR_END, ///< Indicates the end of a tar file
     TAR_LONGNAME, ///< Indicates a longname that must be applied to the next tar item that isn't a longlink
-    TAR_LONGLINK ///< Indicates a longlink that must be applied to the next hardlink or symlink
+    TAR_LONGLINK, ///< Indicates a longlink that must be applied to the next hardlink or symlink
+    TAR_PAX, ///< Indicates a pax extended header that must be applied to the next tar item
+    TAR_PAX_GLOBAL, ///< Indicates a pax global header that applies to every following tar item
 }
     tar_type; ///< Item types which may be found in a tar file
+
+typedef struct tar_sparse_extent tar_sparse_extent;
+struct tar_sparse_extent {
+    unsigned long long offset; ///< The offset of the extent within the file
+    unsigned long long size; ///< The number of bytes in the extent
+};
+/**< @struct tar_sparse_extent
+   A range of a sparse file that holds data. The bytes of a sparse file that are outside of every extent are holes, which read as zeros.
+*/
+
+range_typedef(tar_sparse_extent, tar_sparse_extent);
+window_typedef(tar_sparse_extent, tar_sparse_extent);
@@ -0,0 +1,370 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../keyargs/keyargs.h"
+#include "../convert/sink.h"
+#include "../convert/source.h"
+#include "../convert/duplex.h"
+#include "../convert/fd/source.h"
+#include "../convert/fd/sink.h"
+#include "common.h"
+#include "owner.h"
+#include "hardlink.h"
+#include "write.h"
+#include "create.h"
+#include "../log/log.h"
+
+#define DEFAULT_MAX_BUFFERED_BYTES (64 * 1024 * 1024)
+#define SLOTS_PER_THREAD 8
+
+typedef enum {
+    SLOT_EMPTY,
+    SLOT_CLAIMED,
+    SLOT_READY,
+}
+    slot_status;
+
+typedef struct create_slot create_slot;
+struct create_slot
+{
+    slot_status status;
+    bool error;
+    bool preloaded;
+    struct stat stat;
+    char linkname[PATH_MAX + 1];
+    window_unsigned_char contents;
+};
+
+typedef struct create_pipeline create_pipeline;
+struct create_pipeline
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    create_slot * slots;
+    size_t slot_count;
+    const char * const * paths;
+    size_t count;
+    size_t next_claim;
+    size_t emitted;
+    size_t buffered_bytes;
+    size_t max_buffered_bytes;
+    bool abort;
+};
+
+static bool read_contents (window_unsigned_char * contents, const char * path, size_t size)
+{
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+	perror (path);
+	return false;
+    }
+
+    unsigned char * output = window_grow_bytes (contents, size);
+    size_t have = 0;
+
+    while (have < size)
+    {
+	ssize_t got = read (fd, output + have, size - have);
+
+	if (got < 0 && errno == EINTR)
+	{
+	    continue;
+	}
+
+	if (got <= 0)
+	{
+	    if (got < 0)
+	    {
+		perror (path);
+	    }
+	    else
+	    {
+		log_error ("%s was truncated while it was being read", path);
+	    }
+
+	    close (fd);
+	    return false;
+	}
+
+	have += got;
+    }
+
+    close (fd);
+    return true;
+}
+
+static void prepare_slot (create_pipeline * pipeline, create_slot * slot, size_t index)
+{
+    const char * path = pipeline->paths[index];
+
+    if (-1 == lstat (path, &slot->stat))
+    {
+	perror (path);
+	slot->error = true;
+	return;
+    }
+
+    if (S_ISLNK (slot->stat.st_mode))
+    {
+	ssize_t linkname_length = readlink (path, slot->linkname, sizeof(slot->linkname));
+
+	if (linkname_length < 0 || linkname_length == sizeof(slot->linkname))
+	{
+	    log_error ("Failed to read link %s", path);
+	    slot->error = true;
+	    return;
+	}
+
+	slot->linkname[linkname_length] = '\0';
+    }
+
+    if (!S_ISREG (slot->stat.st_mode) || (size_t) slot->stat.st_size > pipeline->max_buffered_bytes)
+    {
+	return;
+    }
+
+    size_t size = slot->stat.st_size;
+
+    pthread_mutex_lock (&pipeline->mutex);
+
+    while (!pipeline->abort && index != pipeline->emitted && pipeline->buffered_bytes + size > pipeline->max_buffered_bytes)
+    {
+	pthread_cond_wait (&pipeline->changed, &pipeline->mutex);
+    }
+
+    pipeline->buffered_bytes += size;
+
+    pthread_mutex_unlock (&pipeline->mutex);
+
+    slot->preloaded = true;
+
+    if (!read_contents (&slot->contents, path, size))
+    {
+	slot->error = true;
+    }
+}
+
+static void * worker_thread (void * arg)
+{
+    create_pipeline * pipeline = arg;
+
+    pthread_mutex_lock (&pipeline->mutex);
+
+    while (true)
+    {
+	while (!pipeline->abort
+	       && pipeline->next_claim < pipeline->count
+	       && pipeline->next_claim >= pipeline->emitted + pipeline->slot_count)
+	{
+	    pthread_cond_wait (&pipeline->changed, &pipeline->mutex);
+	}
+
+	if (pipeline->abort || pipeline->next_claim >= pipeline->count)
+	{
+	    break;
+	}
+
+	size_t index = pipeline->next_claim++;
+	create_slot * slot = pipeline->slots + index % pipeline->slot_count;
+
+	assert (slot->status == SLOT_EMPTY);
+	slot->status = SLOT_CLAIMED;
+
+	pthread_mutex_unlock (&pipeline->mutex);
+
+	prepare_slot (pipeline, slot, index);
+
+	pthread_mutex_lock (&pipeline->mutex);
+
+	slot->status = SLOT_READY;
+	pthread_cond_broadcast (&pipeline->changed);
+    }
+
+    pthread_mutex_unlock (&pipeline->mutex);
+
+    return NULL;
+}
+
+static bool stream_contents (convert_sink * sink, window_unsigned_char * buffer, const char * path)
+{
+    int file_fd = open (path, O_RDONLY | O_CLOEXEC);
+
+    if (file_fd < 0)
+    {
+	perror (path);
+	return false;
+    }
+
+    fd_source fd_source = fd_source_init(.fd = file_fd, .contents = buffer);
+
+    bool join_success = convert_join (sink, &fd_source.source);
+
+    convert_source_clear(&fd_source.source);
+
+    close (file_fd);
+
+    return join_success;
+}
+
+static bool emit_slot (convert_sink * sink, window_unsigned_char * buffer, tar_owner_cache * owners, bool pax, tar_hardlink_table * hardlinks, create_slot * slot, const char * path, const char * name)
+{
+    tar_type type = TAR_ERROR;
+
+    sink->contents = &buffer->region.const_cast;
+
+    if (!tar_write_stat_header (.output = buffer,
+				.stat = &slot->stat,
+				.name = name,
+				.linkname = slot->linkname,
+				.detect_type = &type,
+				.owners = owners,
+				.pax = pax,
+				.hardlinks = hardlinks,
+				.path = path))
+    {
+	return false;
+    }
+
+    if (type == TAR_FILE)
+    {
+	if (slot->preloaded)
+	{
+	    window_append_bytes (buffer, slot->contents.region.begin, range_count (slot->contents.region));
+	}
+	else if (!stream_contents (sink, buffer, path))
+	{
+	    return false;
+	}
+
+	sink->contents = &buffer->region.const_cast;
+
+	tar_write_padding (buffer, slot->stat.st_size);
+    }
+
+    bool error = false;
+
+    return convert_drain (&error, sink);
+}
+
+keyargs_define(tar_write_sink_paths)
+{
+    assert (args.sink);
+    assert (args.buffer);
+    assert (args.paths || !args.count);
+
+    if (!args.threads)
+    {
+	long online = sysconf (_SC_NPROCESSORS_ONLN);
+	args.threads = online > 0 ? online : 1;
+    }
+
+    if (!args.max_buffered_bytes)
+    {
+	args.max_buffered_bytes = DEFAULT_MAX_BUFFERED_BYTES;
+    }
+
+    create_pipeline pipeline = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.changed = PTHREAD_COND_INITIALIZER,
+	.slot_count = args.threads * SLOTS_PER_THREAD,
+	.paths = args.paths,
+	.count = args.count,
+	.max_buffered_bytes = args.max_buffered_bytes,
+    };
+
+    tar_owner_cache local_owners = {0};
+
+    pipeline.slots = calloc (pipeline.slot_count, sizeof(*pipeline.slots));
+
+    pthread_t * threads = calloc (args.threads, sizeof(*threads));
+    unsigned int started = 0;
+
+    for (; started < args.threads; started++)
+    {
+	if (pthread_create (threads + started, NULL, worker_thread, &pipeline))
+	{
+	    log_error ("Failed to start archiving thread");
+	    break;
+	}
+    }
+
+    bool success = started > 0;
+
+    for (size_t index = 0; success && index < args.count; index++)
+    {
+	create_slot * slot = pipeline.slots + index % pipeline.slot_count;
+
+	pthread_mutex_lock (&pipeline.mutex);
+
+	while (slot->status != SLOT_READY)
+	{
+	    pthread_cond_wait (&pipeline.changed, &pipeline.mutex);
+	}
+
+	pthread_mutex_unlock (&pipeline.mutex);
+
+	const char * path = args.paths[index];
+	const char * name = args.override_names && args.override_names[index] ? args.override_names[index] : path;
+
+	if (slot->error || !emit_slot (args.sink, args.buffer, args.owners ? args.owners : &local_owners, args.pax, args.hardlinks, slot, path, name))
+	{
+	    log_error ("Failed to write %s to the tar", path);
+	    success = false;
+	}
+
+	pthread_mutex_lock (&pipeline.mutex);
+
+	if (slot->preloaded)
+	{
+	    pipeline.buffered_bytes -= slot->stat.st_size;
+	}
+
+	window_clear (slot->contents);
+	slot->status = SLOT_EMPTY;
+	slot->error = false;
+	slot->preloaded = false;
+	slot->linkname[0] = '\0';
+	pipeline.emitted++;
+
+	if (!success)
+	{
+	    pipeline.abort = true;
+	}
+
+	pthread_cond_broadcast (&pipeline.changed);
+	pthread_mutex_unlock (&pipeline.mutex);
+    }
+
+    for (unsigned int i = 0; i < started; i++)
+    {
+	pthread_join (threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < pipeline.slot_count; i++)
+    {
+	window_clear (pipeline.slots[i].contents);
+    }
+
+    tar_owner_cache_clear (&local_owners);
+    free (threads);
+    free (pipeline.slots);
+    pthread_mutex_destroy (&pipeline.mutex);
+    pthread_cond_destroy (&pipeline.changed);
+
+    return success;
+}
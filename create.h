@@ -0,0 +1,44 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/sink.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "owner.h"
+#include "hardlink.h"
+#endif
+
+/**
+   @file tar/create.h
+   Describes a pipeline that writes many paths into a tar at once. A pool of worker threads examines, opens and reads upcoming paths ahead of time into bounded buffers, while the calling thread writes their headers and contents to the sink in the order given. The output is identical to calling tar_write_sink_path for each path in turn.
+*/
+
+keyargs_declare(bool,tar_write_sink_paths,
+		convert_sink * sink;
+		window_unsigned_char * buffer;
+		const char * const * paths;
+		const char * const * override_names;
+		size_t count;
+		unsigned int threads;
+		size_t max_buffered_bytes;
+		tar_owner_cache * owners;
+		bool pax;
+		tar_hardlink_table * hardlinks;);
+#define tar_write_sink_paths(...) keyargs_call(tar_write_sink_paths, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that writes the headers and contents of a list of paths to a sink.
+   @return True if successful, false otherwise
+   @param sink The sink to write the tar to
+   @param buffer A buffer used to hold headers and file contents on their way to the sink
+   @param paths The paths to be written, in the order they should appear in the tar
+   @param override_names If non-null, this gives the name to be used in the tar for each path. Individual names may be null to use the path itself.
+   @param count The number of paths to write
+   @param threads The number of worker threads. If 0, one thread per online processor is used.
+   @param max_buffered_bytes The number of bytes of file contents that may be read ahead of the sink. Files larger than this are read by the calling thread as they are written. If 0, a default of 64 MiB is used.
+   @param owners An optional cache for user and group names, as in tar_write_header. If null, a cache is kept for the duration of this call.
+   @param pax If true, headers are written in pax format as in tar_write_stat_header
+   @param hardlinks An optional table of inodes that have been written, as in tar_write_stat_header. Files that are written as hardlinks have no contents in the tar.
+*/
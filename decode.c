@@ -0,0 +1,181 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "common.h"
+#include "internal/spec.h"
+#include "internal/decode.h"
+
+#define CHKSUM_OFFSET offsetof(struct posix_header, chksum)
+#define CHKSUM_SIZE sizeof(((struct posix_header*)0)->chksum)
+
+static bool parse_base256 (unsigned long long * value, const char * field, size_t size)
+{
+    // GNU base 256: the high bit of the first byte marks the encoding, the next bit is the sign, and the remaining bits are big endian
+    
+    if (field[0] & 0x40)
+    {
+	return false;
+    }
+
+    unsigned long long result = field[0] & 0x3f;
+
+    for (size_t i = 1; i < size; i++)
+    {
+	if (result >> (8 * sizeof(result) - 8))
+	{
+	    return false;
+	}
+
+	result = (result << 8) | (unsigned char) field[i];
+    }
+
+    *value = result;
+    return true;
+}
+
+static bool parse_numeric (unsigned long long * value, const char * field, size_t size)
+{
+    if (field[0] & 0x80)
+    {
+	return parse_base256 (value, field, size);
+    }
+
+    size_t i = 0;
+
+    while (i < size && field[i] == ' ')
+    {
+	i++;
+    }
+
+    if (i == size || field[i] < '0' || field[i] > '7')
+    {
+	return false;
+    }
+
+    unsigned long long result = 0;
+
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; i++)
+    {
+	result = (result << 3) | (unsigned) (field[i] - '0');
+    }
+
+    if (i < size && field[i] != ' ' && field[i] != '\0')
+    {
+	return false;
+    }
+
+    *value = result;
+    return true;
+}
+
+bool tar_decode_numeric (unsigned long long * value, const char * field, size_t size)
+{
+    return parse_numeric (value, field, size);
+}
+
+#define decode_field(name, flag)					\
+    if (!parse_numeric (&fields->name, header->name, sizeof(header->name))) \
+    {									\
+	fields->name = 0;						\
+	fields->invalid |= flag;					\
+    }
+
+static void sum_block (unsigned long long * sum, unsigned int * high_bytes, const unsigned char * block)
+{
+#if defined(__AVX2__)
+    __m256i total = _mm256_setzero_si256();
+    unsigned int high = 0;
+
+    for (int i = 0; i < TAR_BLOCK_SIZE; i += 32)
+    {
+	__m256i bytes = _mm256_loadu_si256 ((const __m256i*) (block + i));
+	total = _mm256_add_epi64 (total, _mm256_sad_epu8 (bytes, _mm256_setzero_si256()));
+	high += __builtin_popcount ((unsigned int) _mm256_movemask_epi8 (bytes));
+    }
+
+    __m128i half = _mm_add_epi64 (_mm256_castsi256_si128 (total), _mm256_extracti128_si256 (total, 1));
+    *sum = (unsigned long long) _mm_cvtsi128_si64 (half) + (unsigned long long) _mm_cvtsi128_si64 (_mm_unpackhi_epi64 (half, half));
+    *high_bytes = high;
+#elif defined(__SSE2__)
+    __m128i total = _mm_setzero_si128();
+    unsigned int high = 0;
+
+    for (int i = 0; i < TAR_BLOCK_SIZE; i += 16)
+    {
+	__m128i bytes = _mm_loadu_si128 ((const __m128i*) (block + i));
+	total = _mm_add_epi64 (total, _mm_sad_epu8 (bytes, _mm_setzero_si128()));
+	high += __builtin_popcount ((unsigned int) _mm_movemask_epi8 (bytes));
+    }
+
+    *sum = (unsigned long long) _mm_cvtsi128_si64 (total) + (unsigned long long) _mm_cvtsi128_si64 (_mm_unpackhi_epi64 (total, total));
+    *high_bytes = high;
+#else
+    unsigned long long total = 0;
+    unsigned int high = 0;
+
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+    {
+	total += block[i];
+	high += block[i] >> 7;
+    }
+
+    *sum = total;
+    *high_bytes = high;
+#endif
+}
+
+void tar_decode_header (tar_header_fields * fields, const unsigned char * block)
+{
+    const struct posix_header * header = (const void*) block;
+
+    unsigned long long sum;
+    unsigned int high_bytes;
+
+    sum_block (&sum, &high_bytes, block);
+
+    *fields = (tar_header_fields){ .zero = !sum };
+
+    if (fields->zero)
+    {
+	return;
+    }
+
+    unsigned long long chksum_sum = 0;
+    unsigned int chksum_high_bytes = 0;
+
+    for (size_t i = 0; i < CHKSUM_SIZE; i++)
+    {
+	chksum_sum += block[CHKSUM_OFFSET + i];
+	chksum_high_bytes += block[CHKSUM_OFFSET + i] >> 7;
+    }
+
+    fields->sum_unsigned = sum - chksum_sum + CHKSUM_SIZE * ' ';
+    fields->sum_signed = (long long) fields->sum_unsigned - 256 * (long long) (high_bytes - chksum_high_bytes);
+
+    decode_field (mode, TAR_FIELD_MODE);
+    decode_field (uid, TAR_FIELD_UID);
+    decode_field (gid, TAR_FIELD_GID);
+    decode_field (size, TAR_FIELD_SIZE);
+    decode_field (mtime, TAR_FIELD_MTIME);
+    if (!parse_numeric (&fields->chksum, header->chksum, sizeof(header->chksum)) || (header->chksum[0] & 0x80))
+    {
+	fields->chksum = 0;
+	fields->invalid |= TAR_FIELD_CHKSUM;
+    }
+}
+
+bool tar_header_checksum_matches (const tar_header_fields * fields)
+{
+    return !(fields->invalid & TAR_FIELD_CHKSUM)
+	&& (fields->chksum == fields->sum_unsigned || (long long) fields->chksum == fields->sum_signed);
+}
@@ -0,0 +1,989 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../convert/source.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "read.h"
+#include "extract.h"
+#include "../log/log.h"
+
+#define PATH_SEPARATOR '/'
+#define DEFAULT_MAX_QUEUED_BYTES (64 * 1024 * 1024)
+
+typedef struct extract_job extract_job;
+struct extract_job
+{
+    extract_job * next;
+    tar_type type;
+    unsigned int mode;
+    char * path;
+    char * link;
+    window_unsigned_char contents;
+    window_tar_sparse_extent map; ///< The data extents of a sparse file, which is written with holes between them
+    unsigned long long sparse_size; ///< The size of a sparse file, including holes
+};
+
+typedef struct extract_directory extract_directory;
+struct extract_directory
+{
+    extract_directory * next;
+    unsigned int mode;
+    char * path;
+};
+
+typedef struct extract_pool extract_pool;
+struct extract_pool
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    extract_job * head;
+    extract_job ** tail;
+    const char ** running; ///< The paths of the jobs being run, one slot per thread
+    unsigned int running_count;
+    size_t queued_bytes;
+    size_t pending_jobs;
+    bool finished;
+    bool error;
+    int dirfd;
+};
+
+static bool safe_path (const char * path)
+{
+    if (!*path)
+    {
+	return false;
+    }
+
+    while (*path)
+    {
+	if (path[0] == '.' && path[1] == '.' && (path[2] == PATH_SEPARATOR || path[2] == '\0'))
+	{
+	    return false;
+	}
+
+	while (*path && *path != PATH_SEPARATOR)
+	{
+	    path++;
+	}
+
+	while (*path == PATH_SEPARATOR)
+	{
+	    path++;
+	}
+    }
+
+    return true;
+}
+
+static const char * relative_path (const char * path)
+{
+    while (*path == PATH_SEPARATOR)
+    {
+	path++;
+    }
+
+    return path;
+}
+
+static bool next_component (range_const_char * component, const char ** path, const char * end)
+{
+    while (*path < end && **path == PATH_SEPARATOR)
+    {
+	(*path)++;
+    }
+
+    if (*path == end)
+    {
+	return false;
+    }
+
+    component->begin = *path;
+
+    while (*path < end && **path != PATH_SEPARATOR)
+    {
+	(*path)++;
+    }
+
+    component->end = *path;
+
+    return true;
+}
+
+static bool is_dot (range_const_char component, int dots)
+{
+    return range_count (component) == dots && (dots < 1 || component.begin[0] == '.') && (dots < 2 || component.begin[1] == '.');
+}
+
+static bool safe_link (const char * path, const char * link)
+{
+    // a symlink is refused if its target is absolute or climbs above the extraction directory, counting from the directory that holds it
+
+    if (*link == PATH_SEPARATOR)
+    {
+	return false;
+    }
+
+    range_const_char component;
+    const char * end = path + strlen (path);
+    long depth = -1;
+
+    while (next_component (&component, &path, end))
+    {
+	depth += !is_dot (component, 1);
+    }
+
+    end = link + strlen (link);
+
+    while (next_component (&component, &link, end))
+    {
+	if (is_dot (component, 2) && --depth < 0)
+	{
+	    return false;
+	}
+
+	depth += !is_dot (component, 1) && !is_dot (component, 2);
+    }
+
+    return true;
+}
+
+static bool copy_component (char * output, range_const_char component)
+{
+    if (range_count (component) > NAME_MAX)
+    {
+	errno = ENAMETOOLONG;
+	return false;
+    }
+
+    memcpy (output, component.begin, range_count (component));
+    output[range_count (component)] = '\0';
+
+    return true;
+}
+
+static void close_parent (int dirfd, int fd)
+{
+    int error = errno;
+
+    if (fd >= 0 && fd != dirfd)
+    {
+	close (fd);
+    }
+
+    errno = error;
+}
+
+static int open_beneath (int dirfd, const char * path, size_t size)
+{
+    // openat2 resolves the whole path in one call, refusing symlinks and anything outside of dirfd, and the component walk is the fallback when it is unavailable or a directory is missing
+
+    char buffer[PATH_MAX];
+
+    if (size >= sizeof(buffer))
+    {
+	return -1;
+    }
+
+    memcpy (buffer, path, size);
+    buffer[size] = '\0';
+
+    struct open_how how = {
+	.flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC,
+	.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS,
+    };
+
+    return syscall (SYS_openat2, dirfd, buffer, &how, sizeof(how));
+}
+
+static int open_parent (int dirfd, const char * path, char * name, bool create)
+{
+    // every directory leading to an item is opened without following symlinks, so that a symlink extracted earlier, or one already in the extraction directory, cannot lead an item outside of it
+
+    const char * end = path + strlen (path);
+
+    while (end > path && end[-1] == PATH_SEPARATOR)
+    {
+	end--;
+    }
+
+    const char * base = end;
+
+    while (base > path && base[-1] != PATH_SEPARATOR)
+    {
+	base--;
+    }
+
+    if (base == end)
+    {
+	errno = ENOENT;
+	return -1;
+    }
+
+    if (!copy_component (name, (range_const_char){ .begin = base, .end = end }))
+    {
+	return -1;
+    }
+
+    if (base == path)
+    {
+	return dirfd;
+    }
+
+    int fd = open_beneath (dirfd, path, base - path);
+
+    if (fd >= 0)
+    {
+	return fd;
+    }
+
+    fd = dirfd;
+
+    range_const_char component;
+    char component_name[NAME_MAX + 1];
+
+    while (next_component (&component, &path, base))
+    {
+	if (is_dot (component, 1))
+	{
+	    continue;
+	}
+
+	if (!copy_component (component_name, component))
+	{
+	    close_parent (dirfd, fd);
+	    return -1;
+	}
+
+	int next = openat (fd, component_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+	if (next < 0 && errno == ENOENT && create && (0 == mkdirat (fd, component_name, 0777) || errno == EEXIST))
+	{
+	    next = openat (fd, component_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	}
+
+	close_parent (dirfd, fd);
+
+	if (next < 0)
+	{
+	    return -1;
+	}
+
+	fd = next;
+    }
+
+    return fd;
+}
+
+static bool make_directory (int dirfd, const char * path)
+{
+    char name[NAME_MAX + 1];
+    int parent = open_parent (dirfd, path, name, true);
+    struct stat stat;
+
+    // an existing directory is kept, but anything else in its place is replaced
+
+    bool retval = parent >= 0
+	&& (0 == mkdirat (parent, name, 0700)
+	    || (errno == EEXIST
+		&& 0 == fstatat (parent, name, &stat, AT_SYMLINK_NOFOLLOW)
+		&& (S_ISDIR (stat.st_mode)
+		    || (0 == unlinkat (parent, name, 0) && 0 == mkdirat (parent, name, 0700)))));
+
+    if (!retval)
+    {
+	perror (path);
+    }
+
+    close_parent (dirfd, parent);
+
+    return retval;
+}
+
+static bool set_directory_mode (int dirfd, const char * path, unsigned int mode)
+{
+    char name[NAME_MAX + 1];
+    int parent = open_parent (dirfd, path, name, false);
+    int fd = parent < 0 ? -1 : openat (parent, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    bool retval = fd >= 0 && 0 == fchmod (fd, mode & 07777);
+
+    if (!retval)
+    {
+	perror (path);
+    }
+
+    if (fd >= 0)
+    {
+	close (fd);
+    }
+
+    close_parent (dirfd, parent);
+
+    return retval;
+}
+
+static int open_output (int dirfd, const char * path, unsigned int mode)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW;
+
+    char name[NAME_MAX + 1];
+    int parent = open_parent (dirfd, path, name, true);
+    int fd = parent < 0 ? -1 : openat (parent, name, flags, mode & 07777);
+
+    if (fd < 0 && parent >= 0 && errno == ELOOP && 0 == unlinkat (parent, name, 0))
+    {
+	fd = openat (parent, name, flags, mode & 07777);
+    }
+
+    if (fd < 0)
+    {
+	perror (path);
+    }
+
+    close_parent (dirfd, parent);
+
+    return fd;
+}
+
+static bool write_all (int fd, const unsigned char * begin, const unsigned char * end)
+{
+    while (begin < end)
+    {
+	ssize_t size = write (fd, begin, end - begin);
+
+	if (size < 0)
+	{
+	    if (errno == EINTR)
+	    {
+		continue;
+	    }
+
+	    perror ("write");
+	    return false;
+	}
+
+	begin += size;
+    }
+
+    return true;
+}
+
+typedef struct sparse_cursor sparse_cursor;
+struct sparse_cursor
+{
+    const tar_sparse_extent * extent;
+    const tar_sparse_extent * end;
+    unsigned long long done; ///< The number of bytes of extent that have been written
+};
+
+static bool write_sparse (int fd, sparse_cursor * cursor, const unsigned char * begin, const unsigned char * end)
+{
+    // the contents of a sparse file are its extents placed end to end, so each part is written at the position of the extent it falls in
+
+    while (begin < end)
+    {
+	if (cursor->extent == cursor->end)
+	{
+	    log_error ("Sparse file contents are larger than its map");
+	    return false;
+	}
+
+	unsigned long long want = cursor->extent->size - cursor->done;
+	size_t size = want < (unsigned long long) (end - begin) ? want : (size_t) (end - begin);
+	ssize_t written = pwrite (fd, begin, size, cursor->extent->offset + cursor->done);
+
+	if (written < 0)
+	{
+	    if (errno == EINTR)
+	    {
+		continue;
+	    }
+
+	    perror ("pwrite");
+	    return false;
+	}
+
+	begin += written;
+	cursor->done += written;
+
+	if (cursor->done == cursor->extent->size)
+	{
+	    cursor->extent++;
+	    cursor->done = 0;
+	}
+    }
+
+    return true;
+}
+
+static bool finish_sparse (int fd, const char * path, unsigned long long size)
+{
+    // holes are left by never writing them, and a trailing hole by extending the file
+
+    if (-1 == ftruncate (fd, size))
+    {
+	perror (path);
+	return false;
+    }
+
+    return true;
+}
+
+static bool extract_symlink (int dirfd, const char * path, const char * link)
+{
+    char name[NAME_MAX + 1];
+    int parent = open_parent (dirfd, path, name, true);
+
+    bool retval = parent >= 0
+	&& (0 == symlinkat (link, parent, name)
+	    || (errno == EEXIST && 0 == unlinkat (parent, name, 0) && 0 == symlinkat (link, parent, name)));
+
+    if (!retval)
+    {
+	perror (path);
+    }
+
+    close_parent (dirfd, parent);
+
+    return retval;
+}
+
+static bool extract_hardlink (int dirfd, const char * path, const char * link)
+{
+    if (!strcmp (path, link))
+    {
+	// tar writes a file that it is given twice as a hardlink to itself the second time, and it is already in place
+	return true;
+    }
+
+    char link_name[NAME_MAX + 1];
+    char name[NAME_MAX + 1];
+    int link_parent = open_parent (dirfd, link, link_name, false);
+    int parent = link_parent < 0 ? -1 : open_parent (dirfd, path, name, true);
+
+    bool retval = parent >= 0
+	&& (0 == linkat (link_parent, link_name, parent, name, 0)
+	    || (errno == EEXIST && 0 == unlinkat (parent, name, 0) && 0 == linkat (link_parent, link_name, parent, name, 0)));
+
+    if (!retval)
+    {
+	perror (path);
+    }
+
+    close_parent (dirfd, parent);
+    close_parent (dirfd, link_parent);
+
+    return retval;
+}
+
+static bool remove_tree (int parent, const char * name)
+{
+    // the contents of a directory are removed before it, and symlinks are removed rather than followed
+
+    if (0 == unlinkat (parent, name, 0) || errno == ENOENT)
+    {
+	return true;
+    }
+
+    if (errno != EISDIR && errno != EPERM)
+    {
+	return false;
+    }
+
+    int fd = openat (parent, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR * dir = fd < 0 ? NULL : fdopendir (fd);
+
+    if (!dir)
+    {
+	if (fd >= 0)
+	{
+	    close (fd);
+	}
+
+	return false;
+    }
+
+    bool retval = true;
+    struct dirent * entry;
+
+    while (retval && (entry = readdir (dir)))
+    {
+	if (strcmp (entry->d_name, ".") && strcmp (entry->d_name, ".."))
+	{
+	    retval = remove_tree (fd, entry->d_name);
+	}
+    }
+
+    closedir (dir);
+
+    return retval && 0 == unlinkat (parent, name, AT_REMOVEDIR);
+}
+
+static bool extract_deleted (int dirfd, const char * path, const window_char * deleted)
+{
+    // each name is an entry of the directory at path, which is removed along with anything beneath it
+
+    bool retval = true;
+
+    for (const char * name = deleted->region.begin; name < deleted->region.end; name += strlen (name) + 1)
+    {
+	size_t size = strlen (path) + 1 + strlen (name) + 1;
+	char * entry_path = malloc (size);
+	snprintf (entry_path, size, "%s%c%s", path, PATH_SEPARATOR, name);
+
+	char entry_name[NAME_MAX + 1];
+	int parent = open_parent (dirfd, entry_path, entry_name, false);
+
+	if (parent >= 0 ? !remove_tree (parent, entry_name) : errno != ENOENT)
+	{
+	    perror (entry_path);
+	    retval = false;
+	}
+
+	close_parent (dirfd, parent);
+	free (entry_path);
+    }
+
+    return retval;
+}
+
+static bool run_job (int dirfd, extract_job * job)
+{
+    if (job->type == TAR_DIR)
+    {
+	return make_directory (dirfd, job->path);
+    }
+
+    if (job->type == TAR_SYMLINK)
+    {
+	return extract_symlink (dirfd, job->path, job->link);
+    }
+
+    assert (job->type == TAR_FILE);
+
+    int fd = open_output (dirfd, job->path, job->mode);
+
+    if (fd < 0)
+    {
+	return false;
+    }
+
+    bool retval;
+
+    if (job->sparse_size)
+    {
+	sparse_cursor cursor = { .extent = job->map.region.begin, .end = job->map.region.end };
+	retval = write_sparse (fd, &cursor, job->contents.region.begin, job->contents.region.end)
+	    && finish_sparse (fd, job->path, job->sparse_size);
+    }
+    else
+    {
+	retval = write_all (fd, job->contents.region.begin, job->contents.region.end);
+    }
+
+    if (close (fd) < 0)
+    {
+	perror (job->path);
+	retval = false;
+    }
+
+    return retval;
+}
+
+static void free_job (extract_job * job)
+{
+    free (job->path);
+    free (job->link);
+    window_clear (job->contents);
+    window_clear (job->map);
+    free (job);
+}
+
+static bool paths_overlap (const char * a, const char * b)
+{
+    // true if the paths are the same, or one of them is beneath the other
+
+    const char * begin = a;
+    
+    while (*a && *a == *b)
+    {
+	a++;
+	b++;
+    }
+
+    if (*a && *b)
+    {
+	return false;
+    }
+
+    return (!*a && !*b) || *a == PATH_SEPARATOR || *b == PATH_SEPARATOR || (a > begin && a[-1] == PATH_SEPARATOR);
+}
+
+static bool job_is_blocked (const extract_pool * pool, const extract_job * job)
+{
+    for (unsigned int i = 0; i < pool->running_count; i++)
+    {
+	if (paths_overlap (pool->running[i], job->path))
+	{
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+static void * worker_thread (void * arg)
+{
+    extract_pool * pool = arg;
+
+    pthread_mutex_lock (&pool->mutex);
+
+    while (true)
+    {
+	// jobs are started in archive order, and a job waits for any running job on the same path or a path above or beneath it, so that the last of several items at a path is the one left behind
+
+	extract_job * job = pool->head;
+
+	if (!job && pool->finished)
+	{
+	    break;
+	}
+
+	if (!job || job_is_blocked (pool, job))
+	{
+	    pthread_cond_wait (&pool->job_ready, &pool->mutex);
+	    continue;
+	}
+
+	pool->head = job->next;
+
+	if (!pool->head)
+	{
+	    pool->tail = &pool->head;
+	}
+
+	const char * path = job->path;
+	pool->running[pool->running_count++] = path;
+
+	pthread_mutex_unlock (&pool->mutex);
+
+	bool success = run_job (pool->dirfd, job);
+
+	pthread_mutex_lock (&pool->mutex);
+
+	for (unsigned int i = 0; i < pool->running_count; i++)
+	{
+	    if (pool->running[i] == path)
+	    {
+		pool->running[i] = pool->running[--pool->running_count];
+		break;
+	    }
+	}
+
+	pool->queued_bytes -= range_count (job->contents.region);
+	pool->pending_jobs--;
+
+	if (!success)
+	{
+	    pool->error = true;
+	}
+
+	free_job (job);
+
+	pthread_cond_broadcast (&pool->job_done);
+	pthread_cond_broadcast (&pool->job_ready);
+    }
+
+    pthread_mutex_unlock (&pool->mutex);
+
+    return NULL;
+}
+
+static void pool_push (extract_pool * pool, extract_job * job, size_t max_queued_bytes)
+{
+    size_t job_bytes = range_count (job->contents.region);
+
+    pthread_mutex_lock (&pool->mutex);
+
+    while (pool->queued_bytes && pool->queued_bytes + job_bytes > max_queued_bytes)
+    {
+	pthread_cond_wait (&pool->job_done, &pool->mutex);
+    }
+
+    job->next = NULL;
+    *pool->tail = job;
+    pool->tail = &job->next;
+    pool->queued_bytes += job_bytes;
+    pool->pending_jobs++;
+
+    pthread_cond_signal (&pool->job_ready);
+    pthread_mutex_unlock (&pool->mutex);
+}
+
+static bool pool_wait_idle (extract_pool * pool)
+{
+    pthread_mutex_lock (&pool->mutex);
+
+    while (pool->pending_jobs)
+    {
+	pthread_cond_wait (&pool->job_done, &pool->mutex);
+    }
+
+    bool error = pool->error;
+
+    pthread_mutex_unlock (&pool->mutex);
+
+    return !error;
+}
+
+static bool extract_file_direct (int dirfd, tar_state * state, const char * path)
+{
+    int fd = open_output (dirfd, path, state->mode);
+
+    if (fd < 0)
+    {
+	tar_skip_file (state);
+	return false;
+    }
+
+    bool error = false;
+    bool retval = true;
+    range_const_unsigned_char part;
+
+    sparse_cursor cursor = { .extent = state->sparse.map.region.begin, .end = state->sparse.map.region.end };
+
+    while (tar_read_file_part (&error, &part, state))
+    {
+	if (retval && !(state->sparse.is_sparse ? write_sparse (fd, &cursor, part.begin, part.end) : write_all (fd, part.begin, part.end)))
+	{
+	    retval = false;
+	}
+    }
+
+    if (retval && state->sparse.is_sparse && !finish_sparse (fd, path, state->sparse.size))
+    {
+	retval = false;
+    }
+
+    if (close (fd) < 0)
+    {
+	perror (path);
+	retval = false;
+    }
+
+    return retval && !error && state->type != TAR_ERROR;
+}
+
+keyargs_define(tar_extract)
+{
+    assert (args.state);
+
+    if (!args.threads)
+    {
+	long online = sysconf (_SC_NPROCESSORS_ONLN);
+	args.threads = online > 0 ? online : 1;
+    }
+
+    if (!args.max_queued_bytes)
+    {
+	args.max_queued_bytes = DEFAULT_MAX_QUEUED_BYTES;
+    }
+
+    extract_pool pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.job_ready = PTHREAD_COND_INITIALIZER,
+	.job_done = PTHREAD_COND_INITIALIZER,
+	.tail = &pool.head,
+	.dirfd = args.directory ? open (args.directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : AT_FDCWD,
+    };
+
+    if (pool.dirfd < 0 && pool.dirfd != AT_FDCWD)
+    {
+	perror (args.directory);
+	log_error ("Failed to open extraction directory %s", args.directory);
+	return false;
+    }
+
+    pthread_t * threads = calloc (args.threads, sizeof(*threads));
+    pool.running = calloc (args.threads, sizeof(*pool.running));
+    unsigned int started = 0;
+
+    for (; started < args.threads; started++)
+    {
+	if (pthread_create (threads + started, NULL, worker_thread, &pool))
+	{
+	    log_error ("Failed to start extraction thread");
+	    break;
+	}
+    }
+
+    extract_directory * directories = NULL;
+    bool success = started > 0;
+
+    while (success && tar_update (args.state))
+    {
+	const char * path = relative_path (args.state->path.region.begin);
+
+	if (!safe_path (path))
+	{
+	    log_error ("Refusing to extract unsafe path %s", args.state->path.region.begin);
+	    success = false;
+	    break;
+	}
+
+	extract_job * job;
+
+	switch (args.state->type)
+	{
+	case TAR_DIR:
+	    job = calloc (1, sizeof(*job));
+	    *job = (extract_job){ .type = TAR_DIR, .path = strdup (path) };
+	    pool_push (&pool, job, args.max_queued_bytes);
+
+	    if (range_count (args.state->deleted.region) && !(pool_wait_idle (&pool) && extract_deleted (pool.dirfd, path, &args.state->deleted)))
+	    {
+		success = false;
+		break;
+	    }
+
+	    extract_directory * directory = malloc (sizeof(*directory));
+	    *directory = (extract_directory){ .next = directories, .mode = args.state->mode, .path = strdup (path) };
+	    directories = directory;
+	    break;
+
+	case TAR_FILE:
+	    if (args.state->file.size > args.max_queued_bytes)
+	    {
+		success = pool_wait_idle (&pool) && extract_file_direct (pool.dirfd, args.state, path);
+		break;
+	    }
+
+	    job = calloc (1, sizeof(*job));
+	    *job = (extract_job){ .type = TAR_FILE, .mode = args.state->mode, .path = strdup (path) };
+
+	    if (args.state->sparse.is_sparse)
+	    {
+		for (const tar_sparse_extent * extent = args.state->sparse.map.region.begin; extent < args.state->sparse.map.region.end; extent++)
+		{
+		    *window_push (job->map) = *extent;
+		}
+		
+		job->sparse_size = args.state->sparse.size;
+	    }
+
+	    if (!tar_read_file_whole (&job->contents, args.state))
+	    {
+		log_error ("Failed to read contents of %s", path);
+		free_job (job);
+		success = false;
+		break;
+	    }
+
+	    pool_push (&pool, job, args.max_queued_bytes);
+	    break;
+
+	case TAR_SYMLINK:
+	    if (!safe_link (path, args.state->link.path.region.begin))
+	    {
+		log_error ("Refusing to extract symlink %s with an unsafe target", path);
+		success = false;
+		break;
+	    }
+
+	    job = calloc (1, sizeof(*job));
+	    *job = (extract_job){ .type = TAR_SYMLINK, .path = strdup (path), .link = strdup (args.state->link.path.region.begin) };
+	    pool_push (&pool, job, args.max_queued_bytes);
+	    break;
+
+	case TAR_HARDLINK:
+	    if (!safe_path (relative_path (args.state->link.path.region.begin)))
+	    {
+		log_error ("Refusing to extract hardlink to unsafe path %s", args.state->link.path.region.begin);
+		success = false;
+		break;
+	    }
+
+	    success = pool_wait_idle (&pool) && extract_hardlink (pool.dirfd, path, relative_path (args.state->link.path.region.begin));
+	    break;
+
+	default:
+	    log_error ("Cannot extract item of type %d: %s", args.state->type, path);
+	    success = false;
+	    break;
+	}
+    }
+
+    if (success && args.state->type != TAR_END)
+    {
+	log_error ("Failed to read the tar being extracted");
+	success = false;
+    }
+
+    pthread_mutex_lock (&pool.mutex);
+    pool.finished = true;
+    pthread_cond_broadcast (&pool.job_ready);
+    pthread_mutex_unlock (&pool.mutex);
+
+    for (unsigned int i = 0; i < started; i++)
+    {
+	pthread_join (threads[i], NULL);
+    }
+
+    free (threads);
+    free (pool.running);
+
+    if (pool.error)
+    {
+	success = false;
+    }
+
+    while (pool.head)
+    {
+	extract_job * job = pool.head;
+	pool.head = job->next;
+	free_job (job);
+    }
+
+    while (directories)
+    {
+	extract_directory * directory = directories;
+	directories = directory->next;
+
+	if (!set_directory_mode (pool.dirfd, directory->path, directory->mode))
+	{
+	    success = false;
+	}
+
+	free (directory->path);
+	free (directory);
+    }
+
+    if (pool.dirfd != AT_FDCWD)
+    {
+	close (pool.dirfd);
+    }
+
+    pthread_mutex_destroy (&pool.mutex);
+    pthread_cond_destroy (&pool.job_ready);
+    pthread_cond_destroy (&pool.job_done);
+
+    return success;
+}
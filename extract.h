@@ -0,0 +1,33 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "read.h"
+#endif
+
+/**
+   @file tar/extract.h
+   Describes an extraction engine which recreates the contents of a tar on the filesystem. The calling thread parses the tar with tar_update and hands the contents of each item to a pool of writer threads, which create directories, files and symlinks concurrently.
+   Items are started in archive order, and a writer waits while another is working on the same path or on a path above or beneath it. Directories therefore exist before their children are written, and the last of several items with the same path is the one left behind. Hardlinks are created only after every previously parsed item has been written, so that their targets exist. The entries that an incremental tar records as deleted from a directory are removed, along with anything beneath them, once the directory and every previously parsed item have been written. Directory permissions are applied after everything else has been extracted, so that read-only directories may still be populated.
+   Every item is created relative to the extraction directory without following symlinks, whether they were extracted from the tar or already present, so no item can be written outside of it. A symlink in the place of a directory is replaced by the directory. Symlinks whose targets are absolute or climb above the extraction directory are refused, as are paths containing '..'.
+*/
+
+keyargs_declare(bool,tar_extract,
+		tar_state * state;
+		const char * directory;
+		unsigned int threads;
+		size_t max_queued_bytes;);
+#define tar_extract(...) keyargs_call(tar_extract, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that extracts the remainder of a tar into a directory.
+   @return True if every item was extracted, false otherwise
+   @param state A state whose source reads from the tar to be extracted
+   @param directory The directory into which the tar will be extracted. If NULL, the working directory is used.
+   @param threads The number of writer threads. If 0, one thread per online processor is used.
+   @param max_queued_bytes The number of bytes of file contents that may be held in memory waiting to be written. Files larger than this are written by the calling thread as they are read. If 0, a default of 64 MiB is used.
+*/
@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <zlib.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../keyargs/keyargs.h"
+#include "../convert/source.h"
+#include "../convert/sink.h"
+#include "gz.h"
+#include "../log/log.h"
+
+#define CHUNK_SIZE (64 * 1024)
+#define GZIP_WINDOW_BITS (15 + 16) // 16 selects the gzip wrapper rather than zlib's
+#define GZIP_AUTO_WINDOW_BITS (15 + 32) // 32 accepts either wrapper
+
+static bool gz_source_read (bool * error, convert_source * source)
+{
+    tar_gz_source * gz = (tar_gz_source*) source;
+
+    if (!gz->started)
+    {
+	if (Z_OK != inflateInit2 (&gz->stream, GZIP_AUTO_WINDOW_BITS))
+	{
+	    log_fatal ("Failed to initialize gzip decompression: %s", gz->stream.msg ? gz->stream.msg : "unknown error");
+	}
+
+	gz->started = true;
+    }
+
+    while (!gz->finished)
+    {
+	// zlib may hold output from earlier input, so it is run before more input is read
+	
+	window_unsigned_char * input = gz->input->contents;
+	unsigned char * output = window_grow_bytes (source->contents, CHUNK_SIZE);
+
+	gz->stream.next_in = input->region.begin;
+	gz->stream.avail_in = range_count (input->region);
+	gz->stream.next_out = output;
+	gz->stream.avail_out = CHUNK_SIZE;
+
+	int result = inflate (&gz->stream, Z_NO_FLUSH);
+
+	input->region.begin = gz->stream.next_in;
+	source->contents->region.end -= gz->stream.avail_out;
+
+	if (result == Z_STREAM_END)
+	{
+	    // another gzip member may follow, as produced by concatenating .gz files
+	    
+	    if (Z_OK != inflateReset (&gz->stream))
+	    {
+		log_fatal ("Failed to reset gzip decompression");
+	    }
+	}
+	else if (result != Z_OK && result != Z_BUF_ERROR)
+	{
+	    log_fatal ("Gzip decompression failed: %s", gz->stream.msg ? gz->stream.msg : "corrupt input");
+	}
+
+	if (gz->stream.avail_out < CHUNK_SIZE)
+	{
+	    return true;
+	}
+
+	if (range_is_empty (input->region) && !convert_fill (error, gz->input))
+	{
+	    if (*error)
+	    {
+		log_fatal ("Failed to read gzip input");
+	    }
+
+	    // inflateReset clears total_in, so it is only nonzero partway through a member
+	    
+	    if (gz->stream.total_in)
+	    {
+		log_fatal ("Gzip input is truncated");
+	    }
+
+	    gz->finished = true;
+	}
+    }
+
+    return false;
+
+fail:
+    *error = true;
+    return false;
+}
+
+static void gz_source_clear (convert_source * source)
+{
+    tar_gz_source * gz = (tar_gz_source*) source;
+
+    if (gz->started)
+    {
+	inflateEnd (&gz->stream);
+	gz->started = false;
+    }
+}
+
+keyargs_define(tar_gz_source_init)
+{
+    assert (args.input);
+    assert (args.contents);
+
+    return (tar_gz_source){
+	.source = { .contents = args.contents, .read = gz_source_read, .clear = gz_source_clear },
+	.input = args.input,
+    };
+}
+
+static bool gz_sink_deflate (tar_gz_sink * gz, range_const_unsigned_char * input, int flush)
+{
+    if (!gz->started)
+    {
+	if (Z_OK != deflateInit2 (&gz->stream, gz->level ? gz->level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY))
+	{
+	    log_fatal ("Failed to initialize gzip compression");
+	}
+
+	gz->started = true;
+    }
+
+    gz->stream.next_in = (unsigned char*) input->begin;
+    gz->stream.avail_in = range_count (*input);
+
+    int result;
+
+    do
+    {
+	unsigned char * output = window_grow_bytes (&gz->buffer, CHUNK_SIZE);
+
+	gz->stream.next_out = output;
+	gz->stream.avail_out = CHUNK_SIZE;
+
+	result = deflate (&gz->stream, flush);
+
+	gz->buffer.region.end -= gz->stream.avail_out;
+
+	if (result == Z_STREAM_ERROR)
+	{
+	    log_fatal ("Gzip compression failed");
+	}
+    }
+    while (gz->stream.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+
+    input->begin = gz->stream.next_in;
+
+    bool error = false;
+
+    gz->output->contents = &gz->buffer.region.const_cast;
+
+    if (!convert_drain (&error, gz->output))
+    {
+	log_fatal ("Failed to write gzip output");
+    }
+
+    window_rewrite (gz->buffer);
+
+    return true;
+
+fail:
+    return false;
+}
+
+static bool gz_sink_write (bool * error, convert_sink * sink)
+{
+    if (!gz_sink_deflate ((tar_gz_sink*) sink, sink->contents, Z_NO_FLUSH))
+    {
+	*error = true;
+	return false;
+    }
+
+    return true;
+}
+
+static void gz_sink_clear (convert_sink * sink)
+{
+    tar_gz_sink * gz = (tar_gz_sink*) sink;
+
+    if (gz->started)
+    {
+	deflateEnd (&gz->stream);
+	gz->started = false;
+    }
+
+    window_clear (gz->buffer);
+}
+
+keyargs_define(tar_gz_sink_init)
+{
+    assert (args.output);
+
+    return (tar_gz_sink){
+	.sink = { .write = gz_sink_write, .clear = gz_sink_clear },
+	.output = args.output,
+	.level = args.level,
+    };
+}
+
+bool tar_gz_sink_finish (tar_gz_sink * sink)
+{
+    range_const_unsigned_char rest = {0};
+
+    if (sink->sink.contents)
+    {
+	rest = *sink->sink.contents;
+	sink->sink.contents->begin = sink->sink.contents->end;
+    }
+
+    return gz_sink_deflate (sink, &rest, Z_FINISH);
+}
@@ -0,0 +1,67 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#include <zlib.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "../convert/sink.h"
+#include "../keyargs/keyargs.h"
+#endif
+
+/**
+   @file tar/gz.h
+   Describes a gzip decompressing source and a gzip compressing sink, so that a .tar.gz can be read or written in one process. The source reads compressed bytes from another source and may be given to tar_state.source. The sink compresses the bytes given to it and writes them to another sink, and may be given to tar_write_sink_path, tar_write_sink_paths, and tar_write_sink_end.
+*/
+
+typedef struct tar_gz_source tar_gz_source;
+struct tar_gz_source {
+    convert_source source; ///< The decompressed contents, to be read through convert functions
+    convert_source * input; ///< The source of compressed contents
+    z_stream stream; ///< The zlib state, which is initialized on the first read
+    bool started; ///< True if stream has been initialized
+    bool finished; ///< True if the compressed input has ended
+};
+/**< @struct tar_gz_source
+   A source that decompresses gzip data read from another source. Concatenated gzip members are decompressed as one stream.
+*/
+
+keyargs_declare(tar_gz_source,tar_gz_source_init,
+		convert_source * input;
+		window_unsigned_char * contents;);
+#define tar_gz_source_init(...) keyargs_call(tar_gz_source_init, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that creates a gzip decompressing source. It must be cleared with convert_source_clear.
+   @param input The source of compressed contents
+   @param contents The buffer into which decompressed contents are written
+*/
+
+typedef struct tar_gz_sink tar_gz_sink;
+struct tar_gz_sink {
+    convert_sink sink; ///< Accepts the uncompressed contents through convert functions
+    convert_sink * output; ///< The sink to which compressed contents are written
+    window_unsigned_char buffer; ///< Holds compressed contents on their way to output
+    z_stream stream; ///< The zlib state, which is initialized on the first write
+    int level; ///< The compression level
+    bool started; ///< True if stream has been initialized
+};
+/**< @struct tar_gz_sink
+   A sink that compresses its contents with gzip and writes them to another sink.
+*/
+
+keyargs_declare(tar_gz_sink,tar_gz_sink_init,
+		convert_sink * output;
+		int level;);
+#define tar_gz_sink_init(...) keyargs_call(tar_gz_sink_init, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that creates a gzip compressing sink. It must be finished with tar_gz_sink_finish and then cleared with convert_sink_clear.
+   @param output The sink to which compressed contents are written
+   @param level The zlib compression level, from 1 to 9. If 0, zlib's default level is used.
+*/
+
+bool tar_gz_sink_finish (tar_gz_sink * sink);
+/**<
+   @brief Compresses anything still held by the sink, writes the gzip trailer, and drains it to the output. Call this after tar_write_sink_end.
+   @return True if successful, false otherwise
+*/
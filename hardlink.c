@@ -0,0 +1,376 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "hardlink.h"
+
+#define INITIAL_SLOT_COUNT 64
+#define READ_CHUNK_SIZE (64 * 1024)
+
+static uint64_t mix (uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+
+    return value;
+}
+
+static size_t hash_inode (dev_t dev, ino_t ino)
+{
+    return mix (((uint64_t) dev * 0x9E3779B97F4A7C15ULL) ^ (uint64_t) ino);
+}
+
+static tar_hardlink_entry * find_slot (tar_hardlink_entry * slots, size_t slot_count, dev_t dev, ino_t ino)
+{
+    size_t mask = slot_count - 1;
+
+    for (size_t i = hash_inode (dev, ino) & mask; ; i = (i + 1) & mask)
+    {
+	tar_hardlink_entry * slot = slots + i;
+
+	if (!slot->name_begin || (slot->dev == dev && slot->ino == ino))
+	{
+	    return slot;
+	}
+    }
+}
+
+static void grow_slots (tar_hardlink_table * table)
+{
+    size_t slot_count = table->slot_count ? table->slot_count * 2 : INITIAL_SLOT_COUNT;
+    tar_hardlink_entry * slots = calloc (slot_count, sizeof(*slots));
+
+    assert (slots);
+
+    for (size_t i = 0; i < table->slot_count; i++)
+    {
+	if (table->slots[i].name_begin)
+	{
+	    *find_slot (slots, slot_count, table->slots[i].dev, table->slots[i].ino) = table->slots[i];
+	}
+    }
+
+    free (table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+}
+
+static size_t * find_size_slot (const tar_hardlink_table * table, size_t * size_slots, size_t size_slot_count, unsigned long long size)
+{
+    size_t mask = size_slot_count - 1;
+
+    for (size_t i = mix (size) & mask; ; i = (i + 1) & mask)
+    {
+	size_t * slot = size_slots + i;
+
+	if (!*slot || table->contents.region.begin[*slot - 1].size == size)
+	{
+	    return slot;
+	}
+    }
+}
+
+static void grow_size_slots (tar_hardlink_table * table)
+{
+    size_t size_slot_count = table->size_slot_count ? table->size_slot_count * 2 : INITIAL_SLOT_COUNT;
+    size_t * size_slots = calloc (size_slot_count, sizeof(*size_slots));
+
+    assert (size_slots);
+
+    for (size_t i = 0; i < table->size_slot_count; i++)
+    {
+	if (table->size_slots[i])
+	{
+	    *find_size_slot (table, size_slots, size_slot_count, table->contents.region.begin[table->size_slots[i] - 1].size) = table->size_slots[i];
+	}
+    }
+
+    free (table->size_slots);
+    table->size_slots = size_slots;
+    table->size_slot_count = size_slot_count;
+}
+
+static size_t read_full (int fd, unsigned char * buffer, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+	ssize_t got = read (fd, buffer + done, size - done);
+
+	if (got < 0 && errno == EINTR)
+	{
+	    continue;
+	}
+
+	if (got <= 0)
+	{
+	    break;
+	}
+
+	done += got;
+    }
+
+    return done;
+}
+
+static uint64_t hash_bytes (uint64_t hash, const unsigned char * bytes, size_t size)
+{
+    uint64_t word;
+
+    for (; size >= sizeof(word); bytes += sizeof(word), size -= sizeof(word))
+    {
+	memcpy (&word, bytes, sizeof(word));
+	hash ^= word * 0x87C37B91114253D5ULL;
+	hash = ((hash << 31) | (hash >> 33)) * 0x4CF5AD432745937FULL;
+    }
+
+    if (size)
+    {
+	word = 0;
+	memcpy (&word, bytes, size);
+	hash ^= word * 0x87C37B91114253D5ULL;
+	hash = ((hash << 31) | (hash >> 33)) * 0x4CF5AD432745937FULL;
+    }
+
+    return hash;
+}
+
+static bool hash_file (uint64_t * hash, tar_hardlink_table * table, const char * path, unsigned long long size)
+{
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+	return false;
+    }
+
+    unsigned char * buffer = malloc (READ_CHUNK_SIZE);
+    uint64_t state = mix (size);
+    unsigned long long remaining = size;
+
+    while (remaining)
+    {
+	size_t want = remaining < READ_CHUNK_SIZE ? remaining : READ_CHUNK_SIZE;
+
+	if (read_full (fd, buffer, want) != want)
+	{
+	    break;
+	}
+
+	state = hash_bytes (state, buffer, want);
+	remaining -= want;
+    }
+
+    free (buffer);
+    close (fd);
+
+    if (remaining)
+    {
+	return false;
+    }
+
+    *hash = mix (state);
+    table->stats.hashed_files++;
+    table->stats.hashed_bytes += size;
+
+    return true;
+}
+
+static bool compare_files (const char * a_path, const char * b_path, unsigned long long size)
+{
+    int a_fd = open (a_path, O_RDONLY | O_CLOEXEC);
+    int b_fd = open (b_path, O_RDONLY | O_CLOEXEC);
+    unsigned char * buffer = malloc (2 * READ_CHUNK_SIZE);
+    bool same = a_fd >= 0 && b_fd >= 0;
+    unsigned long long remaining = size;
+
+    while (same && remaining)
+    {
+	size_t want = remaining < READ_CHUNK_SIZE ? remaining : READ_CHUNK_SIZE;
+
+	same = read_full (a_fd, buffer, want) == want
+	    && read_full (b_fd, buffer + READ_CHUNK_SIZE, want) == want
+	    && !memcmp (buffer, buffer + READ_CHUNK_SIZE, want);
+
+	remaining -= want;
+    }
+
+    free (buffer);
+
+    if (a_fd >= 0)
+    {
+	close (a_fd);
+    }
+
+    if (b_fd >= 0)
+    {
+	close (b_fd);
+    }
+
+    return same;
+}
+
+static size_t match_contents (uint64_t * hash, bool * hashed, tar_hardlink_table * table, size_t first, const struct stat * stat, const char * path)
+{
+    // files are only hashed once another file of the same size, mode and owner turns up, and a matching hash is confirmed by comparing the files themselves
+
+    for (size_t index = first; index; index = table->contents.region.begin[index - 1].next)
+    {
+	tar_hardlink_content * content = table->contents.region.begin + index - 1;
+
+	if (content->mode != stat->st_mode || content->uid != stat->st_uid || content->gid != stat->st_gid)
+	{
+	    continue;
+	}
+
+	if (!*hashed)
+	{
+	    if (!hash_file (hash, table, path, stat->st_size))
+	    {
+		return 0;
+	    }
+
+	    *hashed = true;
+	}
+
+	const char * content_path = table->paths.region.begin + content->path_begin;
+
+	if (!content->hashed)
+	{
+	    content->hashed = hash_file (&content->hash, table, content_path, content->size);
+	}
+
+	if (content->hashed && content->hash == *hash && compare_files (path, content_path, stat->st_size))
+	{
+	    return index;
+	}
+    }
+
+    return 0;
+}
+
+static size_t append_string (window_char * strings, const char * string)
+{
+    size_t begin = range_count (strings->region);
+
+    window_append_bytes ((window_unsigned_char*) strings, (const unsigned char*) string, strlen (string) + 1);
+
+    return begin;
+}
+
+const char * tar_hardlink_lookup (tar_hardlink_table * table, const struct stat * stat, const char * path, const char * name)
+{
+    if (!S_ISREG(stat->st_mode))
+    {
+	return NULL;
+    }
+
+    bool linked = stat->st_nlink > 1;
+    bool dedupe = table->dedupe && path && stat->st_size > 0;
+
+    if (!linked && !dedupe)
+    {
+	return NULL;
+    }
+
+    tar_hardlink_entry * slot = NULL;
+
+    if (linked)
+    {
+	// the table is kept at most half full, so probes stay short and always find an empty slot
+
+	if ((table->used + 1) * 2 > table->slot_count)
+	{
+	    grow_slots (table);
+	}
+
+	slot = find_slot (table->slots, table->slot_count, stat->st_dev, stat->st_ino);
+
+	if (slot->name_begin)
+	{
+	    return table->names.region.begin + slot->name_begin - 1;
+	}
+    }
+
+    size_t match = 0;
+    size_t name_begin;
+
+    if (dedupe)
+    {
+	if (((size_t) range_count (table->contents.region) + 1) * 2 > table->size_slot_count)
+	{
+	    grow_size_slots (table);
+	}
+
+	size_t * size_slot = find_size_slot (table, table->size_slots, table->size_slot_count, stat->st_size);
+	uint64_t hash = 0;
+	bool hashed = false;
+
+	match = match_contents (&hash, &hashed, table, *size_slot, stat, path);
+
+	if (match)
+	{
+	    name_begin = table->contents.region.begin[match - 1].name_begin;
+	    table->stats.duplicates++;
+	    table->stats.saved_bytes += stat->st_size;
+	}
+	else
+	{
+	    name_begin = append_string (&table->names, name);
+
+	    *window_push (table->contents) = (tar_hardlink_content){
+		.size = stat->st_size,
+		.mode = stat->st_mode,
+		.uid = stat->st_uid,
+		.gid = stat->st_gid,
+		.hashed = hashed,
+		.hash = hash,
+		.name_begin = name_begin,
+		.path_begin = append_string (&table->paths, path),
+		.next = *size_slot,
+	    };
+
+	    *size_slot = range_count (table->contents.region);
+	}
+    }
+    else
+    {
+	name_begin = append_string (&table->names, name);
+    }
+
+    // later links to this inode point at the name that holds the contents, even if this path is itself a duplicate
+
+    if (slot)
+    {
+	*slot = (tar_hardlink_entry){ .dev = stat->st_dev, .ino = stat->st_ino, .name_begin = name_begin + 1 };
+	table->used++;
+    }
+
+    return match ? table->names.region.begin + name_begin : NULL;
+}
+
+void tar_hardlink_table_clear (tar_hardlink_table * table)
+{
+    free (table->slots);
+    free (table->size_slots);
+    window_clear (table->names);
+    window_clear (table->contents);
+    window_clear (table->paths);
+
+    *table = (tar_hardlink_table){ .dedupe = table->dedupe };
+}
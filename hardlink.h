@@ -0,0 +1,90 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#endif
+
+/**
+   @file tar/hardlink.h
+   Describes a table of the files that have been written to a tar, keyed by device and inode number, which is used when writing tar headers to detect hardlinks. The first path written for an inode carries its contents, and every later path to the same inode is written as a hardlink to that first name.
+   A table may also be put into dedupe mode, in which regular files at different inodes whose contents are identical are written as hardlinks too. Files are only read for this when an earlier file had the same size, mode and owner, so that most files are never read twice.
+   A table is meant to be owned by a single writer, and it must not be shared between threads.
+*/
+
+typedef struct tar_hardlink_entry tar_hardlink_entry;
+struct tar_hardlink_entry {
+    dev_t dev; ///< The device of the inode
+    ino_t ino; ///< The inode number
+    size_t name_begin; ///< The offset of the name in the table's names, plus one, or 0 if this slot is empty
+};
+/**< @struct tar_hardlink_entry
+   A single slot of a tar_hardlink_table
+*/
+
+typedef struct tar_hardlink_content tar_hardlink_content;
+struct tar_hardlink_content {
+    unsigned long long size; ///< The size of the file
+    mode_t mode; ///< The mode of the file
+    uid_t uid; ///< The owner of the file
+    gid_t gid; ///< The group of the file
+    bool hashed; ///< True once hash has been computed
+    uint64_t hash; ///< A hash of the file's contents
+    size_t name_begin; ///< The offset of the file's name in the table's names
+    size_t path_begin; ///< The offset of the file's path in the table's paths, from which it is read to be hashed and compared
+    size_t next; ///< The index of the previous file with the same size, plus one, or 0 if there is none
+};
+/**< @struct tar_hardlink_content
+   A file that has been written with its contents while the table was in dedupe mode
+*/
+
+range_typedef(tar_hardlink_content, tar_hardlink_content);
+window_typedef(tar_hardlink_content, tar_hardlink_content);
+
+typedef struct tar_hardlink_stats tar_hardlink_stats;
+struct tar_hardlink_stats {
+    size_t hashed_files; ///< The number of files whose contents were hashed
+    unsigned long long hashed_bytes; ///< The number of bytes read to hash them
+    size_t duplicates; ///< The number of files that were written as hardlinks because their contents matched an earlier file
+    unsigned long long saved_bytes; ///< The total size of the contents that those files did not store
+};
+/**< @struct tar_hardlink_stats
+   Statistics of a table in dedupe mode
+*/
+
+typedef struct tar_hardlink_table tar_hardlink_table;
+struct tar_hardlink_table {
+    tar_hardlink_entry * slots; ///< An open addressed hash table of the inodes that have been written, whose size is a power of two
+    size_t slot_count; ///< The number of slots
+    size_t used; ///< The number of slots that are in use
+    window_char names; ///< The null terminated names under which each inode was first written
+    bool dedupe; ///< If true, regular files whose contents match an earlier file are written as hardlinks to it. This may be set before the first lookup.
+    window_tar_hardlink_content contents; ///< In dedupe mode, the files that have been written with their contents
+    size_t * size_slots; ///< An open addressed hash table of the most recent index into contents, plus one, for each size
+    size_t size_slot_count; ///< The number of size slots, which is a power of two
+    window_char paths; ///< The null terminated paths of the files in contents
+    tar_hardlink_stats stats; ///< Statistics of dedupe mode
+};
+/**< @struct tar_hardlink_table
+   A table of inodes that have been written to a tar. It should be zeroed before use.
+*/
+
+struct stat;
+
+const char * tar_hardlink_lookup (tar_hardlink_table * table, const struct stat * stat, const char * path, const char * name);
+/**<
+   @brief Looks up the inode of a file that is about to be written. Files with a single link are never recorded, since no other path can refer to them, unless the table is in dedupe mode.
+   @return The name under which this inode, or in dedupe mode an identical file, was already written, which remains valid until the next lookup. If this is the first time it has been seen, NULL is returned, and the file is recorded under the given name.
+   @param table The table to use
+   @param stat The result of calling lstat on the file
+   @param path The path from which the file can be read. In dedupe mode, a null path excludes the file from deduplication.
+   @param name The name of the file within the tar
+*/
+
+void tar_hardlink_table_clear (tar_hardlink_table * table);
+/**<
+   @brief Frees all memory allocated to the given table, but not the table itself.
+*/
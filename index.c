@@ -0,0 +1,352 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../window/printf.h"
+#include "../convert/source.h"
+#include "../convert/sink.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "read.h"
+#include "index.h"
+#include "../log/log.h"
+
+// an index file is the magic, the entry, extent and name pool sizes, then the entries, the extents of sparse members, and the name pool, with every number little endian
+
+#define INDEX_MAGIC "TARINDX2"
+#define INDEX_MAGIC_SIZE 8
+#define INDEX_HEADER_SIZE (INDEX_MAGIC_SIZE + 8 + 8 + 8)
+#define INDEX_ENTRY_SIZE (8 + 8 + 8 + 4 + 1 + 8 + 8 + 1 + 8 + 8 + 8)
+#define INDEX_EXTENT_SIZE (8 + 8)
+
+static void write_le (unsigned char * output, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+	output[i] = value & 0xff;
+	value >>= 8;
+    }
+}
+
+static uint64_t read_le (const unsigned char * input, int size)
+{
+    uint64_t value = 0;
+
+    for (int i = size - 1; i >= 0; i--)
+    {
+	value = (value << 8) | input[i];
+    }
+
+    return value;
+}
+
+static int compare_entries (const void * a_void, const void * b_void)
+{
+    const tar_index_entry * a = a_void;
+    const tar_index_entry * b = b_void;
+
+    int name_order = strcmp (a->name, b->name);
+
+    if (name_order)
+    {
+	return name_order;
+    }
+
+    return (a->header_offset > b->header_offset) - (a->header_offset < b->header_offset);
+}
+
+static size_t add_name (tar_index * index, const char * name)
+{
+    size_t begin = range_count (index->names.region);
+
+    window_append_bytes ((window_unsigned_char*) &index->names, (const unsigned char*) name, strlen (name) + 1);
+
+    return begin;
+}
+
+static void index_finish (tar_index * index)
+{
+    for (tar_index_entry * entry = index->entries.region.begin; entry < index->entries.region.end; entry++)
+    {
+	entry->name = index->names.region.begin + entry->name_begin;
+	entry->link = index->names.region.begin + entry->link_begin;
+	entry->sparse_map = index->extents.region.begin + entry->sparse_begin;
+    }
+
+    qsort (index->entries.region.begin, range_count (index->entries.region), sizeof(*index->entries.region.begin), compare_entries);
+}
+
+bool tar_index_build (tar_index * index, tar_state * state)
+{
+    while (tar_update (state))
+    {
+	tar_index_entry * entry = window_push (index->entries);
+
+	*entry = (tar_index_entry){
+	    .header_offset = state->offset.header,
+	    .data_offset = state->offset.data,
+	    .size = state->type == TAR_FILE ? state->file.size : 0,
+	    .mode = state->mode,
+	    .type = state->type,
+	    .is_sparse = state->type == TAR_FILE && state->sparse.is_sparse,
+	};
+
+	entry->name_begin = add_name (index, state->path.region.begin);
+	entry->link_begin = add_name (index, state->type == TAR_HARDLINK || state->type == TAR_SYMLINK ? state->link.path.region.begin : "");
+
+	if (entry->is_sparse)
+	{
+	    entry->sparse_size = state->sparse.size;
+	    entry->sparse_begin = range_count (index->extents.region);
+	    entry->sparse_count = range_count (state->sparse.map.region);
+
+	    for (const tar_sparse_extent * extent = state->sparse.map.region.begin; extent < state->sparse.map.region.end; extent++)
+	    {
+		*window_push (index->extents) = *extent;
+	    }
+	}
+
+	if (state->type == TAR_FILE && !tar_skip_file (state))
+	{
+	    log_fatal ("Failed to skip the contents of %s", state->path.region.begin);
+	}
+    }
+
+    index_finish (index);
+
+    if (state->type != TAR_END)
+    {
+	log_fatal ("Failed to read the tar to be indexed");
+    }
+
+    return true;
+
+fail:
+    return false;
+}
+
+bool tar_index_save (convert_sink * sink, const tar_index * index)
+{
+    window_unsigned_char buffer = {0};
+
+    size_t count = range_count (index->entries.region);
+    size_t extents_count = range_count (index->extents.region);
+    size_t names_size = range_count (index->names.region);
+
+    unsigned char * header = window_grow_bytes (&buffer, INDEX_HEADER_SIZE);
+    memcpy (header, INDEX_MAGIC, INDEX_MAGIC_SIZE);
+    write_le (header + INDEX_MAGIC_SIZE, count, 8);
+    write_le (header + INDEX_MAGIC_SIZE + 8, extents_count, 8);
+    write_le (header + INDEX_MAGIC_SIZE + 16, names_size, 8);
+
+    for (const tar_index_entry * entry = index->entries.region.begin; entry < index->entries.region.end; entry++)
+    {
+	unsigned char * output = window_grow_bytes (&buffer, INDEX_ENTRY_SIZE);
+
+	write_le (output, entry->header_offset, 8);
+	write_le (output + 8, entry->data_offset, 8);
+	write_le (output + 16, entry->size, 8);
+	write_le (output + 24, entry->mode, 4);
+	write_le (output + 28, entry->type, 1);
+	write_le (output + 29, entry->name_begin, 8);
+	write_le (output + 37, entry->link_begin, 8);
+	write_le (output + 45, entry->is_sparse, 1);
+	write_le (output + 46, entry->sparse_size, 8);
+	write_le (output + 54, entry->sparse_begin, 8);
+	write_le (output + 62, entry->sparse_count, 8);
+    }
+
+    for (const tar_sparse_extent * extent = index->extents.region.begin; extent < index->extents.region.end; extent++)
+    {
+	unsigned char * output = window_grow_bytes (&buffer, INDEX_EXTENT_SIZE);
+
+	write_le (output, extent->offset, 8);
+	write_le (output + 8, extent->size, 8);
+    }
+
+    window_append_bytes (&buffer, (const unsigned char*) index->names.region.begin, names_size);
+
+    sink->contents = &buffer.region.const_cast;
+
+    bool error = false;
+
+    bool retval = convert_drain (&error, sink);
+
+    window_clear (buffer);
+
+    return retval;
+}
+
+bool tar_index_load (tar_index * index, convert_source * source)
+{
+    bool error = false;
+
+    while (convert_fill (&error, source))
+    {
+    }
+
+    if (error)
+    {
+	log_fatal ("Failed to read tar index");
+    }
+
+    const unsigned char * input = source->contents->region.begin;
+    size_t input_size = range_count (source->contents->region);
+
+    if (input_size < INDEX_HEADER_SIZE || memcmp (input, INDEX_MAGIC, INDEX_MAGIC_SIZE))
+    {
+	log_fatal ("Input is not a tar index");
+    }
+
+    uint64_t count = read_le (input + INDEX_MAGIC_SIZE, 8);
+    uint64_t extents_count = read_le (input + INDEX_MAGIC_SIZE + 8, 8);
+    uint64_t names_size = read_le (input + INDEX_MAGIC_SIZE + 16, 8);
+
+    if (count > (input_size - INDEX_HEADER_SIZE) / INDEX_ENTRY_SIZE
+	|| extents_count > (input_size - INDEX_HEADER_SIZE - count * INDEX_ENTRY_SIZE) / INDEX_EXTENT_SIZE
+	|| input_size - INDEX_HEADER_SIZE - count * INDEX_ENTRY_SIZE - extents_count * INDEX_EXTENT_SIZE != names_size)
+    {
+	log_fatal ("Tar index is truncated");
+    }
+
+    input += INDEX_HEADER_SIZE;
+
+    window_rewrite (index->entries);
+    window_rewrite (index->extents);
+    window_rewrite (index->names);
+
+    const unsigned char * extents_input = input + count * INDEX_ENTRY_SIZE;
+
+    window_append_bytes ((window_unsigned_char*) &index->names, extents_input + extents_count * INDEX_EXTENT_SIZE, names_size);
+
+    if (names_size && index->names.region.end[-1] != '\0')
+    {
+	log_fatal ("Tar index names are not terminated");
+    }
+
+    for (uint64_t i = 0; i < count; i++, input += INDEX_ENTRY_SIZE)
+    {
+	tar_index_entry * entry = window_push (index->entries);
+
+	*entry = (tar_index_entry){
+	    .header_offset = read_le (input, 8),
+	    .data_offset = read_le (input + 8, 8),
+	    .size = read_le (input + 16, 8),
+	    .mode = read_le (input + 24, 4),
+	    .type = read_le (input + 28, 1),
+	    .name_begin = read_le (input + 29, 8),
+	    .link_begin = read_le (input + 37, 8),
+	    .is_sparse = read_le (input + 45, 1),
+	    .sparse_size = read_le (input + 46, 8),
+	    .sparse_begin = read_le (input + 54, 8),
+	    .sparse_count = read_le (input + 62, 8),
+	};
+
+	if (entry->name_begin >= names_size || entry->link_begin >= names_size)
+	{
+	    log_fatal ("Tar index entry name is out of bounds");
+	}
+
+	if (entry->sparse_begin > extents_count || entry->sparse_count > extents_count - entry->sparse_begin)
+	{
+	    log_fatal ("Tar index entry sparse map is out of bounds");
+	}
+    }
+
+    for (uint64_t i = 0; i < extents_count; i++, extents_input += INDEX_EXTENT_SIZE)
+    {
+	*window_push (index->extents) = (tar_sparse_extent){
+	    .offset = read_le (extents_input, 8),
+	    .size = read_le (extents_input + 8, 8),
+	};
+    }
+
+    source->contents->region.begin = source->contents->region.end;
+
+    index_finish (index);
+
+    return true;
+
+fail:
+    return false;
+}
+
+const tar_index_entry * tar_index_find (const tar_index * index, const char * name)
+{
+    const tar_index_entry * begin = index->entries.region.begin;
+    const tar_index_entry * end = index->entries.region.end;
+
+    while (begin < end)
+    {
+	const tar_index_entry * middle = begin + (end - begin) / 2;
+
+	if (strcmp (middle->name, name) <= 0)
+	{
+	    begin = middle + 1;
+	}
+	else
+	{
+	    end = middle;
+	}
+    }
+
+    if (begin == index->entries.region.begin || strcmp (begin[-1].name, name))
+    {
+	return NULL;
+    }
+
+    return begin - 1;
+}
+
+bool tar_index_seek (tar_state * state, int fd, const tar_index_entry * entry)
+{
+    if ((off_t) -1 == lseek (fd, entry->data_offset, SEEK_SET))
+    {
+	perror ("lseek");
+	log_fatal ("Failed to seek to tar member %s", entry->name);
+    }
+
+    window_rewrite (*state->source->contents);
+
+    window_printf (&state->path, "%s", entry->name);
+    window_printf (&state->link.path, "%s", entry->link);
+
+    window_rewrite (state->sparse.map);
+    state->sparse.is_sparse = entry->is_sparse;
+    state->sparse.size = entry->is_sparse ? entry->sparse_size : 0;
+
+    for (size_t i = 0; i < entry->sparse_count; i++)
+    {
+	*window_push (state->sparse.map) = entry->sparse_map[i];
+    }
+
+    window_rewrite (state->deleted);
+
+    state->type = entry->type;
+    state->mode = entry->mode;
+    state->file.size = entry->type == TAR_FILE ? entry->size : 0;
+    state->file.bytes_read = 0;
+    state->offset = (struct tar_state_offset){ .header = entry->header_offset, .data = entry->data_offset, .position = entry->data_offset };
+    state->pending = (struct tar_state_pending){0};
+    state->ready = true;
+
+    return true;
+
+fail:
+    state->type = TAR_ERROR;
+    return false;
+}
+
+void tar_index_clear (tar_index * index)
+{
+    window_clear (index->entries);
+    window_clear (index->extents);
+    window_clear (index->names);
+}
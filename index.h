@@ -0,0 +1,91 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "../convert/sink.h"
+#include "common.h"
+#include "read.h"
+#endif
+
+/**
+   @file tar/index.h
+   Describes an index of the members of an uncompressed tar file, which allows individual members to be found and read without walking every header that precedes them.
+   To use an index, first build one from a tar_state with tar_index_build, or load a previously saved index with tar_index_load. Entries may then be found by name with tar_index_find, and a tar_state whose source reads from the indexed file may be positioned at an entry's contents with tar_index_seek.
+*/
+
+typedef struct tar_index_entry tar_index_entry;
+struct tar_index_entry {
+    unsigned long long header_offset; ///< The offset of the first header block of this member, including any longname or longlink headers
+    unsigned long long data_offset; ///< The offset of this member's contents
+    unsigned long long size; ///< The size of this member's contents
+    unsigned int mode; ///< The permissions mode of this member
+    tar_type type; ///< The type of this member
+    size_t name_begin; ///< The offset of this member's name within the index's name pool
+    const char * name; ///< The resolved name of this member, valid once the index has been built or loaded
+    size_t link_begin; ///< The offset of this member's link target within the index's name pool
+    const char * link; ///< The resolved link target of this member, which is empty unless it is a hardlink or symlink, valid once the index has been built or loaded
+    bool is_sparse; ///< True if this member is a sparse file
+    unsigned long long sparse_size; ///< If this member is a sparse file, its size including holes
+    size_t sparse_begin; ///< If this member is a sparse file, the position of its first data extent within the index's extent pool
+    size_t sparse_count; ///< If this member is a sparse file, the number of its data extents
+    const tar_sparse_extent * sparse_map; ///< If this member is a sparse file, its data extents, valid once the index has been built or loaded
+};
+/**< @struct tar_index_entry
+   Describes a single member of an indexed tar file
+*/
+
+range_typedef(tar_index_entry, tar_index_entry);
+window_typedef(tar_index_entry, tar_index_entry);
+
+typedef struct tar_index tar_index;
+struct tar_index {
+    window_tar_index_entry entries; ///< The indexed members, sorted by name, with duplicate names kept in archive order
+    window_char names; ///< A pool of null terminated member names and link targets
+    window_tar_sparse_extent extents; ///< A pool of the data extents of sparse members
+};
+/**< @struct tar_index
+   An index of the members of a tar file. It should be zeroed before use.
+*/
+
+bool tar_index_build (tar_index * index, tar_state * state);
+/**<
+   @brief Reads the remainder of the tar described by state and appends each of its members to the given index.
+   @return True if the end of the tar was reached, false otherwise
+   @param index The index to add members to
+   @param state A state reading from the beginning of the tar to be indexed
+*/
+
+bool tar_index_save (convert_sink * sink, const tar_index * index);
+/**<
+   @brief Writes the given index to a sink in a compact binary format that can be read by tar_index_load
+   @return True if successful, false otherwise
+*/
+
+bool tar_index_load (tar_index * index, convert_source * source);
+/**<
+   @brief Reads an index that was written by tar_index_save, replacing the contents of the given index
+   @return True if successful, false otherwise
+*/
+
+const tar_index_entry * tar_index_find (const tar_index * index, const char * name);
+/**<
+   @brief Finds a member by its name. If a name occurs more than once in the tar, then its last occurrence is returned, as it would be the one left behind by extraction.
+   @return The entry for the named member, or NULL if it is not present in the index
+*/
+
+bool tar_index_seek (tar_state * state, int fd, const tar_index_entry * entry);
+/**<
+   @brief Positions a state at the given member so that its contents may be read with tar_read_file_part or tar_read_file_whole. The member's link target and sparse map are restored along with its name, but the deleted entries of a directory are not kept by the index, and are left empty.
+   @return True if successful, false otherwise
+   @param state A state whose source reads from fd. Any input buffered by the source is discarded.
+   @param fd A seekable file descriptor of the indexed tar file
+   @param entry The entry to seek to
+*/
+
+void tar_index_clear (tar_index * index);
+/**<
+   @brief Frees all memory allocated to the given index, but not the index itself.
+*/
@@ -0,0 +1,47 @@
+/**
+   @file tar/internal/decode.h
+   Describes the header decoding kernel used by the reader. It parses every fixed width numeric field of a header block and sums the block for its checksum in a single pass. The sum is computed with AVX2 or SSE2 when the library is built for a processor that has them, and with a scalar loop otherwise.
+*/
+
+#define TAR_FIELD_MODE 1 ///< Set in tar_header_fields.invalid if the mode field could not be parsed
+#define TAR_FIELD_UID 2 ///< Set in tar_header_fields.invalid if the uid field could not be parsed
+#define TAR_FIELD_GID 4 ///< Set in tar_header_fields.invalid if the gid field could not be parsed
+#define TAR_FIELD_SIZE 8 ///< Set in tar_header_fields.invalid if the size field could not be parsed
+#define TAR_FIELD_MTIME 16 ///< Set in tar_header_fields.invalid if the mtime field could not be parsed
+#define TAR_FIELD_CHKSUM 32 ///< Set in tar_header_fields.invalid if the chksum field could not be parsed
+
+typedef struct tar_header_fields tar_header_fields;
+struct tar_header_fields {
+    unsigned long long mode;
+    unsigned long long uid;
+    unsigned long long gid;
+    unsigned long long size;
+    unsigned long long mtime;
+    unsigned long long chksum; ///< The checksum recorded in the header
+    unsigned int invalid; ///< A mask of TAR_FIELD_* values for fields that could not be parsed
+    unsigned long long sum_unsigned; ///< The checksum of the block, computed with unsigned bytes and the chksum field read as spaces
+    long long sum_signed; ///< The checksum of the block, computed with signed bytes as some historical tar implementations did
+    bool zero; ///< True if every byte of the block is zero
+};
+/**< @struct tar_header_fields
+   The decoded numeric fields of a header block
+*/
+
+void tar_decode_header (tar_header_fields * fields, const unsigned char * block);
+/**<
+   @brief Decodes the numeric fields of a header block and computes its checksums
+   @param fields The structure to be filled in
+   @param block A TAR_BLOCK_SIZE byte header block
+*/
+
+bool tar_header_checksum_matches (const tar_header_fields * fields);
+/**<
+   @brief Checks the checksum recorded in a decoded header against either of the checksums computed for it
+   @return True if the recorded checksum matches, false otherwise
+*/
+
+bool tar_decode_numeric (unsigned long long * value, const char * field, size_t size);
+/**<
+   @brief Parses a numeric field in either octal or GNU base 256, as found in headers and GNU sparse maps
+   @return True if the field could be parsed, false otherwise
+*/
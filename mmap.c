@@ -0,0 +1,147 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "read.h"
+#include "mmap.h"
+#include "../log/log.h"
+
+inline static size_t size_to_blocks (size_t size)
+{
+    return size % TAR_BLOCK_SIZE == 0
+	? size / TAR_BLOCK_SIZE
+	: size / TAR_BLOCK_SIZE + 1;
+}
+
+bool tar_mmap_open (tar_mmap * map, const char * path)
+{
+    int fd = open (path, O_RDONLY);
+
+    if (fd < 0)
+    {
+	perror (path);
+	log_fatal ("Failed to open %s", path);
+    }
+
+    struct stat s;
+
+    if (-1 == fstat (fd, &s))
+    {
+	perror (path);
+	close (fd);
+	log_fatal ("Failed to stat %s", path);
+    }
+
+    if (!s.st_size)
+    {
+	close (fd);
+	log_fatal ("Tar file %s is empty", path);
+    }
+
+    void * mapping = mmap (NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close (fd);
+
+    if (mapping == MAP_FAILED)
+    {
+	perror (path);
+	log_fatal ("Failed to map %s", path);
+    }
+
+    map->file.begin = mapping;
+    map->file.end = map->file.begin + s.st_size;
+    map->rest = map->file;
+    map->header = (range_const_unsigned_char){0};
+
+    tar_restart (&map->state);
+    map->state.source = NULL;
+
+    return true;
+
+fail:
+    return false;
+}
+
+bool tar_mmap_update (tar_mmap * map)
+{
+    tar_state * state = &map->state;
+
+    if (state->ready && state->type == TAR_FILE)
+    {
+	size_t skip_size = size_to_blocks (state->file.size) * TAR_BLOCK_SIZE;
+
+	if ((size_t) range_count (map->rest) < skip_size)
+	{
+	    log_fatal ("Tar file ended prematurely");
+	}
+
+	map->rest.begin += skip_size;
+	state->offset.position += skip_size;
+    }
+
+    while (tar_update_mem (state, &map->rest))
+    {
+	if (state->ready)
+	{
+	    if (state->type == TAR_FILE && state->file.size > (size_t) range_count (map->rest))
+	    {
+		log_fatal ("Tar file ended prematurely");
+	    }
+
+	    map->header.begin = map->file.begin + state->offset.item;
+	    map->header.end = map->header.begin + TAR_BLOCK_SIZE;
+	    return true;
+	}
+
+	if ((size_t) range_count (map->rest) < TAR_BLOCK_SIZE)
+	{
+	    log_fatal ("Input closed prematurely");
+	}
+    }
+
+    return false;
+
+fail:
+    state->type = TAR_ERROR;
+    state->ready = true;
+    return false;
+}
+
+bool tar_mmap_contents (range_const_unsigned_char * contents, const tar_mmap * map)
+{
+    if (!map->state.ready || map->state.type != TAR_FILE)
+    {
+	return false;
+    }
+
+    contents->begin = map->file.begin + map->state.offset.data;
+    contents->end = contents->begin + map->state.file.size;
+
+    assert (contents->end <= map->file.end);
+
+    return true;
+}
+
+void tar_mmap_close (tar_mmap * map)
+{
+    if (map->file.begin)
+    {
+	munmap ((void*) map->file.begin, range_count (map->file));
+    }
+
+    tar_cleanup (&map->state);
+
+    *map = (tar_mmap){0};
+}
@@ -0,0 +1,50 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "common.h"
+#include "read.h"
+#endif
+
+/**
+   @file tar/mmap.h
+   Describes a reader for tar files that are on a local disk, which maps the whole file into memory and parses it in place with tar_update_mem. Headers and file contents are given as ranges that point into the mapping, so no bytes are copied and no read calls are made.
+   To use it, open a tar file with tar_mmap_open, then call tar_mmap_update to advance to each item in turn. The item's metadata can be read from the tar_mmap's state, and the contents of a file may be obtained with tar_mmap_contents. Unlike tar_update, the contents of a file do not need to be read or skipped before the next update.
+*/
+
+typedef struct tar_mmap tar_mmap;
+struct tar_mmap {
+    range_const_unsigned_char file; ///< The whole mapped tar file
+    range_const_unsigned_char rest; ///< The portion of the mapping that has not been parsed yet
+    range_const_unsigned_char header; ///< The header block of the current item
+    tar_state state; ///< The state describing the current item. Its source is unused and must not be read from.
+};
+/**< @struct tar_mmap
+   A tar file that has been mapped into memory, and the parsing state within it
+*/
+
+bool tar_mmap_open (tar_mmap * map, const char * path);
+/**<
+   @brief Maps the tar at the given path into memory. The map should be zeroed before the first call.
+   @return True if successful, false otherwise
+*/
+
+bool tar_mmap_update (tar_mmap * map);
+/**<
+   @brief Advances to the next item in the mapped tar, skipping the contents of the current item if it is a file.
+   @return True if an item was found, false at the end of the tar or on error. On error, the state's type will be TAR_ERROR.
+*/
+
+bool tar_mmap_contents (range_const_unsigned_char * contents, const tar_mmap * map);
+/**<
+   @brief Points contents at the contents of the current file, within the mapping.
+   @return True if the current item is a file, false otherwise
+*/
+
+void tar_mmap_close (tar_mmap * map);
+/**<
+   @brief Unmaps the tar and frees all memory allocated to the given map, but not the map itself.
+*/
@@ -0,0 +1,183 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pwd.h>
+#include <grp.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "owner.h"
+
+static tar_owner_entry * find_id (window_tar_owner_entry * entries, unsigned int id)
+{
+    for (tar_owner_entry * entry = entries->region.begin; entry < entries->region.end; entry++)
+    {
+	if (entry->has_id && entry->id == id)
+	{
+	    return entry;
+	}
+    }
+
+    return NULL;
+}
+
+static tar_owner_entry * find_name (window_tar_owner_entry * entries, const char * name)
+{
+    // names that were not found are kept too, so that they are not looked up again
+
+    for (tar_owner_entry * entry = entries->region.begin; entry < entries->region.end; entry++)
+    {
+	if ((entry->found || !entry->has_id) && !strcmp (entry->name, name))
+	{
+	    return entry;
+	}
+    }
+
+    return NULL;
+}
+
+static tar_owner_entry * add_entry (window_tar_owner_entry * entries, bool found, unsigned int id, const char * name)
+{
+    tar_owner_entry * entry = window_push (*entries);
+
+    *entry = (tar_owner_entry){ .id = id, .found = found, .has_id = true };
+
+    if (found)
+    {
+	strncpy (entry->name, name, TAR_OWNER_NAME_SIZE);
+    }
+
+    return entry;
+}
+
+static void remember_name (window_tar_owner_entry * entries, unsigned int id, const char * name)
+{
+    tar_owner_entry * entry = find_id (entries, id);
+
+    if (!entry)
+    {
+	add_entry (entries, true, id, name);
+    }
+    else if (!entry->found)
+    {
+	entry->found = true;
+	strncpy (entry->name, name, TAR_OWNER_NAME_SIZE);
+    }
+}
+
+static void remember_missing_name (window_tar_owner_entry * entries, const char * name)
+{
+    // a name too long for the entry could not be matched later, so it is looked up each time instead
+
+    if (strlen (name) <= TAR_OWNER_NAME_SIZE)
+    {
+	tar_owner_entry * entry = window_push (*entries);
+	*entry = (tar_owner_entry){0};
+	strcpy (entry->name, name);
+    }
+}
+
+static void resolve_name (window_tar_owner_entry * entries, unsigned int * id, const char * name, bool is_user)
+{
+    // an empty name, as headers carry for ids without one, can never be found
+
+    if (!*name)
+    {
+	return;
+    }
+
+    tar_owner_entry * entry = find_name (entries, name);
+
+    if (entry)
+    {
+	if (entry->found)
+	{
+	    *id = entry->id;
+	}
+
+	return;
+    }
+
+    if (is_user)
+    {
+	struct passwd * passwd = getpwnam (name);
+
+	if (passwd)
+	{
+	    *id = passwd->pw_uid;
+	    remember_name (entries, *id, name);
+	}
+	else
+	{
+	    remember_missing_name (entries, name);
+	}
+    }
+    else
+    {
+	struct group * group = getgrnam (name);
+
+	if (group)
+	{
+	    *id = group->gr_gid;
+	    remember_name (entries, *id, name);
+	}
+	else
+	{
+	    remember_missing_name (entries, name);
+	}
+    }
+}
+
+static const char * resolve_id (window_tar_owner_entry * entries, unsigned int id, bool is_user)
+{
+    tar_owner_entry * entry = find_id (entries, id);
+
+    if (!entry)
+    {
+	if (is_user)
+	{
+	    struct passwd * passwd = getpwuid (id);
+	    entry = add_entry (entries, passwd, id, passwd ? passwd->pw_name : NULL);
+	}
+	else
+	{
+	    struct group * group = getgrgid (id);
+	    entry = add_entry (entries, group, id, group ? group->gr_name : NULL);
+	}
+    }
+
+    return entry->name;
+}
+
+static void resolve (window_tar_owner_entry * entries, bool numeric, unsigned int * id, const char ** name, bool is_user)
+{
+    if (*name)
+    {
+	if (!numeric)
+	{
+	    resolve_name (entries, id, *name, is_user);
+	}
+
+	return;
+    }
+
+    *name = numeric ? "" : resolve_id (entries, *id, is_user);
+}
+
+void tar_owner_resolve_user (tar_owner_cache * cache, unsigned int * uid, const char ** uname)
+{
+    resolve (&cache->users, cache->numeric, uid, uname, true);
+}
+
+void tar_owner_resolve_group (tar_owner_cache * cache, unsigned int * gid, const char ** gname)
+{
+    resolve (&cache->groups, cache->numeric, gid, gname, false);
+}
+
+void tar_owner_cache_clear (tar_owner_cache * cache)
+{
+    window_clear (cache->users);
+    window_clear (cache->groups);
+}
@@ -0,0 +1,57 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#endif
+
+/**
+   @file tar/owner.h
+   Describes a cache of user and group names, which is used when writing tar headers to avoid a passwd or group database lookup for every item. A cache may also be put into numeric mode, in which no lookups are made at all and headers carry only numeric ids.
+   A cache is meant to be owned by a single writer, and it must not be shared between threads.
+*/
+
+#define TAR_OWNER_NAME_SIZE 32 ///< The size of the uname and gname fields of a tar header
+
+typedef struct tar_owner_entry tar_owner_entry;
+struct tar_owner_entry {
+    unsigned int id; ///< The user or group id
+    bool found; ///< False if the id or name has no entry in the passwd or group database
+    bool has_id; ///< False if the entry records a name that was not found, in which case id is not meaningful
+    char name[TAR_OWNER_NAME_SIZE + 1]; ///< The user or group name
+};
+/**< @struct tar_owner_entry
+   A single cached user or group
+*/
+
+range_typedef(tar_owner_entry, tar_owner_entry);
+window_typedef(tar_owner_entry, tar_owner_entry);
+
+typedef struct tar_owner_cache tar_owner_cache;
+struct tar_owner_cache {
+    bool numeric; ///< If true, names are never looked up, and headers will carry only the numeric ids they are given
+    window_tar_owner_entry users; ///< Users that have been looked up so far
+    window_tar_owner_entry groups; ///< Groups that have been looked up so far
+};
+/**< @struct tar_owner_cache
+   A cache of user and group names. It should be zeroed before use, and numeric may be set at any time.
+*/
+
+void tar_owner_resolve_user (tar_owner_cache * cache, unsigned int * uid, const char ** uname);
+/**<
+   @brief Resolves a user for a tar header. If *uname is given and it names a known user, *uid is set to that user's id. Otherwise, *uname is set to the name of the user identified by *uid. If no name can be found, or the cache is in numeric mode, *uname is set to an empty string.
+   @param cache The cache to use
+   @param uid The user id, which is updated if a name was given
+   @param uname The user name, or a pointer to NULL if the name should be found from uid. On return, this points to a null terminated string that remains valid until the next lookup through the cache or until the cache is cleared, or to the name that was given.
+*/
+
+void tar_owner_resolve_group (tar_owner_cache * cache, unsigned int * gid, const char ** gname);
+/**<
+   @brief Resolves a group for a tar header, as tar_owner_resolve_user does for users.
+*/
+
+void tar_owner_cache_clear (tar_owner_cache * cache);
+/**<
+   @brief Frees all memory allocated to the given cache, but not the cache itself.
+*/
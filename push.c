@@ -0,0 +1,186 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "common.h"
+#include "read.h"
+#include "push.h"
+
+inline static unsigned long long size_to_blocks (unsigned long long size)
+{
+    return size / TAR_BLOCK_SIZE + (size % TAR_BLOCK_SIZE != 0);
+}
+
+static unsigned long long header_bytes_needed (const tar_push * push)
+{
+    // the blocks of a longname, longlink or pax header are collected one at a time, so the rest of them are needed along with the header that follows
+
+    const tar_state * state = &push->state;
+    unsigned long long collected;
+
+    switch (state->type)
+    {
+    case TAR_LONGNAME:
+	collected = range_count (state->path.region);
+	break;
+
+    case TAR_LONGLINK:
+	collected = range_count (state->link.path.region);
+	break;
+
+    case TAR_PAX:
+    case TAR_PAX_GLOBAL:
+	collected = range_count (state->pax.records.region);
+	break;
+
+    default:
+	return TAR_BLOCK_SIZE - push->block_size;
+    }
+
+    unsigned long long blocks = 1;
+
+    if (collected < state->file.size)
+    {
+	blocks += size_to_blocks (state->file.size) - collected / TAR_BLOCK_SIZE;
+    }
+
+    return blocks * TAR_BLOCK_SIZE - push->block_size;
+}
+
+static tar_push_status give_contents (tar_push * push, range_const_unsigned_char * input)
+{
+    size_t available = range_count (*input);
+
+    if (!available)
+    {
+	push->need = push->contents_remaining;
+	return TAR_PUSH_NEED;
+    }
+
+    size_t size = available < push->contents_remaining ? available : push->contents_remaining;
+
+    push->data = (range_const_unsigned_char){ .begin = input->begin, .end = input->begin + size };
+    input->begin += size;
+    push->contents_remaining -= size;
+    push->state.file.bytes_read += size;
+    push->state.offset.position += size;
+
+    return TAR_PUSH_DATA;
+}
+
+static tar_push_status parse_header (tar_push * push, range_const_unsigned_char * input)
+{
+    tar_state * state = &push->state;
+
+    while (true)
+    {
+	range_const_unsigned_char mem;
+	bool split = push->block_size || range_count (*input) < TAR_BLOCK_SIZE;
+
+	if (split)
+	{
+	    // a block that is split between chunks is gathered here, so that the caller need not keep the start of it
+
+	    size_t size = TAR_BLOCK_SIZE - push->block_size;
+
+	    if ((size_t) range_count (*input) < size)
+	    {
+		size = range_count (*input);
+	    }
+
+	    memcpy (push->block + push->block_size, input->begin, size);
+	    input->begin += size;
+	    push->block_size += size;
+
+	    if (push->block_size < TAR_BLOCK_SIZE)
+	    {
+		push->need = header_bytes_needed (push);
+		return TAR_PUSH_NEED;
+	    }
+
+	    mem = (range_const_unsigned_char){ .begin = push->block, .end = push->block + TAR_BLOCK_SIZE };
+	}
+	else
+	{
+	    mem = *input;
+	}
+
+	const unsigned char * mem_begin = mem.begin;
+	bool updated = tar_update_mem (state, &mem);
+
+	assert (mem.begin > mem_begin || !updated || state->ready);
+
+	if (split)
+	{
+	    assert (mem.begin == mem.end);
+	    push->block_size = 0;
+	}
+	else
+	{
+	    input->begin = mem.begin;
+	}
+
+	if (!updated)
+	{
+	    return state->type == TAR_END ? TAR_PUSH_END : TAR_PUSH_ERROR;
+	}
+
+	if (state->ready)
+	{
+	    if (state->type == TAR_FILE)
+	    {
+		push->contents_remaining = state->file.size;
+		push->padding_remaining = size_to_blocks (state->file.size) * TAR_BLOCK_SIZE - state->file.size;
+	    }
+
+	    return TAR_PUSH_ITEM;
+	}
+    }
+}
+
+tar_push_status tar_push_update (tar_push * push, range_const_unsigned_char * input)
+{
+    if (push->status == TAR_PUSH_END || push->status == TAR_PUSH_ERROR)
+    {
+	return push->status;
+    }
+
+    push->data = (range_const_unsigned_char){0};
+
+    if (push->contents_remaining)
+    {
+	return push->status = give_contents (push, input);
+    }
+
+    if (push->padding_remaining)
+    {
+	size_t size = push->padding_remaining;
+
+	if ((size_t) range_count (*input) < size)
+	{
+	    size = range_count (*input);
+	}
+
+	input->begin += size;
+	push->padding_remaining -= size;
+	push->state.offset.position += size;
+
+	if (push->padding_remaining)
+	{
+	    push->need = push->padding_remaining + TAR_BLOCK_SIZE;
+	    return push->status = TAR_PUSH_NEED;
+	}
+    }
+
+    return push->status = parse_header (push, input);
+}
+
+void tar_push_cleanup (tar_push * push)
+{
+    tar_cleanup (&push->state);
+}
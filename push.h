@@ -0,0 +1,54 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "common.h"
+#include "read.h"
+#endif
+
+/**
+   @file tar/push.h
+   Describes a non-blocking parser for tar streams whose bytes are pushed to it as they arrive, such as uploads handled by an event loop. The parser never reads, so one thread can parse any number of streams, each with its own tar_push.
+   To use it, zero a tar_push, then give each chunk of input to tar_push_update, calling it repeatedly until it returns TAR_PUSH_NEED, at which point every byte of the chunk has been consumed and need gives the number of further bytes the parser is waiting for. The caller does not need to keep any part of a chunk once it has been consumed, as the parser copies the few bytes of a header that are split between chunks. File contents are returned as ranges within the chunk, and are never copied.
+*/
+
+typedef enum
+{
+    TAR_PUSH_NEED, ///< The input has been consumed, and more is needed to make progress
+    TAR_PUSH_ITEM, ///< A new item has been parsed, and is described by the parser's state
+    TAR_PUSH_DATA, ///< Part of the contents of the current file is given by the parser's data
+    TAR_PUSH_END, ///< The end of the tar has been reached
+    TAR_PUSH_ERROR, ///< The stream is not a valid tar
+}
+    tar_push_status; ///< The results of tar_push_update
+
+typedef struct tar_push tar_push;
+struct tar_push {
+    tar_state state; ///< Describes the current item after TAR_PUSH_ITEM. Its source is unused and must not be read from.
+    range_const_unsigned_char data; ///< After TAR_PUSH_DATA, the contents that were given, which point into the input. For a sparse file, these are the contents of its extents placed end to end, as with tar_read_file_part.
+    unsigned long long need; ///< After TAR_PUSH_NEED, the number of bytes needed to finish the part of the tar being parsed, as far as can be told from what has been parsed so far. This is the rest of a header block and of any extended header being read, the rest of the padding after a file's contents along with the header that follows, or the rest of a file's contents, which are returned as soon as any of them are given. A header block that turns out to begin an extended header, or to be the first of the zero blocks that end the tar, leads to a further request.
+    tar_push_status status; ///< The result of the last update. Once this is TAR_PUSH_END or TAR_PUSH_ERROR, it is returned by every later update without consuming any input.
+    unsigned long long contents_remaining; ///< The number of bytes of the current file's contents that have not been given
+    size_t padding_remaining; ///< The number of padding bytes after the current file's contents that have not been consumed
+    unsigned char block[TAR_BLOCK_SIZE]; ///< The start of a header block that was split between chunks
+    size_t block_size; ///< The number of bytes in block
+};
+/**< @struct tar_push
+   The state of a single tar stream being parsed by tar_push_update. It should be zeroed before use.
+*/
+
+tar_push_status tar_push_update (tar_push * push, range_const_unsigned_char * input);
+/**<
+   @brief Consumes input until the next item, the next piece of a file's contents, the end of the tar, or the end of the input is reached. Errors are kept by the given parser alone, so a stream that fails can be dropped without disturbing others.
+   @return The status of the parser, which is also stored in push->status
+   @param push The parser of the stream
+   @param input The bytes of the stream that have arrived. Its beginning is moved past the bytes that were consumed.
+*/
+
+void tar_push_cleanup (tar_push * push);
+/**<
+   @brief Frees all memory allocated to the given parser, but not the parser itself.
+*/
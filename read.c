@@ -4,7 +4,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
+#include <errno.h>
 #define FLAT_INCLUDES
 #include "../range/def.h"
 #include "../window/def.h"
@@ -16,60 +18,455 @@
 #include "read.h"
 #include "../log/log.h"
 #include "internal/spec.h"
+#include "internal/decode.h"
+
+#define PATH_SEPARATOR '/'
 
 void tar_restart(tar_state * state)
 {
     state->type = TAR_ERROR;
     window_rewrite (state->path);
     window_rewrite (state->link.path);
+    window_rewrite (state->pax.records);
+    state->offset = (struct tar_state_offset){0};
+    state->pending = (struct tar_state_pending){0};
+    state->pax.local = (tar_pax_values){0};
+    state->pax.global = (tar_pax_values){0};
+    window_rewrite (state->sparse.map);
+    state->sparse.is_sparse = false;
+    window_rewrite (state->deleted);
+}
+
+static bool tar_get_size (size_t * size, const tar_header_fields * fields)
+{
+    if (fields->invalid & TAR_FIELD_SIZE || fields->size > SIZE_MAX)
+    {
+	log_error ("could not parse size");
+	return false;
+    }
+
+    *size = fields->size;
+
+    return true;
+}
+
+static bool tar_get_mode (size_t * mode, const tar_header_fields * fields)
+{
+    if (fields->invalid & TAR_FIELD_MODE)
+    {
+	log_error ("could not parse mode");
+	return false;
+    }
+
+    *mode = fields->mode;
+
+    return true;
 }
 
-static bool tar_get_size (size_t * size, const struct posix_header * header)
+static bool header_is_valid (tar_checksum_mode mode, const tar_header_fields * fields, const struct posix_header * header)
 {
-    char * endptr;
+    switch (mode)
+    {
+    case TAR_CHECKSUM_NONE:
+	return true;
+
+    case TAR_CHECKSUM_STRICT:
+	return !memcmp (header->magic, TMAGIC, sizeof(TMAGIC) - 1)
+	    && !(fields->invalid & (TAR_FIELD_MODE | TAR_FIELD_UID | TAR_FIELD_GID | TAR_FIELD_MTIME | TAR_FIELD_CHKSUM))
+	    && fields->chksum == fields->sum_unsigned;
+
+    default:
+	return tar_header_checksum_matches (fields);
+    }
+}
 
-    if (header->size[0] & 128) // base 256 encoding, not sure of format
+static bool parse_decimal (unsigned long long * value, const char * begin, const char * end)
+{
+    if (begin == end)
     {
-	log_error ("base 256 not implemented");
 	return false;
     }
-    else // null terminated octal encoding
+
+    unsigned long long result = 0;
+
+    for (; begin < end; begin++)
     {
-	*size = strtol (header->size, &endptr, 8);
-	if (!*header->size || *endptr)
+	if (*begin < '0' || *begin > '9' || result > (ULLONG_MAX - 9) / 10)
 	{
-	    log_error ("could not parse size");
 	    return false;
 	}
+
+	result = result * 10 + (unsigned) (*begin - '0');
     }
 
+    *value = result;
     return true;
 }
 
-static bool tar_get_mode (size_t * mode, const struct posix_header * header)
+static bool parse_pax_time (long long * sec, unsigned long * nsec, const char * begin, const char * end)
 {
-    char * endptr;
-    
-    *mode = strtol (header->mode, &endptr, 8);
-    if (!*header->mode || *endptr)
+    bool negative = begin < end && *begin == '-';
+
+    if (negative)
+    {
+	begin++;
+    }
+
+    const char * point = memchr (begin, '.', end - begin);
+    unsigned long long whole;
+
+    if (!parse_decimal (&whole, begin, point ? point : end) || whole > LLONG_MAX)
     {
-	log_error ("could not parse mode, error at byte %zu", endptr - header->mode);
 	return false;
     }
 
+    unsigned long fraction = 0;
+
+    if (point)
+    {
+	int digits = 0;
+
+	for (const char * i = point + 1; i < end; i++)
+	{
+	    if (*i < '0' || *i > '9')
+	    {
+		return false;
+	    }
+
+	    if (digits < 9)
+	    {
+		fraction = fraction * 10 + (unsigned) (*i - '0');
+		digits++;
+	    }
+	}
+
+	for (; digits < 9; digits++)
+	{
+	    fraction *= 10;
+	}
+    }
+
+    if (negative && fraction)
+    {
+	*sec = -(long long) whole - 1;
+	*nsec = 1000000000 - fraction;
+    }
+    else
+    {
+	*sec = negative ? -(long long) whole : (long long) whole;
+	*nsec = fraction;
+    }
+
     return true;
 }
 
-static bool block_is_zero (const range_const_unsigned_char * header)
+static bool append_deleted (window_char * deleted, const char * begin, const char * end)
 {
-    for (uint64_t *test = (void*) header->begin; (void*) test < (void*) header->end; test++)
+    // each name is an entry of the directory, followed by a null as in a GNU dumpdir, so it cannot lead outside of the directory
+
+    if (begin == end || end[-1] != '\0')
     {
-	if (*test != 0)
+	return false;
+    }
+
+    for (const char * name = begin; name < end; name += strlen (name) + 1)
+    {
+	if (!*name || strchr (name, PATH_SEPARATOR) || !strcmp (name, ".") || !strcmp (name, ".."))
 	{
 	    return false;
 	}
     }
+
+    window_append_bytes ((window_unsigned_char*) deleted, (const unsigned char*) begin, end - begin);
+
+    return true;
+}
+
+static bool apply_pax_record (tar_state * state, tar_pax_values * values, bool global, const char * key, size_t key_size, const char * value, const char * value_end)
+{
+#define key_is(name) (key_size == sizeof(name) - 1 && !memcmp (key, name, key_size))
+
+    if (key_is ("path"))
+    {
+	if (!global && !state->pending.sparse_name)
+	{
+	    window_printf (&state->path, "%.*s", (int) (value_end - value), value);
+	    state->pending.name = true;
+	}
+    }
+    else if (key_is ("linkpath"))
+    {
+	if (!global)
+	{
+	    window_printf (&state->link.path, "%.*s", (int) (value_end - value), value);
+	    state->pending.link = true;
+	}
+    }
+    else if (key_is ("size"))
+    {
+	values->has_size = parse_decimal (&values->size, value, value_end);
+	return values->has_size;
+    }
+    else if (key_is ("uid"))
+    {
+	values->has_uid = parse_decimal (&values->uid, value, value_end);
+	return values->has_uid;
+    }
+    else if (key_is ("gid"))
+    {
+	values->has_gid = parse_decimal (&values->gid, value, value_end);
+	return values->has_gid;
+    }
+    else if (key_is ("mtime"))
+    {
+	values->has_mtime = parse_pax_time (&values->mtime_sec, &values->mtime_nsec, value, value_end);
+	return values->has_mtime;
+    }
+    else if (global)
+    {
+	// the GNU sparse records and deleted entries describe a single item
+    }
+    else if (key_is (TAR_PAX_DELETED))
+    {
+	return append_deleted (&state->deleted, value, value_end);
+    }
+    else if (key_is ("GNU.sparse.name"))
+    {
+	window_printf (&state->path, "%.*s", (int) (value_end - value), value);
+	state->pending.name = true;
+	state->pending.sparse_name = true;
+    }
+    else if (key_is ("GNU.sparse.realsize") || key_is ("GNU.sparse.size"))
+    {
+	values->has_sparse_realsize = parse_decimal (&values->sparse_realsize, value, value_end);
+	return values->has_sparse_realsize;
+    }
+    else if (key_is ("GNU.sparse.major"))
+    {
+	return parse_decimal (&values->sparse_major, value, value_end);
+    }
+    else if (key_is ("GNU.sparse.minor"))
+    {
+	return parse_decimal (&values->sparse_minor, value, value_end);
+    }
+    else if (key_is ("GNU.sparse.map"))
+    {
+	// format 0.1 gives the whole map as comma separated offsets and sizes
+	
+	window_rewrite (state->sparse.map);
+	
+	for (const char * number = value; number < value_end; )
+	{
+	    const char * comma = memchr (number, ',', value_end - number);
+	    const char * number_end = comma ? comma : value_end;
+	    tar_sparse_extent * extent = window_push (state->sparse.map);
+	    
+	    if (!parse_decimal (&extent->offset, number, number_end) || !comma)
+	    {
+		return false;
+	    }
+
+	    number = comma + 1;
+	    comma = memchr (number, ',', value_end - number);
+	    number_end = comma ? comma : value_end;
+
+	    if (!parse_decimal (&extent->size, number, number_end))
+	    {
+		return false;
+	    }
+
+	    number = comma ? comma + 1 : value_end;
+	}
+    }
+    else if (key_is ("GNU.sparse.offset"))
+    {
+	// format 0.0 gives each extent as a pair of records
+	
+	tar_sparse_extent * extent = window_push (state->sparse.map);
+	extent->size = 0;
+	return parse_decimal (&extent->offset, value, value_end);
+    }
+    else if (key_is ("GNU.sparse.numbytes"))
+    {
+	return !range_is_empty (state->sparse.map.region)
+	    && parse_decimal (&state->sparse.map.region.end[-1].size, value, value_end);
+    }
+
+    return true;
+
+#undef key_is
+}
+
+static bool apply_pax_records (tar_state * state, tar_pax_values * values, bool global)
+{
+    // each record is "<length> <key>=<value>\n", where length counts the whole record
     
+    const char * record = state->pax.records.region.begin;
+    const char * end = state->pax.records.region.end;
+
+    while (record < end && *record)
+    {
+	const char * space = memchr (record, ' ', end - record);
+	unsigned long long length;
+
+	if (!space || !parse_decimal (&length, record, space) || length <= (unsigned long long) (space - record) + 1 || length > (unsigned long long) (end - record))
+	{
+	    log_error ("Malformed pax record length");
+	    return false;
+	}
+
+	const char * record_end = record + length;
+	const char * key = space + 1;
+	const char * equals = memchr (key, '=', record_end - key);
+
+	if (!equals || record_end[-1] != '\n')
+	{
+	    log_error ("Malformed pax record");
+	    return false;
+	}
+
+	if (!apply_pax_record (state, values, global, key, equals - key, equals + 1, record_end - 1))
+	{
+	    log_error ("Invalid value for pax record %.*s", (int) (equals - key), key);
+	    return false;
+	}
+
+	record = record_end;
+    }
+
+    return true;
+}
+
+static void apply_pax_values (tar_state * state, const tar_pax_values * values)
+{
+    if (values->has_size && state->type == TAR_FILE)
+    {
+	state->file.size = values->size;
+    }
+
+    if (values->has_uid)
+    {
+	state->uid = values->uid;
+    }
+
+    if (values->has_gid)
+    {
+	state->gid = values->gid;
+    }
+
+    if (values->has_mtime)
+    {
+	state->mtime.sec = values->mtime_sec;
+	state->mtime.nsec = values->mtime_nsec;
+    }
+}
+
+static bool parse_sparse_entries (tar_state * state, const struct sparse * entries, size_t count)
+{
+    // unused entries of a GNU sparse header are zeroed, and end the map
+
+    for (size_t i = 0; i < count && entries[i].offset[0]; i++)
+    {
+	tar_sparse_extent * extent = window_push (state->sparse.map);
+
+	if (!tar_decode_numeric (&extent->offset, entries[i].offset, sizeof(entries[i].offset))
+	    || !tar_decode_numeric (&extent->size, entries[i].numbytes, sizeof(entries[i].numbytes)))
+	{
+	    log_error ("Invalid GNU sparse map entry");
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+static bool read_sparse_map_block (bool * done, tar_state * state, const unsigned char * block)
+{
+    // format 1.0 stores the map in the file's contents as newline terminated decimal numbers: the number of extents, then the offset and size of each. The map is padded to a whole block.
+
+    window_append_bytes ((window_unsigned_char*) &state->pax.records, block, TAR_BLOCK_SIZE);
+
+    const char * line = state->pax.records.region.begin;
+    const char * end = state->pax.records.region.end;
+    const char * newline;
+
+    while (!*done && (newline = memchr (line, '\n', end - line)))
+    {
+	unsigned long long value;
+
+	if (!parse_decimal (&value, line, newline))
+	{
+	    log_error ("Invalid number in pax sparse map");
+	    return false;
+	}
+
+	line = newline + 1;
+
+	if (!state->sparse.map_counted)
+	{
+	    if (value > ULLONG_MAX / 2)
+	    {
+		log_error ("Pax sparse map is oversized");
+		return false;
+	    }
+	    
+	    state->sparse.map_counted = true;
+	    state->sparse.map_values = 2 * value;
+	}
+	else if (state->sparse.map_values-- % 2 == 0)
+	{
+	    window_push (state->sparse.map)->offset = value;
+	}
+	else
+	{
+	    state->sparse.map.region.end[-1].size = value;
+	}
+
+	*done = state->sparse.map_counted && state->sparse.map_values == 0;
+    }
+
+    // a partial line is kept for the next block
+
+    size_t rest = end - line;
+    memmove (state->pax.records.region.begin, line, rest);
+    state->pax.records.region.end = state->pax.records.region.begin + rest;
+
+    return true;
+}
+
+static bool finish_sparse_map (tar_state * state)
+{
+    // extents must be in order, must not overlap, and must hold exactly the stored contents. Empty extents, which GNU tar uses to mark a trailing hole, are dropped.
+
+    tar_sparse_extent * output = state->sparse.map.region.begin;
+    unsigned long long end = 0;
+    unsigned long long stored = 0;
+
+    for (const tar_sparse_extent * input = state->sparse.map.region.begin; input < state->sparse.map.region.end; input++)
+    {
+	if (input->offset < end || input->size > state->sparse.size || input->offset > state->sparse.size - input->size)
+	{
+	    log_error ("Sparse map extents are out of order or out of bounds");
+	    return false;
+	}
+
+	end = input->offset + input->size;
+	stored += input->size;
+
+	if (input->size)
+	{
+	    *output++ = *input;
+	}
+    }
+
+    state->sparse.map.region.end = output;
+
+    if (stored != state->file.size)
+    {
+	log_error ("Sparse map does not match the stored size of %s", state->path.region.begin);
+	return false;
+    }
+
     return true;
 }
 
@@ -116,18 +513,60 @@ static void append_blocks (window_char * name, size_t file_size, range_const_uns
     name->region.end--;
 }
 
-bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
+static bool tar_update_mem_blocks (tar_state * state, range_const_unsigned_char * mem)
 {
     state->ready = false;
 
-    bool longname = false;
-    bool longlink = false;
+    const unsigned char * mem_begin = mem->begin;
 
     if (range_count (*mem) < TAR_BLOCK_SIZE)
     {
 	goto notready;
     }
 
+    if (state->pending.sparse_header || state->pending.sparse_map)
+    {
+	// the item has been parsed, but its sparse map continues in the blocks that follow its header
+	
+	const unsigned char * block = mem->begin;
+	mem->begin += TAR_BLOCK_SIZE;
+	
+	bool done = false;
+
+	if (state->pending.sparse_header)
+	{
+	    const struct sparse_header * extension = (const void*) block;
+
+	    if (!parse_sparse_entries (state, extension->sp, SPARSES_IN_SPARSE_HEADER))
+	    {
+		log_fatal ("Invalid GNU sparse extension header");
+	    }
+
+	    done = !extension->isextended;
+	}
+	else
+	{
+	    if (state->file.size < TAR_BLOCK_SIZE)
+	    {
+		log_fatal ("Pax sparse map is larger than its file");
+	    }
+
+	    state->file.size -= TAR_BLOCK_SIZE;
+
+	    if (!read_sparse_map_block (&done, state, block))
+	    {
+		log_fatal ("Invalid pax sparse map");
+	    }
+	}
+
+	if (done)
+	{
+	    goto ready;
+	}
+	
+	goto notready;
+    }
+
     if (state->type == TAR_LONGNAME)
     {
 	if ((size_t) range_count(state->path.region) < state->file.size)
@@ -141,7 +580,7 @@ bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
 	    log_fatal ("tar longname path is oversized");
 	}
 
-	longname = true;
+	state->pending.name = true;
     }
     else if (state->type == TAR_LONGLINK)
     {
@@ -156,7 +595,22 @@ bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
 	    log_fatal ("tar longlink path is oversized");
 	}
 
-	longlink = true;
+	state->pending.link = true;
+    }
+    else if (state->type == TAR_PAX || state->type == TAR_PAX_GLOBAL)
+    {
+	if ((size_t) range_count(state->pax.records.region) < state->file.size)
+	{
+	    append_blocks (&state->pax.records, state->file.size, mem);
+	    goto notready;
+	}
+
+	bool global = state->type == TAR_PAX_GLOBAL;
+
+	if (!apply_pax_records (state, global ? &state->pax.global : &state->pax.local, global))
+	{
+	    log_fatal ("Invalid pax header");
+	}
     }
 
     if (range_count (*mem) < TAR_BLOCK_SIZE)
@@ -164,13 +618,22 @@ bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
 	goto notready;
     }
     
+    if (state->type != TAR_LONGNAME && state->type != TAR_LONGLINK && state->type != TAR_PAX && state->type != TAR_END)
+    {
+	state->offset.header = state->offset.position + (mem->begin - mem_begin);
+	window_rewrite (state->deleted);
+    }
+
     const range_const_unsigned_char header_mem = { .begin = mem->begin, .end = mem->begin + TAR_BLOCK_SIZE };
     mem->begin += TAR_BLOCK_SIZE;
 
     const struct posix_header * header = (void*) header_mem.begin;
     assert (sizeof(*header) <= (size_t)range_count (header_mem));
+
+    tar_header_fields fields;
+    tar_decode_header (&fields, header_mem.begin);
     
-    if (block_is_zero (&header_mem))
+    if (fields.zero)
     {
 	if (state->type == TAR_END)
 	{
@@ -182,7 +645,11 @@ bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
 	    goto notready;
 	}
     }
-    else if(header->typeflag == REGTYPE)
+    else if (!header_is_valid (state->checksum, &fields, header))
+    {
+	log_fatal ("Tar header checksum mismatch at offset %llu", state->offset.position + (header_mem.begin - mem_begin));
+    }
+    else if(header->typeflag == REGTYPE || header->typeflag == AREGTYPE)
     {
 	state->type = TAR_FILE;
     }
@@ -196,7 +663,11 @@ bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
     }
     else if (header->typeflag == LNKTYPE)
     {
-	state->type = LNKTYPE;
+	state->type = TAR_HARDLINK;
+    }
+    else if (header->typeflag == GNUTYPE_SPARSE)
+    {
+	state->type = TAR_FILE;
     }
     else
     {
@@ -210,27 +681,45 @@ bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
 	    state->type = TAR_LONGLINK;
 	    window_rewrite (state->link.path);
 	}
+	else if (header->typeflag == XHDTYPE)
+	{
+	    state->type = TAR_PAX;
+	    window_rewrite (state->pax.records);
+	    window_rewrite (state->sparse.map);
+	}
+	else if (header->typeflag == XGLTYPE)
+	{
+	    state->type = TAR_PAX_GLOBAL;
+	    window_rewrite (state->pax.records);
+	}
 	else
 	{
 	    log_fatal ("Invalid typeflag in tar header");
 	}
 
+	if (!tar_get_size (&state->file.size, &fields))
+	{
+	    log_fatal ("Could not read tar extended header size");
+	}
+
 	goto notready;
     }
+
+    state->offset.item = state->offset.position + (header_mem.begin - mem_begin);
 	
-    if (!longname)
+    if (!state->pending.name)
     {
-	window_printf (&state->path, "%s", header->name);
+	window_printf (&state->path, "%.*s", (int) strnlen (header->name, sizeof(header->name)), header->name);
     }
     
     if (state->type == TAR_HARDLINK || state->type == TAR_SYMLINK)
     {
-	if (!longlink)
+	if (!state->pending.link)
 	{
-	    window_printf (&state->link.path, "%s", header->linkname);
+	    window_printf (&state->link.path, "%.*s", (int) strnlen (header->linkname, sizeof(header->linkname)), header->linkname);
 	}
     }
-    else if (longlink)
+    else if (state->pending.link)
     {
 	log_fatal ("Longlink specified for non-link type (%d)", state->type);
     }
@@ -238,7 +727,7 @@ bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
     if (state->type == TAR_FILE)
     {
 	state->file.bytes_read = 0;
-	if (!tar_get_size (&state->file.size, header))
+	if (!tar_get_size (&state->file.size, &fields))
 	{
 	    log_fatal ("Could not read tar file size");
 	}
@@ -246,13 +735,77 @@ bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
 
     if (state->type == TAR_FILE || state->type == TAR_DIR || state->type == TAR_HARDLINK || state->type == TAR_SYMLINK)
     {
-	if (!tar_get_mode (&state->mode, header))
+	if (!tar_get_mode (&state->mode, &fields))
 	{
 	    log_fatal ("Could not read tar file mode");
 	}
     }
+
+    state->uid = fields.uid;
+    state->gid = fields.gid;
+    state->mtime.sec = fields.mtime;
+    state->mtime.nsec = 0;
+
+    apply_pax_values (state, &state->pax.global);
+    apply_pax_values (state, &state->pax.local);
+
+    if (range_count (state->deleted.region) && state->type != TAR_DIR)
+    {
+	log_fatal ("Deleted entries were given for %s, which is not a directory", state->path.region.begin);
+    }
+
+    state->sparse.is_sparse = false;
+
+    if (header->typeflag == GNUTYPE_SPARSE)
+    {
+	const struct oldgnu_header * oldgnu = (const void*) header;
+
+	window_rewrite (state->sparse.map);
+	state->sparse.is_sparse = true;
+
+	if (!tar_decode_numeric (&state->sparse.size, oldgnu->realsize, sizeof(oldgnu->realsize))
+	    || !parse_sparse_entries (state, oldgnu->sp, SPARSES_IN_OLDGNU_HEADER))
+	{
+	    log_fatal ("Invalid GNU sparse header");
+	}
+
+	if (oldgnu->isextended)
+	{
+	    state->pending.sparse_header = true;
+	    goto notready;
+	}
+    }
+    else if (state->type == TAR_FILE && state->pax.local.has_sparse_realsize)
+    {
+	state->sparse.is_sparse = true;
+	state->sparse.size = state->pax.local.sparse_realsize;
+
+	if (state->pax.local.sparse_major == 1)
+	{
+	    // pax.records is free once the pax header has been applied, so it holds partial lines of the map
+	    
+	    window_rewrite (state->sparse.map);
+	    window_rewrite (state->pax.records);
+	    state->sparse.map_counted = false;
+	    state->sparse.map_values = 0;
+	    state->pending.sparse_map = true;
+	    goto notready;
+	}
+    }
+    else
+    {
+	window_rewrite (state->sparse.map);
+    }
     
-//ready:
+ready:
+    if (state->sparse.is_sparse && !finish_sparse_map (state))
+    {
+	log_fatal ("Invalid sparse map");
+    }
+    
+    state->offset.data = state->offset.position + (mem->begin - mem_begin);
+    state->pending = (struct tar_state_pending){0};
+    state->pax.local = (tar_pax_values){0};
     state->ready = true;
     assert (range_count (*mem) >= 0);
     return true;
@@ -275,6 +828,17 @@ done:
     return false;
 }
 
+bool tar_update_mem (tar_state * state, range_const_unsigned_char * mem)
+{
+    const unsigned char * mem_begin = mem->begin;
+
+    bool retval = tar_update_mem_blocks (state, mem);
+
+    state->offset.position += mem->begin - mem_begin;
+
+    return retval;
+}
+
 bool tar_update (tar_state * state)
 {
     bool error = false;
@@ -318,21 +882,55 @@ inline static size_t size_to_blocks (size_t size)
 	: size / TAR_BLOCK_SIZE + 1;
 }
 
+static bool seek_bytes (bool * error, tar_state * state, size_t size)
+{
+    window_unsigned_char * buffer = state->source->contents;
+    size_t buffered = range_count (buffer->region);
+
+    if (size <= buffered)
+    {
+	return convert_skip_bytes (error, state->source, size);
+    }
+
+    if ((off_t) -1 == lseek (state->seek.fd, size - buffered, SEEK_CUR))
+    {
+	if (errno == ESPIPE)
+	{
+	    state->seek.enabled = false;
+	    return convert_skip_bytes (error, state->source, size);
+	}
+	
+	perror ("lseek");
+	log_fatal ("Failed to seek past tar file contents");
+    }
+
+    window_rewrite (*buffer);
+
+    return true;
+
+fail:
+    *error = true;
+    return false;
+}
+
 bool tar_skip_file (tar_state * state)
 {
     assert (state->type == TAR_FILE);
 
-    size_t skip_size = size_to_blocks (state->file.size) * TAR_BLOCK_SIZE;
+    size_t skip_size = size_to_blocks (state->file.size) * TAR_BLOCK_SIZE - state->file.bytes_read;
 
     bool error = false;
 
-    if (convert_skip_bytes(&error, state->source, skip_size))
+    if (state->seek.enabled
+	? !seek_bytes (&error, state, skip_size)
+	: !convert_skip_bytes(&error, state->source, skip_size))
     {
 	state->type = TAR_ERROR;
 	return false;
     }
     else
     {
+	state->offset.position += skip_size;
 	return true;
     }
 }
@@ -343,6 +941,12 @@ void tar_cleanup (tar_state * state)
     window_rewrite (state->path);
     free (state->link.path.region.begin);
     window_rewrite (state->link.path);
+    free (state->pax.records.region.begin);
+    window_rewrite (state->pax.records);
+    free (state->sparse.map.region.begin);
+    window_rewrite (state->sparse.map);
+    free (state->deleted.region.begin);
+    window_rewrite (state->deleted);
 }
 
 bool tar_read_file_part (bool * error, range_const_unsigned_char * contents, tar_state * state)
@@ -363,6 +967,11 @@ bool tar_read_file_part (bool * error, range_const_unsigned_char * contents, tar
 	    log_fatal ("Could not skip trailing file block bytes");
 	}
 
+	if (skip_bytes < TAR_BLOCK_SIZE)
+	{
+	    state->offset.position += skip_bytes;
+	}
+
 	assert (!*error);
 	return false;
     }
@@ -375,6 +984,7 @@ bool tar_read_file_part (bool * error, range_const_unsigned_char * contents, tar
 
 	size_t got_bytes = range_count(*contents);
 	state->file.bytes_read += got_bytes;
+	state->offset.position += got_bytes;
 
 	assert (!*error);
 	return true;
@@ -14,20 +14,62 @@
    Describes the public interface for the reading portion of the tar library.
    In order to read through a tar with this library, first allocate and zero a tar_state structure. Then feed it tar sectors using tar_update_fd or tar_update_mem according to your needs. The metadata pertaining to the current file/directory/link/etc can be directly read from the tar_state after it has been updated. If the tar is being read from a stream, the contents of a file must be read before the tar state is updated again. To do this, use either tar_read_region or tar_skip_file.
 
-   \todo Add chain-io functionality to the tar library
+   To read a compressed tar, give tar_state.source a decompressing source such as those in gz.h and zst.h.
+
    \todo Consider adding a mainpage to the tar library
    \todo Update docs after the buffer to window change
 */
 
+typedef enum
+{
+    TAR_CHECKSUM_DEFAULT, ///< Rejects headers whose checksum matches neither the unsigned nor the historical signed sum of the header
+    TAR_CHECKSUM_STRICT, ///< Additionally rejects headers without ustar magic, with unparseable numeric fields, or with a checksum that only matches the signed sum
+    TAR_CHECKSUM_NONE, ///< Skips checksum verification
+}
+    tar_checksum_mode; ///< Levels of header verification performed by tar_update_mem
+
+typedef struct tar_pax_values tar_pax_values;
+struct tar_pax_values {
+    bool has_size; ///< True if size was given
+    bool has_uid; ///< True if uid was given
+    bool has_gid; ///< True if gid was given
+    bool has_mtime; ///< True if mtime was given
+    unsigned long long size; ///< The size of the item's contents
+    unsigned long long uid; ///< The user id of the item
+    unsigned long long gid; ///< The group id of the item
+    long long mtime_sec; ///< The modification time of the item, in epoch seconds
+    unsigned long mtime_nsec; ///< The sub-second part of the modification time, in nanoseconds
+    bool has_sparse_realsize; ///< True if GNU.sparse.realsize or GNU.sparse.size was given
+    unsigned long long sparse_realsize; ///< The size of a sparse file, including its holes
+    unsigned long long sparse_major; ///< The GNU sparse format major version
+    unsigned long long sparse_minor; ///< The GNU sparse format minor version
+};
+/**< @struct tar_pax_values
+   Numeric values given by a pax extended or global header, which override those in the ustar header
+*/
+
 typedef struct tar_state tar_state;
 struct tar_state {
     bool ready; ///< True if the state is ready for use
+
+    tar_checksum_mode checksum; ///< The verification performed on each header. This may be set before the first update, and is kept by tar_restart.
     
     tar_type type; ///< The current item type
     window_char path; ///< The path of the current item
 
     size_t mode; ///< The mode of the current item
 
+    unsigned long long uid; ///< The user id of the current item
+
+    unsigned long long gid; ///< The group id of the current item
+
+    struct tar_state_mtime ///< The modification time of the current item
+    {
+	long long sec; ///< Epoch seconds
+	unsigned long nsec; ///< Nanoseconds, which are only given by pax headers
+    }
+	mtime; ///< Contains the modification time of the current item
+
     struct tar_state_link ///< tar_state information that is specific to links
     {
 	window_char path; ///< If the current item is a hardlink or symlink, this is its target path
@@ -36,12 +78,58 @@ struct tar_state {
 
     struct tar_state_file ///< tar_state information that is specific to files
     {
-	size_t size; ///< If the current item is a file, this is its size
+	size_t size; ///< If the current item is a file, this is its size. For a sparse file, this is the number of bytes stored in the tar, which is the total size of its data extents.
 	size_t bytes_read;
     }
 	file; ///< Contains information specific to files
+
+    struct tar_state_sparse ///< tar_state information that is specific to sparse files
+    {
+	bool is_sparse; ///< True if the current item is a sparse file. Its contents, as read by tar_read_file_part, are then the contents of each extent in map placed end to end.
+	unsigned long long size; ///< If the current item is a sparse file, this is its size including holes
+	window_tar_sparse_extent map; ///< If the current item is a sparse file, these are its data extents in order of offset
+	bool map_counted; ///< Used internally while reading a pax sparse map, true once the number of its entries has been read
+	unsigned long long map_values; ///< Used internally while reading a pax sparse map, the number of offsets and sizes that remain to be read
+    }
+	sparse; ///< Contains information specific to sparse files
+
+    window_char deleted; ///< If the current item is a directory from an incremental tar, the names of its entries that were deleted since the snapshot the tar was made against, each followed by a null. It is empty for other items.
+
+    struct tar_state_offset ///< Positions within the tar stream, counted from the first byte given to this state
+    {
+	unsigned long long header; ///< The offset of the first header block of the current item, including any longname or longlink headers preceding it
+	unsigned long long item; ///< The offset of the current item's own header block, which follows any longname, longlink or pax headers
+	unsigned long long data; ///< The offset of the current item's contents
+	unsigned long long position; ///< The number of stream bytes consumed so far
+    }
+	offset; ///< Contains the stream offsets of the current item
+
+    struct tar_state_pending ///< Long names that have been read, but not yet applied to an item
+    {
+	bool name; ///< True if a longname has been read into path
+	bool link; ///< True if a longlink has been read into link.path
+	bool sparse_name; ///< True if a GNU.sparse.name pax record has been read into path, which then takes precedence over a pax path record
+	bool sparse_header; ///< True if the current item is a GNU sparse file whose map continues in extension headers
+	bool sparse_map; ///< True if the current item is a pax sparse file whose map is stored at the start of its contents
+    }
+	pending; ///< Used internally to apply longnames and longlinks that precede each other
+
+    struct tar_state_pax ///< Values read from pax headers
+    {
+	window_char records; ///< The records of the pax header currently being read
+	tar_pax_values local; ///< Values from a pax extended header, to be applied to the next item
+	tar_pax_values global; ///< Values from pax global headers, which apply to every following item
+    }
+	pax; ///< Used internally to apply pax headers
     
     convert_source * source;
+
+    struct tar_state_seek ///< Allows skipped contents to be passed over without reading them
+    {
+	bool enabled; ///< If true, fd is the file descriptor underlying source, and tar_skip_file moves past contents that are not yet buffered with lseek instead of reading them. It is cleared by tar_skip_file if fd turns out not to be seekable.
+	int fd; ///< The file descriptor underlying source
+    }
+	seek; ///< Optionally set by the caller before the first update
 };
 
 bool tar_read_file_part (bool * error, range_const_unsigned_char * contents, tar_state * state);
@@ -81,10 +169,9 @@ void tar_cleanup (tar_state * state);
 
 bool tar_skip_file (tar_state * state);
 /**<
-   @brief Skips the file in a tar stream currently described by 'state'. If 'state' is not currently indicating a file, then the behavior of this function is undefined.
+   @brief Skips the file in a tar stream currently described by 'state'. If 'state' is not currently indicating a file, then the behavior of this function is undefined. If state->seek is enabled, contents beyond those already buffered by the source are skipped with lseek and the buffer is discarded, so that listing or indexing a tar on disk reads little more than its headers.
    @return True if successful, false otherwise
    @param state The state describing the file to skip
-   @param fd The file descriptor to read from
 */
 
 bool tar_read_file_whole (window_unsigned_char * output, tar_state * state);
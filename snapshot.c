@@ -0,0 +1,542 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../convert/source.h"
+#include "../convert/sink.h"
+#include "../convert/fd/sink.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "owner.h"
+#include "hardlink.h"
+#include "write.h"
+#include "snapshot.h"
+#include "../log/log.h"
+
+#define SNAPSHOT_MAGIC "TARSNAP1"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_HEADER_SIZE (SNAPSHOT_MAGIC_SIZE + 8 + 8)
+#define SNAPSHOT_ENTRY_SIZE (8 + 8 + 8 + 4 + 8 + 8)
+#define PATH_SEPARATOR '/'
+
+typedef struct snapshot_deletion snapshot_deletion;
+struct snapshot_deletion {
+    const char * path; ///< The path in the previous snapshot that was deleted, or that lies beneath the deleted entry
+    size_t parent_size; ///< The length of the directory holding the deleted entry within path, which is 0 for the current directory
+    size_t name_begin; ///< The offset of the deleted entry's name within path
+    size_t name_end; ///< The end of the deleted entry's name within path
+};
+
+range_typedef(snapshot_deletion, snapshot_deletion);
+window_typedef(snapshot_deletion, snapshot_deletion);
+
+typedef struct snapshot_deleted_group snapshot_deleted_group;
+struct snapshot_deleted_group {
+    size_t parent_begin; ///< The offset of the null terminated path of the directory holding the deleted entries, within the pool of names
+    size_t names_begin; ///< The offset of the first deleted name within the pool, each of which is followed by a null
+    size_t names_end; ///< The end of the last deleted name within the pool
+};
+
+range_typedef(snapshot_deleted_group, snapshot_deleted_group);
+window_typedef(snapshot_deleted_group, snapshot_deleted_group);
+
+static void write_le (unsigned char * output, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+	output[i] = value & 0xff;
+	value >>= 8;
+    }
+}
+
+static uint64_t read_le (const unsigned char * input, int size)
+{
+    uint64_t value = 0;
+
+    for (int i = size - 1; i >= 0; i--)
+    {
+	value = (value << 8) | input[i];
+    }
+
+    return value;
+}
+
+static int compare_entries (const void * a_void, const void * b_void)
+{
+    const tar_snapshot_entry * a = a_void;
+    const tar_snapshot_entry * b = b_void;
+
+    return strcmp (a->path, b->path);
+}
+
+static void snapshot_finish (tar_snapshot * snapshot)
+{
+    for (tar_snapshot_entry * entry = snapshot->entries.region.begin; entry < snapshot->entries.region.end; entry++)
+    {
+	entry->path = snapshot->paths.region.begin + entry->path_begin;
+    }
+
+    qsort (snapshot->entries.region.begin, range_count (snapshot->entries.region), sizeof(*snapshot->entries.region.begin), compare_entries);
+}
+
+bool tar_snapshot_save (convert_sink * sink, const tar_snapshot * snapshot)
+{
+    window_unsigned_char buffer = {0};
+
+    size_t count = range_count (snapshot->entries.region);
+    size_t paths_size = range_count (snapshot->paths.region);
+
+    unsigned char * header = window_grow_bytes (&buffer, SNAPSHOT_HEADER_SIZE);
+    memcpy (header, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    write_le (header + SNAPSHOT_MAGIC_SIZE, count, 8);
+    write_le (header + SNAPSHOT_MAGIC_SIZE + 8, paths_size, 8);
+
+    for (const tar_snapshot_entry * entry = snapshot->entries.region.begin; entry < snapshot->entries.region.end; entry++)
+    {
+	unsigned char * output = window_grow_bytes (&buffer, SNAPSHOT_ENTRY_SIZE);
+
+	write_le (output, entry->dev, 8);
+	write_le (output + 8, entry->ino, 8);
+	write_le (output + 16, entry->mtime_sec, 8);
+	write_le (output + 24, entry->mtime_nsec, 4);
+	write_le (output + 28, entry->size, 8);
+	write_le (output + 36, entry->path_begin, 8);
+    }
+
+    window_append_bytes (&buffer, (const unsigned char*) snapshot->paths.region.begin, paths_size);
+
+    sink->contents = &buffer.region.const_cast;
+
+    bool error = false;
+
+    bool retval = convert_drain (&error, sink);
+
+    window_clear (buffer);
+
+    return retval;
+}
+
+bool tar_snapshot_load (tar_snapshot * snapshot, convert_source * source)
+{
+    bool error = false;
+
+    while (convert_fill (&error, source))
+    {
+    }
+
+    if (error)
+    {
+	log_fatal ("Failed to read tar snapshot");
+    }
+
+    const unsigned char * input = source->contents->region.begin;
+    size_t input_size = range_count (source->contents->region);
+
+    if (input_size < SNAPSHOT_HEADER_SIZE || memcmp (input, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE))
+    {
+	log_fatal ("Input is not a tar snapshot");
+    }
+
+    uint64_t count = read_le (input + SNAPSHOT_MAGIC_SIZE, 8);
+    uint64_t paths_size = read_le (input + SNAPSHOT_MAGIC_SIZE + 8, 8);
+
+    if (count > (input_size - SNAPSHOT_HEADER_SIZE) / SNAPSHOT_ENTRY_SIZE
+	|| input_size - SNAPSHOT_HEADER_SIZE - count * SNAPSHOT_ENTRY_SIZE != paths_size)
+    {
+	log_fatal ("Tar snapshot is truncated");
+    }
+
+    input += SNAPSHOT_HEADER_SIZE;
+
+    window_rewrite (snapshot->entries);
+    window_rewrite (snapshot->paths);
+
+    window_append_bytes ((window_unsigned_char*) &snapshot->paths, input + count * SNAPSHOT_ENTRY_SIZE, paths_size);
+
+    if (paths_size && snapshot->paths.region.end[-1] != '\0')
+    {
+	log_fatal ("Tar snapshot paths are not terminated");
+    }
+
+    for (uint64_t i = 0; i < count; i++, input += SNAPSHOT_ENTRY_SIZE)
+    {
+	tar_snapshot_entry * entry = window_push (snapshot->entries);
+
+	*entry = (tar_snapshot_entry){
+	    .dev = read_le (input, 8),
+	    .ino = read_le (input + 8, 8),
+	    .mtime_sec = read_le (input + 16, 8),
+	    .mtime_nsec = read_le (input + 24, 4),
+	    .size = read_le (input + 28, 8),
+	    .path_begin = read_le (input + 36, 8),
+	};
+
+	if (entry->path_begin >= paths_size)
+	{
+	    log_fatal ("Tar snapshot entry path is out of bounds");
+	}
+    }
+
+    source->contents->region.begin = source->contents->region.end;
+
+    snapshot_finish (snapshot);
+
+    return true;
+
+fail:
+    return false;
+}
+
+const tar_snapshot_entry * tar_snapshot_find (const tar_snapshot * snapshot, const char * path)
+{
+    const tar_snapshot_entry * begin = snapshot->entries.region.begin;
+    const tar_snapshot_entry * end = snapshot->entries.region.end;
+
+    while (begin < end)
+    {
+	const tar_snapshot_entry * middle = begin + (end - begin) / 2;
+	int order = strcmp (middle->path, path);
+
+	if (!order)
+	{
+	    return middle;
+	}
+	else if (order < 0)
+	{
+	    begin = middle + 1;
+	}
+	else
+	{
+	    end = middle;
+	}
+    }
+
+    return NULL;
+}
+
+static bool is_unchanged (const tar_snapshot_entry * before, const tar_snapshot_entry * now)
+{
+    return before
+	&& before->dev == now->dev
+	&& before->ino == now->ino
+	&& before->mtime_sec == now->mtime_sec
+	&& before->mtime_nsec == now->mtime_nsec
+	&& before->size == now->size;
+}
+
+static int compare_names (range_const_char a, range_const_char b)
+{
+    size_t a_size = range_count (a);
+    size_t b_size = range_count (b);
+    int order = memcmp (a.begin, b.begin, a_size < b_size ? a_size : b_size);
+
+    return order ? order : (a_size > b_size) - (a_size < b_size);
+}
+
+static range_const_char deletion_parent (const snapshot_deletion * deletion)
+{
+    static const char current_directory[] = ".";
+
+    return deletion->parent_size
+	? (range_const_char){ .begin = deletion->path, .end = deletion->path + deletion->parent_size }
+	: (range_const_char){ .begin = current_directory, .end = current_directory + 1 };
+}
+
+static range_const_char deletion_name (const snapshot_deletion * deletion)
+{
+    return (range_const_char){ .begin = deletion->path + deletion->name_begin, .end = deletion->path + deletion->name_end };
+}
+
+static int compare_deletions (const void * a_void, const void * b_void)
+{
+    const snapshot_deletion * a = a_void;
+    const snapshot_deletion * b = b_void;
+
+    int order = compare_names (deletion_parent (a), deletion_parent (b));
+
+    return order ? order : compare_names (deletion_name (a), deletion_name (b));
+}
+
+static bool find_deletion (snapshot_deletion * deletion, const char * path, const tar_snapshot * previous, const tar_snapshot * next)
+{
+    // the deletion is recorded on the nearest directory above the path that is still present, and a path beneath a directory that was deleted itself is removed along with that directory
+
+    window_char parent = {0};
+    size_t end = strlen (path);
+    bool found = false;
+
+    while (end > 1 && path[end - 1] == PATH_SEPARATOR)
+    {
+	end--;
+    }
+
+    while (true)
+    {
+	size_t name_begin = end;
+
+	while (name_begin > 0 && path[name_begin - 1] != PATH_SEPARATOR)
+	{
+	    name_begin--;
+	}
+
+	*deletion = (snapshot_deletion){ .path = path, .parent_size = name_begin, .name_begin = name_begin, .name_end = end };
+
+	while (deletion->parent_size > 1 && path[deletion->parent_size - 1] == PATH_SEPARATOR)
+	{
+	    deletion->parent_size--;
+	}
+
+	if (!deletion->parent_size)
+	{
+	    found = true;
+	    break;
+	}
+
+	window_rewrite (parent);
+	window_append_bytes ((window_unsigned_char*) &parent, (const unsigned char*) path, deletion->parent_size);
+	*window_push (parent) = '\0';
+
+	struct stat stat;
+
+	if (tar_snapshot_find (next, parent.region.begin)
+	    || (!tar_snapshot_find (previous, parent.region.begin) && 0 == lstat (parent.region.begin, &stat) && S_ISDIR (stat.st_mode)))
+	{
+	    found = true;
+	    break;
+	}
+
+	if (tar_snapshot_find (previous, parent.region.begin))
+	{
+	    break;
+	}
+
+	// the parent was never archived, and is gone as well, so the deletion moves up to it
+
+	end = deletion->parent_size;
+    }
+
+    window_clear (parent);
+
+    return found;
+}
+
+static void find_deletions (window_snapshot_deletion * deletions, window_char * names, window_snapshot_deleted_group * groups, const tar_snapshot * previous, const tar_snapshot * next)
+{
+    window_rewrite (*deletions);
+    window_rewrite (*names);
+    window_rewrite (*groups);
+
+    for (const tar_snapshot_entry * entry = previous->entries.region.begin; entry < previous->entries.region.end; entry++)
+    {
+	snapshot_deletion deletion;
+
+	if (!tar_snapshot_find (next, entry->path) && find_deletion (&deletion, entry->path, previous, next))
+	{
+	    *window_push (*deletions) = deletion;
+	}
+    }
+
+    qsort (deletions->region.begin, range_count (deletions->region), sizeof(*deletions->region.begin), compare_deletions);
+
+    // the names of each parent are gathered into one list, leaving out the repeats left by deletions that moved up to a common directory
+
+    for (const snapshot_deletion * deletion = deletions->region.begin; deletion < deletions->region.end; deletion++)
+    {
+	if (deletion > deletions->region.begin && !compare_deletions (deletion - 1, deletion))
+	{
+	    continue;
+	}
+
+	if (deletion == deletions->region.begin || compare_names (deletion_parent (deletion - 1), deletion_parent (deletion)))
+	{
+	    range_const_char parent = deletion_parent (deletion);
+	    snapshot_deleted_group * group = window_push (*groups);
+
+	    group->parent_begin = range_count (names->region);
+	    window_append_bytes ((window_unsigned_char*) names, (const unsigned char*) parent.begin, range_count (parent));
+	    *window_push (*names) = '\0';
+	    group->names_begin = range_count (names->region);
+	}
+
+	range_const_char name = deletion_name (deletion);
+	window_append_bytes ((window_unsigned_char*) names, (const unsigned char*) name.begin, range_count (name));
+	*window_push (*names) = '\0';
+
+	groups->region.end[-1].names_end = range_count (names->region);
+    }
+}
+
+static const snapshot_deleted_group * find_group (const window_snapshot_deleted_group * groups, const window_char * names, const char * path)
+{
+    // the groups are sorted by parent, in the same order as strcmp gives
+
+    const snapshot_deleted_group * begin = groups->region.begin;
+    const snapshot_deleted_group * end = groups->region.end;
+
+    while (begin < end)
+    {
+	const snapshot_deleted_group * middle = begin + (end - begin) / 2;
+	int order = strcmp (names->region.begin + middle->parent_begin, path);
+
+	if (!order)
+	{
+	    return middle;
+	}
+	else if (order < 0)
+	{
+	    begin = middle + 1;
+	}
+	else
+	{
+	    end = middle;
+	}
+    }
+
+    return NULL;
+}
+
+static bool write_directory (convert_sink * sink, window_unsigned_char * buffer, const char * path, const snapshot_deleted_group * group, const window_char * names, tar_owner_cache * owners, bool pax)
+{
+    // the header is written as tar_write_sink_path would write it, with the deleted names added
+
+    range_const_char deleted = { .begin = names->region.begin + group->names_begin, .end = names->region.begin + group->names_end };
+    struct stat stat;
+    bool error = false;
+
+    if (lstat (path, &stat))
+    {
+	perror (path);
+	log_fatal ("Failed to examine %s", path);
+    }
+
+    sink->contents = &buffer->region.const_cast;
+
+    if (!tar_write_stat_header (.output = buffer,
+				.stat = &stat,
+				.name = path,
+				.owners = owners,
+				.pax = pax,
+				.deleted = &deleted))
+    {
+	return false;
+    }
+
+    return convert_drain (&error, sink);
+
+fail:
+    return false;
+}
+
+keyargs_define(tar_write_sink_incremental)
+{
+    assert (args.sink);
+    assert (args.buffer);
+    assert (args.paths || !args.count);
+    assert (args.previous);
+    assert (args.next);
+
+    // every path is examined before anything is written, so that the directories holding deleted paths are known, and so that a path which changes while it is being written is caught by the next run
+
+    bool * skip = calloc (args.count ? args.count : 1, sizeof(*skip));
+    bool * directory = calloc (args.count ? args.count : 1, sizeof(*directory));
+    window_snapshot_deletion deletions = {0};
+    window_char names = {0};
+    window_snapshot_deleted_group groups = {0};
+
+    window_rewrite (args.next->entries);
+    window_rewrite (args.next->paths);
+
+    for (size_t i = 0; i < args.count; i++)
+    {
+	struct stat stat;
+
+	if (lstat (args.paths[i], &stat))
+	{
+	    perror (args.paths[i]);
+	    log_fatal ("Failed to examine %s", args.paths[i]);
+	}
+
+	tar_snapshot_entry now = {
+	    .dev = stat.st_dev,
+	    .ino = stat.st_ino,
+	    .mtime_sec = stat.st_mtim.tv_sec,
+	    .mtime_nsec = stat.st_mtim.tv_nsec,
+	    .size = stat.st_size,
+	    .path_begin = range_count (args.next->paths.region),
+	};
+
+	directory[i] = S_ISDIR (stat.st_mode);
+	skip[i] = !directory[i] && is_unchanged (tar_snapshot_find (args.previous, args.paths[i]), &now);
+
+	*window_push (args.next->entries) = now;
+	window_append_bytes ((window_unsigned_char*) &args.next->paths, (const unsigned char*) args.paths[i], strlen (args.paths[i]) + 1);
+    }
+
+    snapshot_finish (args.next);
+
+    find_deletions (&deletions, &names, &groups, args.previous, args.next);
+
+    // a directory holding deleted paths that is not among the paths, such as the current directory, is written first to carry them
+
+    for (const snapshot_deleted_group * group = groups.region.begin; group < groups.region.end; group++)
+    {
+	const char * parent = names.region.begin + group->parent_begin;
+
+	if (!tar_snapshot_find (args.next, parent) && !write_directory (args.sink, args.buffer, parent, group, &names, args.owners, args.pax))
+	{
+	    log_fatal ("Failed to write deleted paths");
+	}
+    }
+
+    for (size_t i = 0; i < args.count; i++)
+    {
+	if (skip[i])
+	{
+	    continue;
+	}
+
+	const snapshot_deleted_group * group = directory[i] ? find_group (&groups, &names, args.paths[i]) : NULL;
+
+	if (group
+	    ? !write_directory (args.sink, args.buffer, args.paths[i], group, &names, args.owners, args.pax)
+	    : !tar_write_sink_path (.sink = args.sink,
+				    .buffer = args.buffer,
+				    .path = args.paths[i],
+				    .owners = args.owners,
+				    .pax = args.pax,
+				    .hardlinks = args.hardlinks))
+	{
+	    log_fatal ("Failed to write %s", args.paths[i]);
+	}
+    }
+
+    free (skip);
+    free (directory);
+    window_clear (deletions);
+    window_clear (names);
+    window_clear (groups);
+
+    return true;
+
+fail:
+    free (skip);
+    free (directory);
+    window_clear (deletions);
+    window_clear (names);
+    window_clear (groups);
+    return false;
+}
+
+void tar_snapshot_clear (tar_snapshot * snapshot)
+{
+    window_clear (snapshot->entries);
+    window_clear (snapshot->paths);
+}
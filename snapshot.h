@@ -0,0 +1,93 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "../convert/sink.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "owner.h"
+#include "hardlink.h"
+#endif
+
+/**
+   @file tar/snapshot.h
+   Describes listed-incremental archiving, in which a snapshot of the paths written to one tar is kept so that the next tar need only hold what has changed since.
+   To make an incremental tar, load the snapshot left by the previous run with tar_snapshot_load, or start from a zeroed snapshot for a full backup, and give it to tar_write_sink_incremental along with the paths to be archived. Paths whose device, inode, modification time and size match the snapshot are left out, and paths in the snapshot that are no longer present are recorded as deleted on the header of the directory that held them. The new snapshot filled in by tar_write_sink_incremental should then be saved with tar_snapshot_save for the next run.
+*/
+
+typedef struct tar_snapshot_entry tar_snapshot_entry;
+struct tar_snapshot_entry {
+    unsigned long long dev; ///< The device holding this path
+    unsigned long long ino; ///< The inode of this path
+    long long mtime_sec; ///< The modification time of this path, in epoch seconds
+    unsigned long mtime_nsec; ///< The sub-second part of the modification time, in nanoseconds
+    unsigned long long size; ///< The size of this path
+    size_t path_begin; ///< The offset of this path within the snapshot's path pool
+    const char * path; ///< The resolved path, valid once the snapshot has been finished or loaded
+};
+/**< @struct tar_snapshot_entry
+   Describes a single path recorded in a snapshot
+*/
+
+range_typedef(tar_snapshot_entry, tar_snapshot_entry);
+window_typedef(tar_snapshot_entry, tar_snapshot_entry);
+
+typedef struct tar_snapshot tar_snapshot;
+struct tar_snapshot {
+    window_tar_snapshot_entry entries; ///< The recorded paths, sorted by path
+    window_char paths; ///< A pool of null terminated paths
+};
+/**< @struct tar_snapshot
+   A record of the state of each path written to an incremental tar. It should be zeroed before use.
+*/
+
+bool tar_snapshot_save (convert_sink * sink, const tar_snapshot * snapshot);
+/**<
+   @brief Writes the given snapshot to a sink in a compact binary format that can be read by tar_snapshot_load
+   @return True if successful, false otherwise
+*/
+
+bool tar_snapshot_load (tar_snapshot * snapshot, convert_source * source);
+/**<
+   @brief Reads a snapshot that was written by tar_snapshot_save, replacing the contents of the given snapshot
+   @return True if successful, false otherwise
+*/
+
+const tar_snapshot_entry * tar_snapshot_find (const tar_snapshot * snapshot, const char * path);
+/**<
+   @brief Finds a path in a snapshot
+   @return The entry for the path, or NULL if it is not present in the snapshot
+*/
+
+keyargs_declare(bool,tar_write_sink_incremental,
+		convert_sink * sink;
+		window_unsigned_char * buffer;
+		const char * const * paths;
+		size_t count;
+		const tar_snapshot * previous;
+		tar_snapshot * next;
+		tar_owner_cache * owners;
+		bool pax;
+		tar_hardlink_table * hardlinks;);
+#define tar_write_sink_incremental(...) keyargs_call(tar_write_sink_incremental, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that writes the given paths to a sink as an incremental tar against a previous snapshot. Each path is examined with lstat, and a file or symlink whose device, inode, modification time and size all match its entry in previous is left out. Directories are always written, so that extraction recreates them with their permissions. Every path in previous that is not among the given paths is recorded as deleted, as described for tar_write_header, on the nearest directory above it that is still present. Only the topmost deleted paths are recorded, as extraction removes everything beneath them. A directory that carries deletions but is not among the given paths, such as the current directory for a deleted path with no directory, is written before any other member. Readers that do not know the record see only the directory, so other tar programs restore an incremental tar without removing anything. The tar is not terminated, so that more members may follow before tar_write_sink_end.
+   @return True if successful, false otherwise
+   @param sink The sink to write the tar to
+   @param buffer A buffer used to hold headers and file contents on their way to the sink
+   @param paths The paths to archive, which are also the names they are given in the tar. A directory is written alone, without its contents, so a tree should be listed in full.
+   @param count The number of paths
+   @param previous The snapshot of the previous run. If it is empty, every path is written.
+   @param next A snapshot that is filled with the state of each path as it was examined, replacing its contents, to be saved for the next run. A path that changes while it is being written is recorded as it was before, so that it is written again by the next run.
+   @param owners An optional cache for user and group names, as in tar_write_header
+   @param pax If true, headers are written in pax format as in tar_write_stat_header
+   @param hardlinks An optional table of inodes that have been written, as in tar_write_stat_header
+*/
+
+void tar_snapshot_clear (tar_snapshot * snapshot);
+/**<
+   @brief Frees all memory allocated to the given snapshot, but not the snapshot itself.
+*/
@@ -0,0 +1,54 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/source.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../read.h"
+#include "../write.h"
+#include "../append.h"
+
+int main(int argc, char * argv[])
+{
+    // append <tar> <directory> <paths...>
+
+    assert (argc >= 4);
+
+    int fd = open (argv[1], O_RDWR | O_CREAT, 0644);
+    assert (fd >= 0);
+    assert (0 == chdir (argv[2]));
+
+    unsigned long long end;
+    assert (tar_append_seek (&end, fd));
+    log_normal ("appending at offset %llu", end);
+
+    window_unsigned_char buffer = {0};
+    fd_sink output = fd_sink_init(.fd = fd);
+
+    for (int i = 3; i < argc; i++)
+    {
+	assert (tar_write_sink_path (.sink = &output.sink, .buffer = &buffer, .path = argv[i]));
+    }
+
+    assert (tar_write_sink_end (&output.sink));
+
+    window_clear (buffer);
+    close (fd);
+
+    return 0;
+}
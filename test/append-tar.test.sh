@@ -0,0 +1,26 @@
+#!/bin/sh
+
+dir="$(mktemp -d)"
+archive="$(mktemp)"
+
+printf 'first' > "$dir/first"
+printf 'second' > "$dir/second"
+printf 'third' > "$dir/third"
+mkdir "$dir/directory"
+printf 'fourth' > "$dir/directory/fourth"
+
+# an empty file is an empty tar
+
+$DEBUG_PROGRAM test/append-tar "$archive" "$dir" first
+$DEBUG_PROGRAM test/append-tar "$archive" "$dir" second directory directory/fourth
+tar -tf "$archive"
+tar -xOf "$archive" second && echo
+
+# tar pads its output to a whole record, so the new members land well before the end of the file
+
+tar -C "$dir" -cf "$archive" first
+$DEBUG_PROGRAM test/append-tar "$archive" "$dir" third
+tar -tf "$archive"
+tar -xOf "$archive" third && echo
+
+rm -rf "$dir" "$archive"
@@ -0,0 +1,93 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../write.h"
+#include "../read.h"
+#include "../internal/spec.h"
+
+static void set_checksum (unsigned char * block, bool is_signed)
+{
+    // the sum is taken with the checksum field read as spaces, and some historical writers summed the bytes as signed chars
+
+    struct posix_header * header = (void*) block;
+    memset (header->chksum, ' ', sizeof(header->chksum));
+
+    long long sum = 0;
+
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+    {
+	sum += is_signed ? (signed char) block[i] : block[i];
+    }
+
+    snprintf (header->chksum, sizeof(header->chksum), "%07llo", sum);
+}
+
+static void check (const char * label, const unsigned char * block)
+{
+    const char * mode_names[] = { "default", "strict", "none" };
+    const tar_checksum_mode modes[] = { TAR_CHECKSUM_DEFAULT, TAR_CHECKSUM_STRICT, TAR_CHECKSUM_NONE };
+
+    for (size_t i = 0; i < sizeof(modes) / sizeof(*modes); i++)
+    {
+	tar_state state = { .checksum = modes[i] };
+	range_const_unsigned_char mem = { .begin = block, .end = block + TAR_BLOCK_SIZE };
+
+	bool accepted = tar_update_mem (&state, &mem) && state.ready && state.type == TAR_FILE;
+
+	log_normal ("%s: %s %s", label, mode_names[i], accepted ? "accepts" : "rejects");
+
+	tar_cleanup (&state);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    // a byte above 0x7f in the name makes the signed sum differ from the unsigned one
+
+    window_unsigned_char output = {0};
+
+    assert (tar_write_header (.output = &output,
+			      .name = "caf\xc3\xa9",
+			      .mode = 0644,
+			      .type = TAR_FILE,
+			      .pax = true));
+
+    assert (range_count (output.region) == TAR_BLOCK_SIZE);
+
+    unsigned char block[TAR_BLOCK_SIZE];
+    struct posix_header * header = (void*) block;
+
+    memcpy (block, output.region.begin, TAR_BLOCK_SIZE);
+    check ("valid", block);
+
+    set_checksum (block, true);
+    check ("signed sum", block);
+
+    memcpy (block, output.region.begin, TAR_BLOCK_SIZE);
+    memcpy (header->magic, "notar", sizeof(header->magic) - 1);
+    set_checksum (block, false);
+    check ("bad magic", block);
+
+    memcpy (block, output.region.begin, TAR_BLOCK_SIZE);
+    header->name[0] = 'C';
+    check ("corrupt checksum", block);
+
+    window_clear (output);
+
+    return 0;
+}
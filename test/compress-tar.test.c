@@ -0,0 +1,154 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <zstd.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/duplex.h"
+#include "../../convert/fd/source.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../read.h"
+#include "../index.h"
+#include "../gz.h"
+#include "../zst.h"
+
+static void list (convert_source * source)
+{
+    tar_state state = { .source = source };
+
+    while (tar_update (&state))
+    {
+	if (state.type == TAR_FILE)
+	{
+	    log_normal ("file: %s (%llu bytes)", state.path.region.begin, (unsigned long long) state.file.size);
+	    assert (tar_skip_file (&state));
+	}
+	else
+	{
+	    log_normal ("item: %s", state.path.region.begin);
+	}
+    }
+
+    assert (state.type == TAR_END);
+
+    tar_cleanup (&state);
+}
+
+static void seek (int fd)
+{
+    tar_zst_seek_table table = {0};
+    assert (tar_zst_seek_table_load (&table, fd));
+
+    window_unsigned_char buffer = {0};
+    tar_index index = {0};
+
+    {
+	tar_zst_seekable_source source = tar_zst_seekable_source_init(.fd = fd, .table = &table, .contents = &buffer);
+	tar_state state = { .source = &source.source };
+	assert (tar_index_build (&index, &state));
+	tar_cleanup (&state);
+    }
+
+    // read each member starting from the frame that holds its header, in reverse so that no frame is reused by accident
+    
+    for (size_t i = range_count (index.entries.region); i > 0; i--)
+    {
+	tar_index_entry * entry = index.entries.region.begin + i - 1;
+	window_rewrite (buffer);
+	
+	tar_zst_seekable_source source = tar_zst_seekable_source_init(.fd = fd, .table = &table, .contents = &buffer, .offset = entry->header_offset);
+	tar_state state = { .source = &source.source, .offset.position = entry->header_offset };
+
+	assert (tar_update (&state));
+	assert (!strcmp (state.path.region.begin, entry->name));
+	assert (state.offset.header == entry->header_offset);
+	
+	log_normal ("seek: %s (frame %zu)", state.path.region.begin, tar_zst_seek_table_find (&table, entry->header_offset));
+
+	tar_cleanup (&state);
+    }
+
+    tar_index_clear (&index);
+    window_clear (buffer);
+    tar_zst_seek_table_clear (&table);
+}
+
+int main(int argc, char * argv[])
+{
+    assert (argc == 3);
+
+    bool zst = !strcmp (argv[1], "zst");
+    bool zst_seekable = !strcmp (argv[1], "zst-seekable");
+    bool zst_parallel = zst_seekable || !strcmp (argv[1], "zst-parallel");
+    bool compress = !strcmp (argv[2], "compress");
+
+    if (!strcmp (argv[2], "seek"))
+    {
+	seek (STDIN_FILENO);
+	return 0;
+    }
+
+    window_unsigned_char input_buffer = {0};
+    fd_source input = fd_source_init(.fd = STDIN_FILENO, .contents = &input_buffer);
+
+    if (compress)
+    {
+	fd_sink output = fd_sink_init(.fd = STDOUT_FILENO);
+
+	if (zst_parallel)
+	{
+	    tar_zst_parallel_sink sink = tar_zst_parallel_sink_init(.output = &output.sink, .level = 3, .threads = 2, .block_size = 1024, .max_blocks = 3, .seekable = zst_seekable);
+	    assert (convert_join (&sink.sink, &input.source));
+	    assert (tar_zst_parallel_sink_finish (&sink));
+	    convert_sink_clear (&sink.sink);
+	}
+	else if (zst)
+	{
+	    tar_zst_sink sink = tar_zst_sink_init(.output = &output.sink, .level = 3);
+	    assert (convert_join (&sink.sink, &input.source));
+	    assert (tar_zst_sink_finish (&sink));
+	    convert_sink_clear (&sink.sink);
+	}
+	else
+	{
+	    tar_gz_sink sink = tar_gz_sink_init(.output = &output.sink, .level = 6);
+	    assert (convert_join (&sink.sink, &input.source));
+	    assert (tar_gz_sink_finish (&sink));
+	    convert_sink_clear (&sink.sink);
+	}
+    }
+    else
+    {
+	window_unsigned_char buffer = {0};
+
+	if (zst || zst_parallel)
+	{
+	    tar_zst_source source = tar_zst_source_init(.input = &input.source, .contents = &buffer);
+	    list (&source.source);
+	    convert_source_clear (&source.source);
+	}
+	else
+	{
+	    tar_gz_source source = tar_gz_source_init(.input = &input.source, .contents = &buffer);
+	    list (&source.source);
+	    convert_source_clear (&source.source);
+	}
+
+	window_clear (buffer);
+    }
+
+    window_clear (input_buffer);
+
+    return 0;
+}
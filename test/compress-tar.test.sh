@@ -0,0 +1,17 @@
+#!/bin/sh
+
+gen_tar() {
+    tar -c --to-stdout --sort=name src/tar/test/tar-contents # unfortunately, this depends on gnu tar for sorting by name
+}
+
+gen_tar | gzip | $DEBUG_PROGRAM test/compress-tar gz list
+gen_tar | zstd | $DEBUG_PROGRAM test/compress-tar zst list
+gen_tar | $DEBUG_PROGRAM test/compress-tar gz compress | gzip -d | tar -tf -
+gen_tar | $DEBUG_PROGRAM test/compress-tar zst compress | zstd -d | tar -tf -
+gen_tar | $DEBUG_PROGRAM test/compress-tar zst-parallel compress | $DEBUG_PROGRAM test/compress-tar zst-parallel list
+
+seekable=$(mktemp)
+gen_tar | $DEBUG_PROGRAM test/compress-tar zst-seekable compress > "$seekable"
+zstd -d < "$seekable" | tar -tf -
+$DEBUG_PROGRAM test/compress-tar zst-seekable seek < "$seekable"
+rm -f "$seekable"
@@ -0,0 +1,116 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../write.h"
+#include "../create.h"
+
+static void read_all (window_unsigned_char * output, FILE * file)
+{
+    rewind (file);
+
+    size_t size;
+
+    do {
+	unsigned char * chunk = window_grow_bytes (output, 4096);
+	size = fread (chunk, 1, 4096, file);
+	output->region.end -= 4096 - size;
+    }
+    while (size);
+}
+
+static void write_paths (window_unsigned_char * output, int argc, char * argv[], bool pax, unsigned int threads, size_t max_buffered_bytes)
+{
+    FILE * file = tmpfile();
+    assert (file);
+
+    window_unsigned_char buffer = {0};
+    tar_hardlink_table hardlinks = {0};
+    tar_owner_cache owners = { .numeric = true };
+    fd_sink sink = fd_sink_init(.fd = fileno (file));
+
+    if (threads)
+    {
+	assert (tar_write_sink_paths (.sink = &sink.sink,
+				      .buffer = &buffer,
+				      .paths = (const char * const *) argv,
+				      .count = argc,
+				      .threads = threads,
+				      .max_buffered_bytes = max_buffered_bytes,
+				      .owners = &owners,
+				      .pax = pax,
+				      .hardlinks = &hardlinks));
+    }
+    else
+    {
+	for (int i = 0; i < argc; i++)
+	{
+	    assert (tar_write_sink_path (.sink = &sink.sink,
+					 .buffer = &buffer,
+					 .path = argv[i],
+					 .owners = &owners,
+					 .pax = pax,
+					 .hardlinks = &hardlinks));
+	}
+    }
+
+    assert (tar_write_sink_end (&sink.sink));
+
+    window_rewrite (*output);
+    read_all (output, file);
+
+    fclose (file);
+    window_clear (buffer);
+    tar_hardlink_table_clear (&hardlinks);
+}
+
+int main(int argc, char * argv[])
+{
+    // create-tar <paths...>, which compares the output of the pipeline with writing each path in turn
+
+    assert (argc >= 2);
+
+    const unsigned int threads[] = { 1, 2, 8 };
+    const size_t max_buffered_bytes[] = { 0, 1000, 50000 };
+
+    window_unsigned_char expect = {0};
+    window_unsigned_char result = {0};
+
+    for (int pax = 0; pax < 2; pax++)
+    {
+	write_paths (&expect, argc - 1, argv + 1, pax, 0, 0);
+
+	for (size_t i = 0; i < sizeof(threads) / sizeof(*threads); i++)
+	{
+	    for (size_t j = 0; j < sizeof(max_buffered_bytes) / sizeof(*max_buffered_bytes); j++)
+	    {
+		write_paths (&result, argc - 1, argv + 1, pax, threads[i], max_buffered_bytes[j]);
+
+		bool identical = range_count (result.region) == range_count (expect.region)
+		    && !memcmp (result.region.begin, expect.region.begin, range_count (expect.region));
+
+		log_normal ("%s, %u threads, %zu buffered bytes: %s", pax ? "pax" : "gnu", threads[i], max_buffered_bytes[j], identical ? "identical" : "differs");
+	    }
+	}
+    }
+
+    window_clear (expect);
+    window_clear (result);
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/fd/source.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../read.h"
+#include "../extract.h"
+
+int main(int argc, char * argv[])
+{
+    // extract-tar <directory> <threads>, reading the tar from stdin
+
+    assert (argc == 3);
+
+    window_unsigned_char buffer = {0};
+    fd_source input = fd_source_init(.fd = STDIN_FILENO, .contents = &buffer);
+    tar_state state = { .source = &input.source };
+
+    if (tar_extract (.state = &state, .directory = argv[1], .threads = atoi (argv[2])))
+    {
+	log_normal ("extracted");
+    }
+    else
+    {
+	log_normal ("failed");
+    }
+
+    tar_cleanup (&state);
+    window_clear (buffer);
+
+    return 0;
+}
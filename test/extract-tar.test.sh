@@ -0,0 +1,112 @@
+#!/bin/sh
+
+dir="$(mktemp -d)"
+
+list() {
+    (cd "$dir" && find destination outside | sort)
+}
+
+reset() {
+    rm -rf "$dir/destination" "$dir/outside"
+    mkdir "$dir/destination" "$dir/outside"
+}
+
+mkdir "$dir/source"
+ln -s "$dir/outside" "$dir/source/evil"
+ln -s ../outside "$dir/source/climb"
+printf 'pwned' > "$dir/source/pwned"
+mkdir -p "$dir/tree/evil"
+printf 'pwned' > "$dir/tree/evil/pwned"
+
+# a symlink out of the destination, followed by a member beneath it
+
+echo "absolute symlink:"
+reset
+tar -C "$dir/source" --transform 's,^pwned$,evil/pwned,' -cf - evil pwned | $DEBUG_PROGRAM test/extract-tar "$dir/destination" 4
+list
+
+echo "climbing symlink:"
+reset
+tar -C "$dir/source" --transform 's,^pwned$,climb/pwned,' -cf - climb pwned | $DEBUG_PROGRAM test/extract-tar "$dir/destination" 4
+list
+
+# a symlink that was already in the destination is not followed either
+
+echo "existing symlink:"
+reset
+ln -s ../outside "$dir/destination/evil"
+tar -C "$dir/source" --transform 's,^pwned$,evil/pwned,' -cf - pwned | $DEBUG_PROGRAM test/extract-tar "$dir/destination" 4
+list
+
+# a directory replaces a symlink in its place, rather than being merged into its target
+
+echo "existing symlink replaced by a directory:"
+reset
+ln -s ../outside "$dir/destination/evil"
+tar -C "$dir/tree" -cf - evil | $DEBUG_PROGRAM test/extract-tar "$dir/destination" 4
+list
+
+# appended archives give several items the same path, and the last of them must win however the writers are scheduled
+
+mkdir -p "$dir/first" "$dir/second" "$dir/symlink" "$dir/directory/a"
+printf 'first' > "$dir/first/a"
+printf 'second' > "$dir/second/a"
+ln -s target "$dir/symlink/a"
+printf 'inner' > "$dir/directory/a/inner"
+
+describe() {
+    if [ -L "$dir/destination/a" ]
+    then
+	echo "symlink to $(readlink "$dir/destination/a")"
+    elif [ -d "$dir/destination/a" ]
+    then
+	echo "directory holding $(cat "$dir/destination/a/inner")"
+    else
+	echo "file holding $(cat "$dir/destination/a")"
+    fi
+}
+
+for order in "first second" "first symlink" "symlink second" "symlink directory" "first directory"
+do
+    rm -f "$dir/appended.tar"
+
+    for source in $order
+    do
+	tar -C "$dir/$source" -rf "$dir/appended.tar" a
+    done
+
+    echo "$order:"
+
+    for attempt in 1 2 3 4 5 6 7 8 9 10
+    do
+	reset
+	$DEBUG_PROGRAM test/extract-tar "$dir/destination" 4 < "$dir/appended.tar" > /dev/null
+	describe
+    done | sort | uniq -c
+done
+
+# archives written by GNU tar in each format, where a hardlink must follow its target and a sparse file keeps its holes
+
+mkdir "$dir/links"
+printf 'linked' > "$dir/links/data"
+ln "$dir/links/data" "$dir/links/link"
+printf 'start' | dd of="$dir/links/sparse" bs=1 seek=1048576 conv=notrunc 2> /dev/null
+printf 'end' | dd of="$dir/links/sparse" bs=1 seek=4194300 conv=notrunc 2> /dev/null
+
+for format in "--format=gnu" "--format=pax --pax-option=delete=atime,delete=ctime" "--format=pax --pax-option=delete=atime,delete=ctime --sparse-version=0.0" "--format=pax --pax-option=delete=atime,delete=ctime --sparse-version=0.1"
+do
+    echo "$format:"
+    reset
+    tar -C "$dir/links" $format --sparse -cf - data link sparse | $DEBUG_PROGRAM test/extract-tar "$dir/destination" 4
+
+    [ "$dir/destination/data" -ef "$dir/destination/link" ] && echo "hardlinked"
+
+    for name in data link sparse
+    do
+	cmp "$dir/links/$name" "$dir/destination/$name" && echo "$name matches"
+    done
+
+    [ "$(du -k "$dir/destination/sparse" | cut -f 1)" -lt 1024 ] && echo "sparse has holes"
+done
+
+rm -rf "$dir"
@@ -0,0 +1,100 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/source.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../read.h"
+#include "../write.h"
+
+static void list (convert_source * source)
+{
+    tar_state state = { .source = source };
+
+    while (tar_update (&state))
+    {
+	switch (state.type)
+	{
+	case TAR_FILE:
+	    log_normal ("file: %s (%zu bytes)", state.path.region.begin, state.file.size);
+	    assert (tar_skip_file (&state));
+	    break;
+
+	case TAR_DIR:
+	    log_normal ("directory: %s", state.path.region.begin);
+	    break;
+
+	case TAR_HARDLINK:
+	    log_normal ("hardlink: %s -> %s", state.path.region.begin, state.link.path.region.begin);
+	    break;
+
+	default:
+	    log_fatal ("Bad type for this test");
+	}
+    }
+
+    assert (state.type == TAR_END);
+
+fail:
+    tar_cleanup (&state);
+}
+
+int main(int argc, char * argv[])
+{
+    assert (argc >= 3);
+    assert (0 == chdir (argv[2]));
+
+    if (!strcmp (argv[1], "read"))
+    {
+	window_unsigned_char buffer = {0};
+	fd_source input = fd_source_init(.fd = STDIN_FILENO, .contents = &buffer);
+	list (&input.source);
+	window_clear (buffer);
+    }
+    else
+    {
+	assert (argc >= 4);
+
+	// the stats mode writes a deduplicated tar to /dev/null and prints the statistics of its table
+	
+	bool stats = !strcmp (argv[1], "stats");
+	bool pax = !strcmp (argv[3], "pax");
+	window_unsigned_char buffer = {0};
+	int output_fd = stats ? open ("/dev/null", O_WRONLY) : STDOUT_FILENO;
+	fd_sink output = fd_sink_init(.fd = output_fd);
+	tar_hardlink_table hardlinks = { .dedupe = stats || !strcmp (argv[3], "dedupe") };
+
+	for (int i = 4; i < argc; i++)
+	{
+	    assert (tar_write_sink_path (.sink = &output.sink, .buffer = &buffer, .path = argv[i], .pax = pax, .hardlinks = &hardlinks));
+	}
+
+	assert (tar_write_sink_end (&output.sink));
+
+	if (stats)
+	{
+	    log_normal ("hashed %zu files (%llu bytes), %zu duplicates (%llu bytes)", hardlinks.stats.hashed_files, hardlinks.stats.hashed_bytes, hardlinks.stats.duplicates, hardlinks.stats.saved_bytes);
+	    close (output_fd);
+	}
+	
+	tar_hardlink_table_clear (&hardlinks);
+	window_clear (buffer);
+    }
+
+    return 0;
+}
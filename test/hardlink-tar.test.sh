@@ -0,0 +1,38 @@
+#!/bin/sh
+
+dir="$(mktemp -d)"
+extracted="$(mktemp -d)"
+long="a-directory-name-that-is-long-enough/to-push-the-link-target/past-the-one-hundred-bytes/of-a-ustar-header"
+
+mkdir -p "$dir/$long"
+printf 'shared' > "$dir/first"
+ln "$dir/first" "$dir/second"
+ln "$dir/first" "$dir/$long/third"
+printf 'alone' > "$dir/single"
+printf 'deep' > "$dir/$long/deep"
+ln "$dir/$long/deep" "$dir/shallow"
+
+for format in gnu pax
+do
+    $DEBUG_PROGRAM test/hardlink-tar write "$dir" $format first second single "$long/third" "$long/deep" shallow | $DEBUG_PROGRAM test/hardlink-tar read "$dir"
+    $DEBUG_PROGRAM test/hardlink-tar write "$dir" $format first second single "$long/third" "$long/deep" shallow | tar -C "$extracted" -xf -
+    [ "$extracted/first" -ef "$extracted/second" ] && [ "$extracted/first" -ef "$extracted/$long/third" ] && [ "$extracted/$long/deep" -ef "$extracted/shallow" ] && [ ! "$extracted/first" -ef "$extracted/single" ] && echo "$format: extracted by tar"
+    rm -rf "$extracted"/*
+done
+
+printf 'identical contents' > "$dir/copy-1"
+printf 'identical contents' > "$dir/copy-2"
+printf 'identical contents' > "$dir/$long/copy-3"
+printf 'different contents' > "$dir/other"
+printf 'identical contents' > "$dir/private"
+chmod 600 "$dir/private" # a copy with a different mode keeps its own contents
+
+$DEBUG_PROGRAM test/hardlink-tar write "$dir" dedupe copy-1 first copy-2 second other private "$long/copy-3" | $DEBUG_PROGRAM test/hardlink-tar read "$dir"
+$DEBUG_PROGRAM test/hardlink-tar write "$dir" dedupe copy-1 first copy-2 second other private "$long/copy-3" | tar -C "$extracted" -xf -
+[ "$extracted/copy-1" -ef "$extracted/copy-2" ] && [ "$extracted/copy-1" -ef "$extracted/$long/copy-3" ] && [ ! "$extracted/copy-1" -ef "$extracted/other" ] && cmp "$dir/other" "$extracted/other" && echo "dedupe: extracted by tar"
+$DEBUG_PROGRAM test/hardlink-tar stats "$dir" gnu copy-1 first copy-2 second other private "$long/copy-3"
+
+tar -C "$dir" --format=gnu -cf - first second single "$long/third" "$long/deep" shallow | $DEBUG_PROGRAM test/hardlink-tar read "$dir"
+tar -C "$dir" --format=pax -cf - first second single "$long/third" "$long/deep" shallow | $DEBUG_PROGRAM test/hardlink-tar read "$dir"
+
+rm -rf "$dir" "$extracted"
@@ -0,0 +1,155 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/source.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../read.h"
+#include "../index.h"
+#include "../catalog.h"
+
+static void print_member (tar_state * state, int fd, const tar_index * index, const char * name)
+{
+    const tar_index_entry * entry = tar_index_find (index, name);
+    
+    if (!entry)
+    {
+	log_normal ("missing: %s", name);
+	return;
+    }
+
+    window_unsigned_char contents = {0};
+
+    assert (tar_index_seek (state, fd, entry));
+
+    if (state->type == TAR_HARDLINK || state->type == TAR_SYMLINK)
+    {
+	log_normal ("member: %s -> %s", state->path.region.begin, state->link.path.region.begin);
+	return;
+    }
+
+    assert (tar_read_file_whole (&contents, state));
+    
+    log_normal ("member: %s", state->path.region.begin);
+
+    if (state->sparse.is_sparse)
+    {
+	// the contents of a sparse file are its extents placed end to end, and each extent is padded with zeros to a filesystem block
+	
+	log_normal ("\tsparse(%llu):", state->sparse.size);
+
+	const unsigned char * extent_contents = contents.region.begin;
+
+	for (const tar_sparse_extent * extent = state->sparse.map.region.begin; extent < state->sparse.map.region.end; extent++)
+	{
+	    log_normal ("\t\t%llu+%llu: [%s]", extent->offset, extent->size, (const char*) extent_contents);
+	    extent_contents += extent->size;
+	}
+    }
+    else
+    {
+	log_normal ("\tcontents(%zu): [%.*s]", range_count (contents.region), (int)range_count (contents.region), contents.region.begin);
+    }
+
+    window_clear (contents);
+}
+
+int main(int argc, char * argv[])
+{
+    // index-tar <tar> <index> <members to read...>
+
+    assert (argc >= 3);
+    
+    int tar_fd = open (argv[1], O_RDONLY);
+    int index_fd = open (argv[2], O_RDWR | O_TRUNC);
+
+    assert (tar_fd >= 0);
+    assert (index_fd >= 0);
+    
+    window_unsigned_char buffer = {0};
+    fd_source tar_read = fd_source_init(.fd = tar_fd, .contents = &buffer);
+    tar_state state = { .source = &tar_read.source, .seek = { .enabled = true, .fd = tar_fd } };
+
+    tar_index built = {0};
+
+    assert (tar_index_build (&built, &state));
+
+    fd_sink index_write = fd_sink_init(.fd = index_fd);
+    assert (tar_index_save (&index_write.sink, &built));
+    tar_index_clear (&built);
+
+    assert (0 == lseek (index_fd, 0, SEEK_SET));
+    
+    window_unsigned_char index_buffer = {0};
+    fd_source index_read = fd_source_init(.fd = index_fd, .contents = &index_buffer);
+    tar_index loaded = {0};
+
+    assert (tar_index_load (&loaded, &index_read.source));
+
+    for (const tar_index_entry * entry = loaded.entries.region.begin; entry < loaded.entries.region.end; entry++)
+    {
+	if (*entry->link)
+	{
+	    log_normal ("%s -> %s: type %d, header %llu", entry->name, entry->link, entry->type, entry->header_offset);
+	}
+	else
+	{
+	    log_normal ("%s: type %d, header %llu, data %llu, size %llu", entry->name, entry->type, entry->header_offset, entry->data_offset, entry->size);
+	}
+    }
+
+    for (int i = 3; i < argc; i++)
+    {
+	print_member (&state, tar_fd, &loaded, argv[i]);
+    }
+
+    assert (0 == lseek (tar_fd, 0, SEEK_SET));
+    window_rewrite (buffer);
+    tar_restart (&state);
+
+    tar_catalog catalog = {0};
+    window_char path = {0};
+    window_char link = {0};
+
+    assert (tar_catalog_build (&catalog, &state));
+
+    for (size_t i = 0; i < tar_catalog_count (&catalog); i++)
+    {
+	tar_catalog_path (&path, &catalog, i);
+
+	if (tar_catalog_link (&link, &catalog, i))
+	{
+	    log_normal ("catalog: %s -> %s: type %d, header %llu", path.region.begin, link.region.begin, catalog.type.region.begin[i], catalog.header_offset.region.begin[i]);
+	}
+	else
+	{
+	    log_normal ("catalog: %s: type %d, header %llu, data %llu, size %llu", path.region.begin, catalog.type.region.begin[i], catalog.header_offset.region.begin[i], catalog.data_offset.region.begin[i], catalog.size.region.begin[i]);
+	}
+    }
+
+    log_normal ("catalog: %zu members, %zu path components", tar_catalog_count (&catalog), (size_t) range_count (catalog.nodes.region));
+
+    tar_catalog_clear (&catalog);
+    window_clear (path);
+    window_clear (link);
+    tar_index_clear (&loaded);
+    tar_cleanup (&state);
+    window_clear (buffer);
+    window_clear (index_buffer);
+    close (tar_fd);
+    close (index_fd);
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+tar_file="$(mktemp)"
+index_file="$(mktemp)"
+
+tar -c --to-stdout --sort=name src/tar/test/tar-contents > "$tar_file" # unfortunately, this depends on gnu tar for sorting by name
+$DEBUG_PROGRAM test/index-tar "$tar_file" "$index_file" src/tar/test/tar-contents/bcle src/tar/test/tar-contents/asdf src/tar/test/tar-contents/nonexistent src/tar/test/tar-contents/a.lnk
+
+# link targets and sparse maps are kept in the index, so that seeking restores them
+
+dir="$(mktemp -d)"
+
+truncate -s 1M "$dir/holes"
+printf 'hello' | dd of="$dir/holes" bs=4096 seek=24 conv=notrunc 2>/dev/null
+printf 'world' | dd of="$dir/holes" bs=4096 seek=200 conv=notrunc 2>/dev/null
+printf 'first' > "$dir/first"
+ln "$dir/first" "$dir/second"
+
+# the pax archive is kept free of timestamps that would change its size
+
+for options in --format=gnu "--format=pax --pax-option=delete=atime,delete=ctime"
+do
+    tar -C "$dir" --sparse --mtime=@0 $options -cf "$tar_file" first holes second
+    echo "$options:"
+    $DEBUG_PROGRAM test/index-tar "$tar_file" "$index_file" holes second
+done
+
+rm -rf "$tar_file" "$index_file" "$dir"
@@ -0,0 +1,51 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../convert/source.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../read.h"
+#include "../mmap.h"
+#include "../internal/spec.h"
+
+int main(int argc, char * argv[])
+{
+    // mmap-tar <tar>
+
+    assert (argc == 2);
+
+    tar_mmap map = {0};
+
+    assert (tar_mmap_open (&map, argv[1]));
+
+    while (tar_mmap_update (&map))
+    {
+	const struct posix_header * header = (const void*) map.header.begin;
+	range_const_unsigned_char contents;
+
+	// the header block is checked against the item's own typeflag, so that an extension block in its place shows
+
+	log_normal ("%s: header at %zu with typeflag '%c', data at %llu",
+		    map.state.path.region.begin,
+		    (size_t) (map.header.begin - map.file.begin),
+		    header->typeflag,
+		    map.state.offset.data);
+
+	if (tar_mmap_contents (&contents, &map))
+	{
+	    size_t size = range_count (contents);
+	    log_normal ("    %zu bytes, starting with '%.*s'", size, (int) (size < 5 ? size : 5), (const char*) contents.begin);
+	}
+    }
+
+    assert (map.state.type == TAR_END);
+
+    tar_mmap_close (&map);
+
+    return 0;
+}
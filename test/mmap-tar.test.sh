@@ -0,0 +1,28 @@
+#!/bin/sh
+
+dir="$(mktemp -d)"
+archive="$(mktemp)"
+
+truncate -s 1M "$dir/holes"
+
+for offset in 0 100000 300000 500000 700000 900000 # more extents than fit in a GNU sparse header, so an extension block follows it
+do
+    printf 'hello' | dd of="$dir/holes" bs=1 seek=$offset conv=notrunc 2>/dev/null
+done
+
+printf 'dense' > "$dir/dense"
+
+# the pax archives are kept free of timestamps that would change their size
+
+tar -C "$dir" --sparse --format=gnu --mtime=@0 -cf "$archive" dense holes
+echo "gnu:"
+$DEBUG_PROGRAM test/mmap-tar "$archive"
+
+for version in 0.1 1.0
+do
+    tar -C "$dir" --sparse --format=pax --pax-option=delete=atime,delete=ctime --sparse-version=$version --mtime=@0 -cf "$archive" dense holes
+    echo "pax $version:"
+    $DEBUG_PROGRAM test/mmap-tar "$archive"
+done
+
+rm -rf "$dir" "$archive"
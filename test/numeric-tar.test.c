@@ -0,0 +1,141 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../write.h"
+#include "../read.h"
+#include "../internal/spec.h"
+
+static void print_item (const char * label, const window_unsigned_char * output, tar_checksum_mode checksum)
+{
+    tar_state state = { .checksum = checksum };
+    range_const_unsigned_char mem = output->region.const_cast;
+
+    while (tar_update_mem (&state, &mem) && !state.ready)
+    {
+    }
+
+    if (state.type == TAR_FILE)
+    {
+	log_normal ("%s: size %llu uid %llu gid %llu mtime %lld", label, (unsigned long long) state.file.size, state.uid, state.gid, state.mtime.sec);
+    }
+    else
+    {
+	log_normal ("%s: rejected", label);
+    }
+
+    tar_cleanup (&state);
+}
+
+static void print_encoding (const char * label, const char * field, size_t size)
+{
+    if (field[0] & 0x80)
+    {
+	log_normal ("\t%s: base-256", label);
+    }
+    else
+    {
+	log_normal ("\t%s: octal %.*s", label, (int) size, field);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    // each value is one past the largest that its octal field holds
+
+    const unsigned long long size = 8ULL << 30;
+    const int id = 1 << 21;
+    const unsigned long long mtime = 1ULL << 33;
+
+    tar_owner_cache owners = { .numeric = true };
+    window_unsigned_char output = {0};
+
+    for (int pax = 0; pax < 2; pax++)
+    {
+	window_rewrite (output);
+	assert (tar_write_header (.output = &output,
+				  .name = "large",
+				  .mode = 0644,
+				  .uid = id,
+				  .gid = id,
+				  .size = size,
+				  .mtime = mtime,
+				  .type = TAR_FILE,
+				  .owners = &owners,
+				  .pax = pax));
+
+	const struct posix_header * header = (const struct posix_header*) (output.region.end - TAR_BLOCK_SIZE);
+
+	print_item (pax ? "pax" : "gnu", &output, TAR_CHECKSUM_STRICT);
+
+	// with pax the ustar fields are left at their largest octal value, as the pax records hold the real ones
+
+	print_encoding ("size", header->size, sizeof(header->size));
+	print_encoding ("uid", header->uid, sizeof(header->uid));
+	print_encoding ("gid", header->gid, sizeof(header->gid));
+	print_encoding ("mtime", header->mtime, sizeof(header->mtime));
+    }
+
+    // a time before the epoch can only be given by a pax record, as a negative base-256 field is not decoded
+
+    const char records[] = "12 mtime=-1\n";
+
+    window_rewrite (output);
+    assert (tar_write_header (.output = &output,
+			      .name = "././@PaxHeader",
+			      .size = sizeof(records) - 1,
+			      .type = TAR_PAX,
+			      .owners = &owners,
+			      .pax = true));
+    window_append_bytes (&output, (const unsigned char*) records, sizeof(records) - 1);
+    tar_write_padding (&output, sizeof(records) - 1);
+    assert (tar_write_header (.output = &output,
+			      .name = "old",
+			      .mode = 0644,
+			      .type = TAR_FILE,
+			      .owners = &owners,
+			      .pax = true));
+
+    print_item ("negative pax mtime", &output, TAR_CHECKSUM_STRICT);
+
+    window_rewrite (output);
+    assert (tar_write_header (.output = &output,
+			      .name = "old",
+			      .mode = 0644,
+			      .type = TAR_FILE,
+			      .owners = &owners));
+
+    struct posix_header * header = (struct posix_header*) output.region.begin;
+    memset (header->mtime, 0xff, sizeof(header->mtime));
+    memset (header->chksum, ' ', sizeof(header->chksum));
+
+    unsigned int checksum = 0;
+
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+    {
+	checksum += output.region.begin[i];
+    }
+
+    snprintf (header->chksum, sizeof(header->chksum), "%07o", checksum);
+
+    print_item ("negative base-256 mtime", &output, TAR_CHECKSUM_DEFAULT);
+    print_item ("negative base-256 mtime, strict", &output, TAR_CHECKSUM_STRICT);
+
+    window_clear (output);
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../write.h"
+#include "../internal/spec.h"
+
+static void print_owner (const char * label, window_unsigned_char * output)
+{
+    // the header of the item itself is the last block written, after any extended headers
+
+    assert (range_count (output->region) >= TAR_BLOCK_SIZE);
+
+    const struct posix_header * header = (const struct posix_header*) (output->region.end - TAR_BLOCK_SIZE);
+
+    log_normal ("%s: uname '%.*s' gname '%.*s'",
+		label,
+		(int) sizeof(header->uname), header->uname,
+		(int) sizeof(header->gname), header->gname);
+}
+
+int main(int argc, char * argv[])
+{
+    // ids that are unlikely to have names give headers with empty names, which shows any name read from freed memory
+
+    const unsigned int first_id = 70000;
+    const int id_count = 18;
+
+    tar_owner_cache owners = {0};
+    window_unsigned_char output = {0};
+
+    for (int i = 0; i < id_count; i++)
+    {
+	window_rewrite (output);
+	assert (tar_write_header (.output = &output,
+				  .name = "short",
+				  .mode = 0644,
+				  .uid = first_id + i,
+				  .gid = first_id + i,
+				  .type = TAR_FILE,
+				  .owners = &owners));
+    }
+
+    print_owner ("short name", &output);
+
+    // the extended headers written for a long name look up id 0, which grows the full cache
+
+    char long_name[151];
+    memset (long_name, 'a', sizeof(long_name) - 1);
+    long_name[sizeof(long_name) - 1] = '\0';
+
+    window_rewrite (output);
+    assert (tar_write_header (.output = &output,
+			      .name = long_name,
+			      .mode = 0644,
+			      .uid = first_id,
+			      .gid = first_id,
+			      .type = TAR_FILE,
+			      .owners = &owners));
+
+    print_owner ("long name", &output);
+
+    window_rewrite (output);
+    assert (tar_write_header (.output = &output,
+			      .name = long_name,
+			      .mode = 0644,
+			      .uid = first_id,
+			      .gid = first_id,
+			      .type = TAR_FILE,
+			      .owners = &owners,
+			      .pax = true));
+
+    print_owner ("long pax name", &output);
+
+    tar_owner_cache_clear (&owners);
+
+    // a name that is not found is remembered once however often it is given, and an empty name is never looked up
+
+    owners = (tar_owner_cache){0};
+
+    const char * unames[] = { "tar-test-no-such-user", "", "tar-test-no-such-user", "" };
+
+    for (size_t i = 0; i < sizeof(unames) / sizeof(*unames); i++)
+    {
+	window_rewrite (output);
+	assert (tar_write_header (.output = &output,
+				  .name = "short",
+				  .mode = 0644,
+				  .uid = first_id,
+				  .gid = first_id,
+				  .type = TAR_FILE,
+				  .uname = unames[i],
+				  .gname = unames[i],
+				  .owners = &owners));
+    }
+
+    print_owner ("unknown names", &output);
+    log_normal ("cached users %zu groups %zu", (size_t) range_count (owners.users.region), (size_t) range_count (owners.groups.region));
+
+    window_clear (output);
+    tar_owner_cache_clear (&owners);
+
+    return 0;
+}
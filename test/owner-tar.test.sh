@@ -0,0 +1,3 @@
+#!/bin/sh
+
+$DEBUG_PROGRAM test/owner-tar
@@ -0,0 +1,211 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../convert/source.h"
+#include "../../convert/fd/source.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../read.h"
+#include "../push.h"
+
+static void print_status (tar_push * push, window_unsigned_char * contents, tar_push_status status)
+{
+    switch (status)
+    {
+    case TAR_PUSH_ITEM:
+	window_rewrite (*contents);
+	
+	switch (push->state.type)
+	{
+	case TAR_FILE:
+	    if (!push->contents_remaining)
+	    {
+		log_normal ("file: %s", push->state.path.region.begin);
+		log_normal ("\tcontents(0): []");
+	    }
+	    break;
+
+	case TAR_DIR:
+	    log_normal ("directory: %s", push->state.path.region.begin);
+	    break;
+
+	case TAR_SYMLINK:
+	    log_normal ("symlink: %s -> %s", push->state.path.region.begin, push->state.link.path.region.begin);
+	    break;
+
+	default:
+	    log_normal ("item of type %d: %s", push->state.type, push->state.path.region.begin);
+	    break;
+	}
+	break;
+
+    case TAR_PUSH_DATA:
+	window_append_bytes (contents, push->data.begin, range_count (push->data));
+
+	if (!push->contents_remaining)
+	{
+	    log_normal ("file: %s", push->state.path.region.begin);
+	    log_normal ("\tcontents(%zu): [%.*s]", range_count (contents->region), (int) range_count (contents->region), contents->region.begin);
+	}
+	break;
+
+    case TAR_PUSH_END:
+	log_normal ("end after %llu bytes", push->state.offset.position);
+	break;
+
+    case TAR_PUSH_ERROR:
+	log_normal ("error after %llu bytes", push->state.offset.position);
+	break;
+
+    case TAR_PUSH_NEED:
+	break;
+    }
+}
+
+static void push_chunks (const range_const_unsigned_char * tar, size_t chunk_size)
+{
+    // each chunk is copied into a buffer of its own that is scribbled over once it has been consumed, as an event loop would reuse its read buffer
+
+    tar_push push = {0};
+    window_unsigned_char contents = {0};
+    unsigned char * chunk = malloc (chunk_size);
+    const unsigned char * next = tar->begin;
+    tar_push_status status = TAR_PUSH_NEED;
+
+    while (status != TAR_PUSH_END && status != TAR_PUSH_ERROR && next < tar->end)
+    {
+	size_t size = range_count (*tar) - (next - tar->begin);
+	size = size < chunk_size ? size : chunk_size;
+	memcpy (chunk, next, size);
+	next += size;
+	
+	range_const_unsigned_char input = { .begin = chunk, .end = chunk + size };
+
+	while ((status = tar_push_update (&push, &input)) != TAR_PUSH_NEED)
+	{
+	    print_status (&push, &contents, status);
+
+	    if (status == TAR_PUSH_END || status == TAR_PUSH_ERROR)
+	    {
+		break;
+	    }
+	}
+
+	assert (status != TAR_PUSH_NEED || range_is_empty (input));
+	memset (chunk, 0xff, size);
+    }
+
+    tar_push_cleanup (&push);
+    window_clear (contents);
+    free (chunk);
+}
+
+static void push_exact (const range_const_unsigned_char * tar)
+{
+    // the parser is given exactly the number of bytes it asks for, and must consume all of them without asking for more than the tar holds
+
+    tar_push push = {0};
+    range_const_unsigned_char input = { .begin = tar->begin, .end = tar->begin };
+    tar_push_status status;
+    size_t needs = 0;
+
+    while ((status = tar_push_update (&push, &input)) != TAR_PUSH_END && status != TAR_PUSH_ERROR)
+    {
+	if (status == TAR_PUSH_NEED)
+	{
+	    assert (range_is_empty (input));
+	    assert (push.need <= (unsigned long long) (tar->end - input.end));
+	    input.end += push.need;
+	    needs++;
+	}
+    }
+
+    log_normal ("%s after %zu requests for input", status == TAR_PUSH_END ? "end" : "error", needs);
+
+    tar_push_cleanup (&push);
+}
+
+static void push_corrupt (const range_const_unsigned_char * tar)
+{
+    // the corrupt stream fails alone, and the other stream is parsed to its end
+
+    unsigned char * copy = malloc (range_count (*tar));
+    memcpy (copy, tar->begin, range_count (*tar));
+    copy[0] ^= 0x20;
+
+    tar_push good = {0};
+    tar_push bad = {0};
+    size_t offset = 0;
+    bool failed = false;
+
+    while (good.status != TAR_PUSH_END && offset < (size_t) range_count (*tar))
+    {
+	range_const_unsigned_char good_input = { .begin = tar->begin + offset, .end = tar->begin + offset + 1 };
+	range_const_unsigned_char bad_input = { .begin = copy + offset, .end = copy + offset + 1 };
+	tar_push_status status;
+	
+	while ((status = tar_push_update (&bad, &bad_input)) != TAR_PUSH_NEED && status != TAR_PUSH_ERROR)
+	{
+	}
+
+	if (status == TAR_PUSH_ERROR && !failed)
+	{
+	    log_normal ("bad stream: error after %llu bytes", bad.state.offset.position);
+	    failed = true;
+	}
+	
+	while ((status = tar_push_update (&good, &good_input)) != TAR_PUSH_NEED && status != TAR_PUSH_END)
+	{
+	}
+
+	offset++;
+    }
+
+    assert (bad.status == TAR_PUSH_ERROR);
+    log_normal ("good stream: end after %llu bytes", good.state.offset.position);
+
+    tar_push_cleanup (&good);
+    tar_push_cleanup (&bad);
+    free (copy);
+}
+
+int main(int argc, char * argv[])
+{
+    assert (argc == 2);
+
+    window_unsigned_char buffer = {0};
+    fd_source input = fd_source_init(.fd = STDIN_FILENO, .contents = &buffer);
+    bool error = false;
+
+    while (convert_fill (&error, &input.source))
+    {
+    }
+
+    assert (!error);
+
+    range_const_unsigned_char tar = buffer.region.const_cast;
+
+    if (!strcmp (argv[1], "exact"))
+    {
+	push_exact (&tar);
+    }
+    else if (!strcmp (argv[1], "corrupt"))
+    {
+	push_corrupt (&tar);
+    }
+    else
+    {
+	push_chunks (&tar, atoi (argv[1]));
+    }
+
+    window_clear (buffer);
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+
+long="a-directory-name-that-is-long-enough-to-need-a-longname-header-in-the-gnu-format-and-a-path-record-in-pax"
+
+gen_tar() {
+    tar -c --to-stdout --sort=name --mtime=@0 --transform "s,subdir,$long,S" $options src/tar/test/tar-contents # unfortunately, this depends on gnu tar for sorting by name
+}
+
+# the pax archive is kept free of timestamps that would change its size
+
+for options in --format=gnu "--format=pax --pax-option=delete=atime,delete=ctime"
+do
+    echo "$options:"
+    gen_tar | $DEBUG_PROGRAM test/push-tar 100000 > push-tar-whole
+    for chunk_size in 1 7 512 1000
+    do
+	gen_tar | $DEBUG_PROGRAM test/push-tar $chunk_size | cmp - push-tar-whole
+    done
+    cat push-tar-whole
+    gen_tar | $DEBUG_PROGRAM test/push-tar exact
+    gen_tar | $DEBUG_PROGRAM test/push-tar corrupt
+done
+
+rm -f push-tar-whole
@@ -0,0 +1,130 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/source.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../read.h"
+#include "../write.h"
+#include "../extract.h"
+#include "../snapshot.h"
+
+static void list (convert_source * source)
+{
+    tar_state state = { .source = source };
+
+    while (tar_update (&state))
+    {
+	switch (state.type)
+	{
+	case TAR_FILE:
+	    log_normal ("file: %s (%zu bytes)", state.path.region.begin, state.file.size);
+	    assert (tar_skip_file (&state));
+	    break;
+
+	case TAR_DIR:
+	    log_normal ("directory: %s", state.path.region.begin);
+
+	    for (const char * name = state.deleted.region.begin; name < state.deleted.region.end; name += strlen (name) + 1)
+	    {
+		log_normal ("\tdeleted: %s", name);
+	    }
+	    break;
+
+	case TAR_SYMLINK:
+	    log_normal ("symlink: %s -> %s", state.path.region.begin, state.link.path.region.begin);
+	    break;
+
+	default:
+	    log_fatal ("Bad type for this test");
+	}
+    }
+
+    assert (state.type == TAR_END);
+
+fail:
+    tar_cleanup (&state);
+}
+
+int main(int argc, char * argv[])
+{
+    assert (argc >= 2);
+
+    window_unsigned_char buffer = {0};
+
+    if (!strcmp (argv[1], "read"))
+    {
+	fd_source input = fd_source_init(.fd = STDIN_FILENO, .contents = &buffer);
+	list (&input.source);
+    }
+    else if (!strcmp (argv[1], "extract"))
+    {
+	assert (argc == 3);
+	
+	fd_source input = fd_source_init(.fd = STDIN_FILENO, .contents = &buffer);
+	tar_state state = { .source = &input.source };
+	assert (tar_extract (.state = &state, .directory = argv[2], .threads = 2));
+	tar_cleanup (&state);
+    }
+    else
+    {
+	// write <directory> <previous snapshot, or - for none> <next snapshot> <paths...>
+
+	assert (argc >= 5);
+
+	tar_snapshot previous = {0};
+	tar_snapshot next = {0};
+
+	if (strcmp (argv[3], "-"))
+	{
+	    window_unsigned_char snapshot_buffer = {0};
+	    int fd = open (argv[3], O_RDONLY);
+	    assert (fd >= 0);
+	    fd_source snapshot_read = fd_source_init(.fd = fd, .contents = &snapshot_buffer);
+	    assert (tar_snapshot_load (&previous, &snapshot_read.source));
+	    window_clear (snapshot_buffer);
+	    close (fd);
+	}
+
+	int next_fd = open (argv[4], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	assert (next_fd >= 0);
+	assert (0 == chdir (argv[2]));
+
+	fd_sink output = fd_sink_init(.fd = STDOUT_FILENO);
+
+	assert (tar_write_sink_incremental (.sink = &output.sink,
+					    .buffer = &buffer,
+					    .paths = (const char * const *) argv + 5,
+					    .count = argc - 5,
+					    .previous = &previous,
+					    .next = &next));
+	
+	assert (tar_write_sink_end (&output.sink));
+
+	fd_sink snapshot_write = fd_sink_init(.fd = next_fd);
+	assert (tar_snapshot_save (&snapshot_write.sink, &next));
+	close (next_fd);
+
+	tar_snapshot_clear (&previous);
+	tar_snapshot_clear (&next);
+    }
+
+    window_clear (buffer);
+
+    return 0;
+}
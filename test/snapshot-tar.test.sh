@@ -0,0 +1,43 @@
+#!/bin/sh
+
+dir="$(mktemp -d)"
+extracted="$(mktemp -d)"
+restored="$(mktemp -d)"
+first="$(mktemp)"
+second="$(mktemp)"
+
+mkdir -p "$dir/kept" "$dir/removed/nested"
+printf 'unchanged' > "$dir/kept/unchanged"
+printf 'changed' > "$dir/kept/changed"
+printf 'gone' > "$dir/kept/gone"
+printf 'nested' > "$dir/removed/nested/file"
+ln -s unchanged "$dir/kept/link"
+
+echo "full:"
+$DEBUG_PROGRAM test/snapshot-tar write "$dir" - "$first" kept kept/changed kept/gone kept/link kept/unchanged removed removed/nested removed/nested/file > "$dir-full.tar"
+$DEBUG_PROGRAM test/snapshot-tar read < "$dir-full.tar"
+$DEBUG_PROGRAM test/snapshot-tar extract "$extracted" < "$dir-full.tar"
+
+# the changed file keeps its size, and is caught by its modification time
+
+printf 'CHANGED' > "$dir/kept/changed"
+touch -d '2001-01-01' "$dir/kept/changed"
+printf 'new' > "$dir/kept/new"
+rm "$dir/kept/gone"
+rm -r "$dir/removed"
+
+echo "incremental:"
+$DEBUG_PROGRAM test/snapshot-tar write "$dir" "$first" "$second" kept kept/changed kept/link kept/new kept/unchanged > "$dir.tar"
+$DEBUG_PROGRAM test/snapshot-tar read < "$dir.tar"
+$DEBUG_PROGRAM test/snapshot-tar extract "$extracted" < "$dir.tar"
+diff -r --no-dereference "$dir" "$extracted" && echo "extracted incremental matches"
+
+# other readers see only the directories that carry the deletions, so restoring with them leaves the deleted paths in place
+
+echo "restored by tar:"
+tar -xf "$dir-full.tar" -C "$restored" && tar --warning=no-unknown-keyword -xf "$dir.tar" -C "$restored" && (cd "$restored" && find . | sort)
+
+echo "unchanged:"
+$DEBUG_PROGRAM test/snapshot-tar write "$dir" "$second" "$first" kept kept/changed kept/link kept/new kept/unchanged | $DEBUG_PROGRAM test/snapshot-tar read
+
+rm -rf "$dir" "$dir.tar" "$dir-full.tar" "$extracted" "$restored" "$first" "$second"
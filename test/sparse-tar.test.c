@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/source.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../read.h"
+#include "../write.h"
+
+static void read_file (window_unsigned_char * output, const char * path)
+{
+    FILE * file = fopen (path, "rb");
+    assert (file);
+
+    size_t size;
+
+    do
+    {
+	size = fread (window_grow_bytes (output, 4096), 1, 4096, file);
+	output->region.end -= 4096 - size;
+    }
+    while (size);
+
+    fclose (file);
+}
+
+static void compare (convert_source * source)
+{
+    // each file in the tar is expanded with its holes and compared to the file of the same name in the working directory
+    
+    tar_state state = { .source = source };
+    window_unsigned_char stored = {0};
+    window_unsigned_char expanded = {0};
+    window_unsigned_char original = {0};
+
+    while (tar_update (&state))
+    {
+	assert (state.type == TAR_FILE);
+
+	window_rewrite (stored);
+	window_rewrite (expanded);
+	window_rewrite (original);
+	
+	assert (tar_read_file_whole (&stored, &state));
+
+	if (state.sparse.is_sparse)
+	{
+	    memset (window_grow_bytes (&expanded, state.sparse.size), 0, state.sparse.size);
+
+	    const unsigned char * data = stored.region.begin;
+
+	    for (const tar_sparse_extent * extent = state.sparse.map.region.begin; extent < state.sparse.map.region.end; extent++)
+	    {
+		memcpy (expanded.region.begin + extent->offset, data, extent->size);
+		data += extent->size;
+	    }
+
+	    assert (data == stored.region.end);
+	}
+	else
+	{
+	    window_append_bytes (&expanded, stored.region.begin, range_count (stored.region));
+	}
+
+	read_file (&original, state.path.region.begin);
+
+	bool matches = range_count (original.region) == range_count (expanded.region)
+	    && !memcmp (original.region.begin, expanded.region.begin, range_count (original.region));
+
+	log_normal ("%s: %zu bytes, %s, %s", state.path.region.begin, (size_t) range_count (expanded.region), state.sparse.is_sparse ? "sparse" : "dense", matches ? "matches" : "differs");
+    }
+
+    assert (state.type == TAR_END);
+
+    tar_cleanup (&state);
+    window_clear (stored);
+    window_clear (expanded);
+    window_clear (original);
+}
+
+int main(int argc, char * argv[])
+{
+    assert (argc >= 3);
+    assert (0 == chdir (argv[2]));
+
+    if (!strcmp (argv[1], "read"))
+    {
+	window_unsigned_char buffer = {0};
+	fd_source input = fd_source_init(.fd = STDIN_FILENO, .contents = &buffer);
+	compare (&input.source);
+	window_clear (buffer);
+    }
+    else
+    {
+	assert (argc >= 4);
+	
+	bool pax = !strcmp (argv[3], "pax");
+	window_unsigned_char buffer = {0};
+	fd_sink output = fd_sink_init(.fd = STDOUT_FILENO);
+
+	for (int i = 4; i < argc; i++)
+	{
+	    assert (tar_write_sink_path (.sink = &output.sink, .buffer = &buffer, .path = argv[i], .pax = pax, .sparse = true));
+	}
+
+	assert (tar_write_sink_end (&output.sink));
+	window_clear (buffer);
+    }
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#!/bin/sh
+
+dir="$(mktemp -d)"
+extracted="$(mktemp -d)"
+
+truncate -s 1M "$dir/holes"
+
+for offset in 0 100000 300000 500000 700000 900000 # more extents than fit in a GNU sparse header
+do
+    printf 'hello' | dd of="$dir/holes" bs=1 seek=$offset conv=notrunc 2>/dev/null
+done
+
+truncate -s 64K "$dir/empty"
+printf 'data' > "$dir/dense"
+
+for format in gnu pax
+do
+    $DEBUG_PROGRAM test/sparse-tar write "$dir" $format holes empty dense | $DEBUG_PROGRAM test/sparse-tar read "$dir"
+    $DEBUG_PROGRAM test/sparse-tar write "$dir" $format holes empty dense | tar -C "$extracted" -xf -
+    cmp "$dir/holes" "$extracted/holes" && cmp "$dir/empty" "$extracted/empty" && cmp "$dir/dense" "$extracted/dense" && echo "$format: extracted by tar"
+done
+
+tar -C "$dir" --sparse --format=gnu -cf - holes empty dense | $DEBUG_PROGRAM test/sparse-tar read "$dir"
+
+for version in 0.0 0.1 1.0
+do
+    tar -C "$dir" --sparse --format=pax --sparse-version=$version -cf - holes empty dense | $DEBUG_PROGRAM test/sparse-tar read "$dir"
+done
+
+rm -rf "$dir" "$extracted"
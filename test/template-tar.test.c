@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../write.h"
+
+static void compare (const tar_header_template * template, const char * name, tar_type type, bool pax)
+{
+    window_unsigned_char expect = {0};
+    window_unsigned_char result = {0};
+
+    assert (tar_write_header (.output = &expect,
+			      .name = name,
+			      .mode = template->mode,
+			      .uid = template->uid,
+			      .gid = template->gid,
+			      .size = type == TAR_FILE ? 1234 : 0,
+			      .mtime = 1700000000,
+			      .type = type,
+			      .uname = template->uname,
+			      .gname = template->gname,
+			      .pax = pax));
+
+    assert (tar_write_template_header (.output = &result,
+				       .template = template,
+				       .name = name,
+				       .size = type == TAR_FILE ? 1234 : 0,
+				       .mtime = 1700000000,
+				       .type = type));
+
+    bool same = range_count (expect.region) == range_count (result.region)
+	&& !memcmp (expect.region.begin, result.region.begin, range_count (expect.region));
+
+    size_t name_size = strlen (name);
+
+    log_normal ("%s %s of %zu characters%s: %zu blocks, %s",
+		pax ? "pax" : "ustar",
+		type == TAR_DIR ? "directory" : "file",
+		name_size,
+		name[name_size - 1] == '/' ? " ending in a separator" : "",
+		(size_t) range_count (expect.region) / TAR_BLOCK_SIZE,
+		same ? "identical" : "different");
+
+    window_clear (expect);
+    window_clear (result);
+}
+
+int main(int argc, char * argv[])
+{
+    // names around the 100 byte ustar name field, where the terminating null and a directory's added separator decide whether a long name header is needed
+
+    char name[104];
+
+    for (int pax = 0; pax < 2; pax++)
+    {
+	tar_header_template template;
+
+	assert (tar_header_template_init (.template = &template,
+					  .mode = 0755,
+					  .uid = 1000,
+					  .gid = 1000,
+					  .uname = "user",
+					  .gname = "group",
+					  .pax = pax));
+
+	for (size_t size = 97; size <= 101; size++)
+	{
+	    memset (name, 'a', size);
+	    name[size] = '\0';
+
+	    compare (&template, name, TAR_FILE, pax);
+	    compare (&template, name, TAR_DIR, pax);
+
+	    name[size - 1] = '/';
+	    compare (&template, name, TAR_DIR, pax);
+	}
+    }
+
+    return 0;
+}
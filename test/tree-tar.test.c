@@ -0,0 +1,105 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/source.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../read.h"
+#include "../write.h"
+#include "../tree.h"
+
+static void list (convert_source * source)
+{
+    tar_state state = { .source = source };
+
+    while (tar_update (&state))
+    {
+	switch (state.type)
+	{
+	case TAR_FILE:
+	    log_normal ("file: %s (%zu bytes)", state.path.region.begin, state.file.size);
+	    assert (tar_skip_file (&state));
+	    break;
+
+	case TAR_DIR:
+	    log_normal ("directory: %s", state.path.region.begin);
+	    break;
+
+	case TAR_SYMLINK:
+	    log_normal ("symlink: %s -> %s", state.path.region.begin, state.link.path.region.begin);
+	    break;
+
+	case TAR_HARDLINK:
+	    log_normal ("hardlink: %s -> %s", state.path.region.begin, state.link.path.region.begin);
+	    break;
+
+	default:
+	    log_fatal ("Bad type for this test");
+	}
+    }
+
+    assert (state.type == TAR_END);
+
+fail:
+    tar_cleanup (&state);
+}
+
+int main(int argc, char * argv[])
+{
+    assert (argc >= 2);
+
+    if (!strcmp (argv[1], "read"))
+    {
+	window_unsigned_char buffer = {0};
+	fd_source input = fd_source_init(.fd = STDIN_FILENO, .contents = &buffer);
+	list (&input.source);
+	window_clear (buffer);
+    }
+    else
+    {
+	// write <directory> <name> <threads> [exclude patterns...]
+	
+	assert (argc >= 5);
+
+	window_unsigned_char buffer = {0};
+	fd_sink output = fd_sink_init(.fd = STDOUT_FILENO);
+	tar_hardlink_table hardlinks = {0};
+
+	// a tree with parts that cannot be read is still written, and the failure shows in the exit status
+	
+	bool success = tar_write_sink_tree (.sink = &output.sink,
+					    .buffer = &buffer,
+					    .path = argv[2],
+					    .override_name = argv[3],
+					    .threads = atoi (argv[4]),
+					    .exclude = (const char * const *) argv + 5,
+					    .exclude_count = argc - 5,
+					    .hardlinks = &hardlinks);
+	
+	assert (tar_write_sink_end (&output.sink));
+
+	tar_hardlink_table_clear (&hardlinks);
+	window_clear (buffer);
+
+	if (!success)
+	{
+	    return 1;
+	}
+    }
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+
+dir="$(mktemp -d)"
+extracted="$(mktemp -d)"
+
+mkdir -p "$dir/b/nested/deeper" "$dir/a/build/objects" "$dir/a/source" "$dir/c"
+printf 'main' > "$dir/a/source/main.c"
+printf 'object' > "$dir/a/source/main.o"
+printf 'cached' > "$dir/a/build/objects/main.o"
+printf 'deep' > "$dir/b/nested/deeper/file"
+printf 'first' > "$dir/b/first"
+ln "$dir/b/first" "$dir/c/linked"
+ln -s ../b/first "$dir/c/symlink"
+mkfifo "$dir/c/fifo" # left out, as it is not a file, directory or symlink
+
+for threads in 1 4
+do
+    echo "$threads threads:"
+    $DEBUG_PROGRAM test/tree-tar write "$dir" tree $threads build '*.o' | $DEBUG_PROGRAM test/tree-tar read
+done
+
+$DEBUG_PROGRAM test/tree-tar write "$dir" tree 4 | tar -C "$extracted" -xf -
+diff -r --no-dereference -x fifo "$dir" "$extracted/tree" && [ "$extracted/tree/b/first" -ef "$extracted/tree/c/linked" ] && echo "extracted by tar"
+
+# a directory that cannot be read is left out with what is beneath it, and the rest is written
+# root reads it whatever its mode, so it gives up its capabilities in a user namespace
+
+if [ "$(id -u)" = 0 ]
+then
+    as_owner="unshare -U"
+fi
+
+chmod 000 "$dir/b/nested"
+
+for threads in 1 4
+do
+    echo "$threads threads, unreadable directory:"
+    $as_owner $DEBUG_PROGRAM test/tree-tar write "$dir" tree $threads 2> "$dir.stderr" | $DEBUG_PROGRAM test/tree-tar read
+    sed "s,$dir,DIR,g" "$dir.stderr"
+done
+
+chmod 755 "$dir/b/nested"
+
+rm -rf "$dir" "$extracted" "$dir.stderr"
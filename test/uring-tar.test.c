@@ -0,0 +1,140 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define FLAT_INCLUDES
+#include "../../range/def.h"
+#include "../../window/def.h"
+#include "../../window/alloc.h"
+#include "../../keyargs/keyargs.h"
+#include "../../convert/source.h"
+#include "../../convert/sink.h"
+#include "../../convert/fd/sink.h"
+#include "../../log/log.h"
+#include "../common.h"
+#include "../owner.h"
+#include "../hardlink.h"
+#include "../write.h"
+#include "../uring.h"
+
+static bool uring_available (void)
+{
+    // the library falls back to tar_write_sink_path when io_uring is missing, so there would be nothing to compare
+
+    struct io_uring_params params = {0};
+    int fd = syscall (__NR_io_uring_setup, 4, &params);
+
+    if (fd < 0)
+    {
+	assert (errno == ENOSYS || errno == EPERM);
+	return false;
+    }
+
+    close (fd);
+    return true;
+}
+
+static void read_all (window_unsigned_char * output, FILE * file)
+{
+    rewind (file);
+
+    size_t size;
+
+    do {
+	unsigned char * chunk = window_grow_bytes (output, 4096);
+	size = fread (chunk, 1, 4096, file);
+	output->region.end -= 4096 - size;
+    }
+    while (size);
+}
+
+static void write_paths (window_unsigned_char * output, int argc, char * argv[], unsigned int depth, size_t max_buffered_bytes)
+{
+    FILE * file = tmpfile();
+    assert (file);
+
+    window_unsigned_char buffer = {0};
+    tar_hardlink_table hardlinks = {0};
+    tar_owner_cache owners = { .numeric = true };
+    fd_sink sink = fd_sink_init(.fd = fileno (file));
+
+    if (depth)
+    {
+	assert (tar_write_sink_paths_uring (.sink = &sink.sink,
+					    .buffer = &buffer,
+					    .paths = (const char * const *) argv,
+					    .count = argc,
+					    .depth = depth,
+					    .max_buffered_bytes = max_buffered_bytes,
+					    .owners = &owners,
+					    .pax = true,
+					    .hardlinks = &hardlinks));
+    }
+    else
+    {
+	for (int i = 0; i < argc; i++)
+	{
+	    assert (tar_write_sink_path (.sink = &sink.sink,
+					 .buffer = &buffer,
+					 .path = argv[i],
+					 .owners = &owners,
+					 .pax = true,
+					 .hardlinks = &hardlinks));
+	}
+    }
+
+    assert (tar_write_sink_end (&sink.sink));
+
+    window_rewrite (*output);
+    read_all (output, file);
+
+    fclose (file);
+    window_clear (buffer);
+    tar_hardlink_table_clear (&hardlinks);
+}
+
+int main(int argc, char * argv[])
+{
+    // uring-tar <paths...>, which prints nothing unless the io_uring output differs from writing each path in turn
+
+    assert (argc >= 2);
+
+    if (!uring_available())
+    {
+	return 0;
+    }
+
+    const struct { unsigned int depth; size_t max_buffered_bytes; } configs[] = {
+	{ 1, 0 },
+	{ 4, 0 },
+	{ 64, 0 },
+	{ 4, 1000 },
+    };
+
+    window_unsigned_char expect = {0};
+    window_unsigned_char result = {0};
+
+    write_paths (&expect, argc - 1, argv + 1, 0, 0);
+
+    for (size_t i = 0; i < sizeof(configs) / sizeof(*configs); i++)
+    {
+	write_paths (&result, argc - 1, argv + 1, configs[i].depth, configs[i].max_buffered_bytes);
+
+	if (range_count (result.region) != range_count (expect.region)
+	    || memcmp (result.region.begin, expect.region.begin, range_count (expect.region)))
+	{
+	    log_normal ("depth %u with %zu buffered bytes differs", configs[i].depth, configs[i].max_buffered_bytes);
+	}
+    }
+
+    window_clear (expect);
+    window_clear (result);
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/sh
+
+dir="$(mktemp -d)"
+
+mkdir "$dir/directory"
+: > "$dir/empty"
+head -c 100000 /dev/zero | tr '\0' 'x' > "$dir/large"
+ln "$dir/large" "$dir/hardlink"
+ln -s large "$dir/symlink"
+
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+    printf 'file %s' "$i" > "$dir/directory/$i"
+done
+
+$DEBUG_PROGRAM test/uring-tar "$dir/directory" "$dir"/directory/* "$dir/empty" "$dir/large" "$dir/hardlink" "$dir/symlink"
+
+rm -rf "$dir"
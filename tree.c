@@ -0,0 +1,613 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../window/printf.h"
+#include "../keyargs/keyargs.h"
+#include "../convert/sink.h"
+#include "common.h"
+#include "owner.h"
+#include "hardlink.h"
+#include "create.h"
+#include "tree.h"
+#include "../log/log.h"
+
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+#define PATH_SEPARATOR '/'
+
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct tree_dir tree_dir;
+
+typedef struct tree_entry tree_entry;
+struct tree_entry
+{
+    const char * name;
+    bool is_dir;
+    tree_dir * dir; ///< The contents of this entry if it is a directory, once they have been read, or null if it could not be read
+};
+
+struct tree_dir
+{
+    tree_entry * entries;
+    size_t count;
+    char * names;
+};
+
+typedef struct tree_task tree_task;
+struct tree_task
+{
+    char * path;
+    tree_dir ** result;
+};
+
+range_typedef(tree_task, tree_task);
+window_typedef(tree_task, tree_task);
+
+typedef struct tree_deque tree_deque;
+struct tree_deque
+{
+    pthread_mutex_t mutex;
+    window_tree_task tasks; ///< The owner takes tasks from the end, and other threads steal them from head
+    size_t head;
+};
+
+typedef struct tree_walker tree_walker;
+struct tree_walker
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    size_t pending; ///< The number of tasks that have been queued but not finished
+    size_t pushes; ///< The number of tasks queued so far, so that an idle thread can tell whether it missed one
+    bool error; ///< Set if the walk could not go on, in which case nothing is written
+    bool incomplete; ///< Set if a directory or entry could not be read and was left out
+    tree_deque * deques;
+    unsigned int deque_count;
+    size_t root_size;
+    const char * const * exclude;
+    size_t exclude_count;
+};
+
+typedef struct tree_worker tree_worker;
+struct tree_worker
+{
+    tree_walker * walker;
+    unsigned int index;
+    pthread_t thread;
+};
+
+typedef struct tree_found tree_found;
+struct tree_found
+{
+    size_t name_begin;
+    bool is_dir;
+};
+
+range_typedef(tree_found, tree_found);
+window_typedef(tree_found, tree_found);
+range_typedef(size_t, tree_offset);
+window_typedef(size_t, tree_offset);
+
+static void push_task (tree_walker * walker, unsigned int index, char * path, tree_dir ** result)
+{
+    tree_deque * deque = walker->deques + index;
+
+    pthread_mutex_lock (&deque->mutex);
+    *window_push (deque->tasks) = (tree_task){ .path = path, .result = result };
+    pthread_mutex_unlock (&deque->mutex);
+
+    pthread_mutex_lock (&walker->mutex);
+    walker->pending++;
+    walker->pushes++;
+    pthread_cond_signal (&walker->changed);
+    pthread_mutex_unlock (&walker->mutex);
+}
+
+static bool take_task (tree_task * task, tree_walker * walker, unsigned int index)
+{
+    // a thread works depth first through its own queue, and steals the oldest, and so usually largest, subtrees from the others
+
+    for (unsigned int i = 0; i < walker->deque_count; i++)
+    {
+	tree_deque * deque = walker->deques + (index + i) % walker->deque_count;
+	bool found = false;
+
+	pthread_mutex_lock (&deque->mutex);
+
+	if ((size_t) range_count (deque->tasks.region) > deque->head)
+	{
+	    *task = i ? deque->tasks.region.begin[deque->head++] : *--deque->tasks.region.end;
+	    found = true;
+
+	    if ((size_t) range_count (deque->tasks.region) == deque->head)
+	    {
+		window_rewrite (deque->tasks);
+		deque->head = 0;
+	    }
+	}
+
+	pthread_mutex_unlock (&deque->mutex);
+
+	if (found)
+	{
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+static bool is_excluded (const tree_walker * walker, const char * relative_path, const char * name)
+{
+    for (size_t i = 0; i < walker->exclude_count; i++)
+    {
+	if (!fnmatch (walker->exclude[i], name, 0) || !fnmatch (walker->exclude[i], relative_path, 0))
+	{
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+static int compare_entries (const void * a, const void * b)
+{
+    return strcmp (((const tree_entry*) a)->name, ((const tree_entry*) b)->name);
+}
+
+static char * join_path (const char * directory, const char * name)
+{
+    size_t directory_size = strlen (directory);
+    size_t name_size = strlen (name);
+    bool add_sep = directory_size && directory[directory_size - 1] != PATH_SEPARATOR;
+    char * path = malloc (directory_size + add_sep + name_size + 1);
+
+    memcpy (path, directory, directory_size);
+
+    if (add_sep)
+    {
+	path[directory_size] = PATH_SEPARATOR;
+    }
+
+    memcpy (path + directory_size + add_sep, name, name_size + 1);
+
+    return path;
+}
+
+static bool read_dir (tree_walker * walker, unsigned int index, const tree_task * task, unsigned char * dirent_buffer)
+{
+    // a directory that cannot be read, such as one without permission or one removed during the walk, leaves its result null
+
+    int fd = open (task->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+	perror (task->path);
+	return false;
+    }
+
+    window_char names = {0};
+    window_char relative_path = {0};
+    window_tree_found found = {0};
+    const char * relative_directory = task->path + walker->root_size;
+    bool success = true;
+
+    while (relative_directory[0] == PATH_SEPARATOR)
+    {
+	relative_directory++;
+    }
+
+    while (true)
+    {
+	long size = syscall (SYS_getdents64, fd, dirent_buffer, DIRENT_BUFFER_SIZE);
+
+	if (size < 0)
+	{
+	    perror (task->path);
+	    close (fd);
+	    window_clear (names);
+	    window_clear (found);
+	    window_clear (relative_path);
+	    return false;
+	}
+
+	if (!size)
+	{
+	    break;
+	}
+
+	for (long offset = 0; offset < size; )
+	{
+	    const struct linux_dirent64 * dirent = (const void*) (dirent_buffer + offset);
+	    offset += dirent->d_reclen;
+
+	    const char * name = dirent->d_name;
+
+	    if (!strcmp (name, ".") || !strcmp (name, ".."))
+	    {
+		continue;
+	    }
+
+	    unsigned char type = dirent->d_type;
+
+	    if (type == DT_UNKNOWN)
+	    {
+		// some filesystems do not report types, so the entry is examined relative to the open directory
+
+		struct stat stat;
+
+		if (fstatat (fd, name, &stat, AT_SYMLINK_NOFOLLOW))
+		{
+		    window_printf (&relative_path, "%s%s%s", relative_directory, *relative_directory ? "/" : "", name);
+		    perror (relative_path.region.begin);
+		    success = false;
+		    continue;
+		}
+
+		type = S_ISDIR (stat.st_mode) ? DT_DIR : S_ISREG (stat.st_mode) ? DT_REG : S_ISLNK (stat.st_mode) ? DT_LNK : DT_UNKNOWN;
+	    }
+
+	    if (type != DT_DIR && type != DT_REG && type != DT_LNK)
+	    {
+		continue;
+	    }
+
+	    if (walker->exclude_count)
+	    {
+		window_printf (&relative_path, "%s%s%s", relative_directory, *relative_directory ? "/" : "", name);
+
+		if (is_excluded (walker, relative_path.region.begin, name))
+		{
+		    continue;
+		}
+	    }
+
+	    *window_push (found) = (tree_found){ .name_begin = range_count (names.region), .is_dir = type == DT_DIR };
+	    window_append_bytes ((window_unsigned_char*) &names, (const unsigned char*) name, strlen (name) + 1);
+	}
+    }
+
+    close (fd);
+
+    tree_dir * dir = calloc (1, sizeof(*dir));
+    dir->count = range_count (found.region);
+    dir->entries = calloc (dir->count ? dir->count : 1, sizeof(*dir->entries));
+    dir->names = names.region.begin;
+
+    for (size_t i = 0; i < dir->count; i++)
+    {
+	dir->entries[i] = (tree_entry){ .name = dir->names + found.region.begin[i].name_begin, .is_dir = found.region.begin[i].is_dir };
+    }
+
+    qsort (dir->entries, dir->count, sizeof(*dir->entries), compare_entries);
+
+    *task->result = dir;
+
+    // the subdirectories are queued last first, so that this thread goes on to read the first of them
+
+    for (size_t i = dir->count; i > 0; i--)
+    {
+	tree_entry * entry = dir->entries + i - 1;
+
+	if (entry->is_dir)
+	{
+	    push_task (walker, index, join_path (task->path, entry->name), &entry->dir);
+	}
+    }
+
+    window_clear (found);
+    window_clear (relative_path);
+
+    return success;
+}
+
+static void * walk_thread (void * arg)
+{
+    tree_worker * worker = arg;
+    tree_walker * walker = worker->walker;
+    unsigned char * dirent_buffer = malloc (DIRENT_BUFFER_SIZE);
+    tree_task task;
+
+    while (true)
+    {
+	pthread_mutex_lock (&walker->mutex);
+	size_t seen_pushes = walker->pushes;
+	bool stop = walker->error || !walker->pending;
+	pthread_mutex_unlock (&walker->mutex);
+
+	if (stop)
+	{
+	    break;
+	}
+
+	if (take_task (&task, walker, worker->index))
+	{
+	    bool success = read_dir (walker, worker->index, &task, dirent_buffer);
+
+	    free (task.path);
+
+	    pthread_mutex_lock (&walker->mutex);
+
+	    walker->pending--;
+	    walker->incomplete |= !success;
+
+	    if (!walker->pending)
+	    {
+		pthread_cond_broadcast (&walker->changed);
+	    }
+
+	    pthread_mutex_unlock (&walker->mutex);
+
+	    continue;
+	}
+
+	pthread_mutex_lock (&walker->mutex);
+
+	while (!walker->error && walker->pending && walker->pushes == seen_pushes)
+	{
+	    pthread_cond_wait (&walker->changed, &walker->mutex);
+	}
+
+	pthread_mutex_unlock (&walker->mutex);
+    }
+
+    free (dirent_buffer);
+
+    return NULL;
+}
+
+static void free_dir (tree_dir * dir)
+{
+    if (!dir)
+    {
+	return;
+    }
+
+    for (size_t i = 0; i < dir->count; i++)
+    {
+	free_dir (dir->entries[i].dir);
+    }
+
+    free (dir->entries);
+    free (dir->names);
+    free (dir);
+}
+
+static void list_dir (window_char * paths, window_tree_offset * offsets, const tree_dir * dir, window_char * path)
+{
+    size_t path_size = range_count (path->region);
+
+    for (size_t i = 0; i < dir->count; i++)
+    {
+	const tree_entry * entry = dir->entries + i;
+
+	if (entry->is_dir && !entry->dir)
+	{
+	    continue;
+	}
+
+	path->region.end = path->region.begin + path_size;
+
+	if (path_size && path->region.begin[path_size - 1] != PATH_SEPARATOR)
+	{
+	    *window_push (*path) = PATH_SEPARATOR;
+	}
+
+	window_append_bytes ((window_unsigned_char*) path, (const unsigned char*) entry->name, strlen (entry->name));
+
+	*window_push (*offsets) = range_count (paths->region);
+	window_append_bytes ((window_unsigned_char*) paths, (const unsigned char*) path->region.begin, range_count (path->region));
+	*window_push (*paths) = '\0';
+
+	if (entry->dir)
+	{
+	    list_dir (paths, offsets, entry->dir, path);
+	}
+    }
+
+    path->region.end = path->region.begin + path_size;
+}
+
+keyargs_define(tar_write_sink_tree)
+{
+    assert (args.sink);
+    assert (args.buffer);
+    assert (args.path);
+    assert (args.exclude || !args.exclude_count);
+
+    if (!args.threads)
+    {
+	long online = sysconf (_SC_NPROCESSORS_ONLN);
+	args.threads = online > 0 ? online : 1;
+    }
+
+    // a trailing separator on the root is dropped, so that names beneath it do not repeat it
+
+    size_t root_size = strlen (args.path);
+
+    while (root_size > 1 && args.path[root_size - 1] == PATH_SEPARATOR)
+    {
+	root_size--;
+    }
+
+    char * root = strndup (args.path, root_size);
+    struct stat root_stat;
+    tree_dir * root_dir = NULL;
+    bool success = true;
+    bool complete = true;
+
+    if (lstat (root, &root_stat))
+    {
+	perror (root);
+	free (root);
+	return false;
+    }
+
+    if (S_ISDIR (root_stat.st_mode))
+    {
+	tree_walker walker = {
+	    .mutex = PTHREAD_MUTEX_INITIALIZER,
+	    .changed = PTHREAD_COND_INITIALIZER,
+	    .deque_count = args.threads,
+	    .root_size = root_size,
+	    .exclude = args.exclude,
+	    .exclude_count = args.exclude_count,
+	};
+
+	walker.deques = calloc (walker.deque_count, sizeof(*walker.deques));
+
+	for (unsigned int i = 0; i < walker.deque_count; i++)
+	{
+	    pthread_mutex_init (&walker.deques[i].mutex, NULL);
+	}
+
+	push_task (&walker, 0, strdup (root), &root_dir);
+
+	tree_worker * workers = calloc (args.threads, sizeof(*workers));
+	unsigned int started = 0;
+
+	for (; started < args.threads; started++)
+	{
+	    workers[started] = (tree_worker){ .walker = &walker, .index = started };
+
+	    if (pthread_create (&workers[started].thread, NULL, walk_thread, workers + started))
+	    {
+		log_error ("Failed to start directory walking thread");
+		break;
+	    }
+	}
+
+	if (!started)
+	{
+	    walker.error = true;
+	}
+
+	for (unsigned int i = 0; i < started; i++)
+	{
+	    pthread_join (workers[i].thread, NULL);
+	}
+
+	// tasks left behind after an error still own their paths
+
+	for (unsigned int i = 0; i < walker.deque_count; i++)
+	{
+	    tree_deque * deque = walker.deques + i;
+
+	    for (size_t j = deque->head; j < (size_t) range_count (deque->tasks.region); j++)
+	    {
+		free (deque->tasks.region.begin[j].path);
+	    }
+
+	    window_clear (deque->tasks);
+	    pthread_mutex_destroy (&deque->mutex);
+	}
+
+	success = !walker.error;
+	complete = !walker.incomplete;
+
+	free (workers);
+	free (walker.deques);
+	pthread_mutex_destroy (&walker.mutex);
+	pthread_cond_destroy (&walker.changed);
+    }
+
+    window_char paths = {0};
+    window_char names = {0};
+    window_tree_offset offsets = {0};
+    window_char path = {0};
+    const char ** path_list = NULL;
+    const char ** name_list = NULL;
+
+    if (!success)
+    {
+	log_error ("Failed to walk %s", root);
+	goto done;
+    }
+
+    *window_push (offsets) = 0;
+    window_append_bytes ((window_unsigned_char*) &paths, (const unsigned char*) root, root_size + 1);
+
+    if (root_dir)
+    {
+	window_append_bytes ((window_unsigned_char*) &path, (const unsigned char*) root, root_size);
+	list_dir (&paths, &offsets, root_dir, &path);
+    }
+
+    size_t count = range_count (offsets.region);
+    path_list = calloc (count, sizeof(*path_list));
+
+    for (size_t i = 0; i < count; i++)
+    {
+	path_list[i] = paths.region.begin + offsets.region.begin[i];
+    }
+
+    if (args.override_name)
+    {
+	name_list = calloc (count, sizeof(*name_list));
+
+	for (size_t i = 0; i < count; i++)
+	{
+	    offsets.region.begin[i] = range_count (names.region);
+	    window_append_bytes ((window_unsigned_char*) &names, (const unsigned char*) args.override_name, strlen (args.override_name));
+	    window_append_bytes ((window_unsigned_char*) &names, (const unsigned char*) path_list[i] + root_size, strlen (path_list[i] + root_size) + 1);
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+	    name_list[i] = names.region.begin + offsets.region.begin[i];
+	}
+    }
+
+    success = tar_write_sink_paths (.sink = args.sink,
+				    .buffer = args.buffer,
+				    .paths = path_list,
+				    .override_names = name_list,
+				    .count = count,
+				    .threads = args.threads,
+				    .max_buffered_bytes = args.max_buffered_bytes,
+				    .owners = args.owners,
+				    .pax = args.pax,
+				    .hardlinks = args.hardlinks);
+
+    // like GNU tar, what could be read is written, and the failure is reported once the tar is done
+
+    if (success && !complete)
+    {
+	log_error ("Some of %s could not be read and was left out", root);
+	success = false;
+    }
+
+done:
+    free_dir (root_dir);
+    free (root);
+    free (path_list);
+    free (name_list);
+    window_clear (paths);
+    window_clear (names);
+    window_clear (offsets);
+    window_clear (path);
+
+    return success;
+}
@@ -0,0 +1,46 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/sink.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "owner.h"
+#include "hardlink.h"
+#endif
+
+/**
+   @file tar/tree.h
+   Describes a function that writes a whole directory tree into a tar. The tree is walked by a pool of threads, each of which reads directories with getdents64 and keeps the subdirectories it finds on its own queue, taking work from the other threads' queues when its own runs out. Each directory's entries are sorted by name once it has been read, so the order of the tar is a depth first walk in name order that does not depend on the timing of the threads. The paths are then written with tar_write_sink_paths.
+*/
+
+keyargs_declare(bool,tar_write_sink_tree,
+		convert_sink * sink;
+		window_unsigned_char * buffer;
+		const char * path;
+		const char * override_name;
+		const char * const * exclude;
+		size_t exclude_count;
+		unsigned int threads;
+		size_t max_buffered_bytes;
+		tar_owner_cache * owners;
+		bool pax;
+		tar_hardlink_table * hardlinks;);
+#define tar_write_sink_tree(...) keyargs_call(tar_write_sink_tree, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that writes a directory and everything beneath it to a sink. Symlinks are written as links and are not followed. Files other than regular files, directories and symlinks, such as sockets and devices, are left out. A directory beneath path that cannot be read, for lack of permission or because it was removed during the walk, is reported and left out together with everything beneath it, and the rest of the tree is still written.
+   @return True if successful, false if anything could not be written or was left out for an error
+   @param sink The sink to write the tar to
+   @param buffer A buffer used to hold headers and file contents on their way to the sink
+   @param path The directory to write. If it is not a directory, it is written alone.
+   @param override_name If non-null, this replaces path at the start of every name in the tar
+   @param exclude Shell wildcard patterns, as used by fnmatch, for entries to leave out. A pattern is matched against both the name of an entry and its path relative to the directory being written, and a directory that matches is left out together with everything beneath it without being read.
+   @param exclude_count The number of patterns in exclude
+   @param threads The number of threads used to walk the tree and to read files ahead of the sink. If 0, one thread per online processor is used.
+   @param max_buffered_bytes As in tar_write_sink_paths
+   @param owners An optional cache for user and group names, as in tar_write_header
+   @param pax If true, headers are written in pax format as in tar_write_stat_header
+   @param hardlinks An optional table of inodes that have been written, as in tar_write_stat_header
+*/
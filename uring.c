@@ -0,0 +1,699 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../keyargs/keyargs.h"
+#include "../convert/sink.h"
+#include "../convert/source.h"
+#include "../convert/duplex.h"
+#include "../convert/fd/source.h"
+#include "../convert/fd/sink.h"
+#include "common.h"
+#include "owner.h"
+#include "hardlink.h"
+#include "write.h"
+#include "uring.h"
+#include "../log/log.h"
+
+#define DEFAULT_DEPTH 64
+#define DEFAULT_MAX_BUFFERED_BYTES (64 * 1024 * 1024)
+
+typedef struct ring ring;
+struct ring
+{
+    int fd;
+    void * sq_map;
+    size_t sq_map_size;
+    void * cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe * sqes;
+    size_t sqes_size;
+    unsigned * sq_tail;
+    unsigned sq_mask;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe * cqes;
+    unsigned queued;
+};
+
+static bool ring_supports (int fd, const int * ops, size_t op_count)
+{
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe * probe = calloc (1, probe_size);
+
+    bool supported = 0 == syscall (__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256);
+
+    for (size_t i = 0; supported && i < op_count; i++)
+    {
+	supported = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free (probe);
+
+    return supported;
+}
+
+static void ring_close (ring * ring)
+{
+    if (ring->sqes)
+    {
+	munmap (ring->sqes, ring->sqes_size);
+    }
+
+    if (ring->cq_map && ring->cq_map != ring->sq_map)
+    {
+	munmap (ring->cq_map, ring->cq_map_size);
+    }
+
+    if (ring->sq_map)
+    {
+	munmap (ring->sq_map, ring->sq_map_size);
+    }
+
+    if (ring->fd >= 0)
+    {
+	close (ring->fd);
+    }
+
+    *ring = (struct ring){ .fd = -1 };
+}
+
+static bool ring_open (ring * ring, unsigned entries)
+{
+    *ring = (struct ring){ .fd = -1 };
+
+    struct io_uring_params params = {0};
+
+    ring->fd = syscall (__NR_io_uring_setup, entries, &params);
+
+    if (ring->fd < 0)
+    {
+	goto fail;
+    }
+
+    static const int ops[] = { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+
+    if (!ring_supports (ring->fd, ops, sizeof(ops) / sizeof(*ops)))
+    {
+	goto fail;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP && ring->cq_map_size > ring->sq_map_size)
+    {
+	ring->sq_map_size = ring->cq_map_size;
+    }
+
+    ring->sq_map = mmap (NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+
+    if (ring->sq_map == MAP_FAILED)
+    {
+	ring->sq_map = NULL;
+	goto fail;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+	ring->cq_map = ring->sq_map;
+    }
+    else
+    {
+	ring->cq_map = mmap (NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+
+	if (ring->cq_map == MAP_FAILED)
+	{
+	    ring->cq_map = NULL;
+	    goto fail;
+	}
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap (NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->sqes == MAP_FAILED)
+    {
+	ring->sqes = NULL;
+	goto fail;
+    }
+
+    char * sq = ring->sq_map;
+    char * cq = ring->cq_map;
+
+    ring->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned*) (sq + params.sq_off.ring_mask);
+    ring->cq_head = (unsigned*) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    // every submission queue entry is always placed at the array index that refers to it
+
+    unsigned * array = (unsigned*) (sq + params.sq_off.array);
+
+    for (unsigned i = 0; i < params.sq_entries; i++)
+    {
+	array[i] = i;
+    }
+
+    return true;
+
+fail:
+    ring_close (ring);
+    return false;
+}
+
+static struct io_uring_sqe * ring_get_sqe (ring * ring)
+{
+    unsigned tail = *ring->sq_tail + ring->queued++;
+    struct io_uring_sqe * sqe = ring->sqes + (tail & ring->sq_mask);
+    memset (sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static bool ring_submit (ring * ring, unsigned wait)
+{
+    __atomic_store_n (ring->sq_tail, *ring->sq_tail + ring->queued, __ATOMIC_RELEASE);
+
+    unsigned submit = ring->queued;
+    ring->queued = 0;
+
+    while (submit || wait)
+    {
+	int entered = syscall (__NR_io_uring_enter, ring->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+	if (entered < 0)
+	{
+	    if (errno == EINTR)
+	    {
+		continue;
+	    }
+
+	    perror ("io_uring_enter");
+	    return false;
+	}
+
+	submit -= entered;
+	wait = 0;
+    }
+
+    return true;
+}
+
+static struct io_uring_cqe * ring_peek_cqe (ring * ring)
+{
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+	return NULL;
+    }
+
+    return ring->cqes + (head & ring->cq_mask);
+}
+
+static void ring_seen_cqe (ring * ring)
+{
+    __atomic_store_n (ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+typedef enum {
+    SLOT_EMPTY,
+    SLOT_STAT,
+    SLOT_WAIT,
+    SLOT_OPEN,
+    SLOT_READ,
+    SLOT_CLOSE,
+    SLOT_READY,
+}
+    slot_stage;
+
+typedef struct uring_slot uring_slot;
+struct uring_slot
+{
+    slot_stage stage;
+    int error;
+    bool preloaded;
+    const char * path;
+    int fd;
+    size_t have;
+    struct statx statx;
+    struct stat stat;
+    char linkname[PATH_MAX + 1];
+    window_unsigned_char contents;
+};
+
+typedef struct uring_pipeline uring_pipeline;
+struct uring_pipeline
+{
+    ring ring;
+    uring_slot * slots;
+    size_t slot_count;
+    size_t emitted;
+    size_t buffered_bytes;
+    size_t max_buffered_bytes;
+};
+
+static void queue_statx (ring * ring, uring_slot * slot)
+{
+    struct io_uring_sqe * sqe = ring_get_sqe (ring);
+
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t) slot->path;
+    sqe->len = STATX_BASIC_STATS;
+    sqe->off = (uintptr_t) &slot->statx;
+    sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+    sqe->user_data = (uintptr_t) slot;
+
+    slot->stage = SLOT_STAT;
+}
+
+static void queue_open (ring * ring, uring_slot * slot)
+{
+    struct io_uring_sqe * sqe = ring_get_sqe (ring);
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t) slot->path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = (uintptr_t) slot;
+
+    slot->stage = SLOT_OPEN;
+}
+
+static void queue_read (ring * ring, uring_slot * slot)
+{
+    struct io_uring_sqe * sqe = ring_get_sqe (ring);
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uintptr_t) (slot->contents.region.begin + slot->have);
+    sqe->len = slot->stat.st_size - slot->have;
+    sqe->off = slot->have;
+    sqe->user_data = (uintptr_t) slot;
+
+    slot->stage = SLOT_READ;
+}
+
+static void queue_close (ring * ring, uring_slot * slot)
+{
+    struct io_uring_sqe * sqe = ring_get_sqe (ring);
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = slot->fd;
+    sqe->user_data = (uintptr_t) slot;
+
+    slot->stage = SLOT_CLOSE;
+}
+
+static void stat_from_statx (struct stat * stat, const struct statx * statx)
+{
+    *stat = (struct stat){
+	.st_dev = makedev (statx->stx_dev_major, statx->stx_dev_minor),
+	.st_ino = statx->stx_ino,
+	.st_mode = statx->stx_mode,
+	.st_nlink = statx->stx_nlink,
+	.st_uid = statx->stx_uid,
+	.st_gid = statx->stx_gid,
+	.st_size = statx->stx_size,
+	.st_mtim = { .tv_sec = statx->stx_mtime.tv_sec, .tv_nsec = statx->stx_mtime.tv_nsec },
+    };
+}
+
+static void try_start_read (uring_pipeline * pipeline, uring_slot * slot, size_t index)
+{
+    size_t size = slot->stat.st_size;
+
+    if (index != pipeline->emitted && pipeline->buffered_bytes + size > pipeline->max_buffered_bytes)
+    {
+	return;
+    }
+
+    pipeline->buffered_bytes += size;
+    slot->preloaded = true;
+    slot->have = 0;
+
+    if (!size)
+    {
+	slot->stage = SLOT_READY;
+	return;
+    }
+
+    window_rewrite (slot->contents);
+    window_grow_bytes (&slot->contents, size);
+
+    queue_open (&pipeline->ring, slot);
+}
+
+static void complete (uring_pipeline * pipeline, uring_slot * slot, int result)
+{
+    switch (slot->stage)
+    {
+    case SLOT_STAT:
+	if (result < 0)
+	{
+	    slot->error = -result;
+	    slot->stage = SLOT_READY;
+	    return;
+	}
+
+	stat_from_statx (&slot->stat, &slot->statx);
+
+	if (S_ISLNK (slot->stat.st_mode))
+	{
+	    // io_uring has no readlink operation
+
+	    ssize_t linkname_length = readlink (slot->path, slot->linkname, sizeof(slot->linkname));
+
+	    if (linkname_length < 0 || linkname_length == sizeof(slot->linkname))
+	    {
+		slot->error = linkname_length < 0 ? errno : ENAMETOOLONG;
+	    }
+	    else
+	    {
+		slot->linkname[linkname_length] = '\0';
+	    }
+	}
+
+	slot->stage = S_ISREG (slot->stat.st_mode) && (size_t) slot->stat.st_size <= pipeline->max_buffered_bytes ? SLOT_WAIT : SLOT_READY;
+	return;
+
+    case SLOT_OPEN:
+	if (result < 0)
+	{
+	    slot->error = -result;
+	    slot->stage = SLOT_READY;
+	    return;
+	}
+
+	slot->fd = result;
+	queue_read (&pipeline->ring, slot);
+	return;
+
+    case SLOT_READ:
+	if (result <= 0)
+	{
+	    slot->error = result < 0 ? -result : EIO;
+	    queue_close (&pipeline->ring, slot);
+	    return;
+	}
+
+	slot->have += result;
+
+	if (slot->have < (size_t) slot->stat.st_size)
+	{
+	    queue_read (&pipeline->ring, slot);
+	}
+	else
+	{
+	    queue_close (&pipeline->ring, slot);
+	}
+	return;
+
+    case SLOT_CLOSE:
+	slot->fd = -1;
+	slot->stage = SLOT_READY;
+	return;
+
+    default:
+	assert (false);
+    }
+}
+
+static bool stream_contents (convert_sink * sink, window_unsigned_char * buffer, const char * path)
+{
+    int file_fd = open (path, O_RDONLY | O_CLOEXEC);
+
+    if (file_fd < 0)
+    {
+	perror (path);
+	return false;
+    }
+
+    fd_source fd_source = fd_source_init(.fd = file_fd, .contents = buffer);
+
+    bool join_success = convert_join (sink, &fd_source.source);
+
+    convert_source_clear(&fd_source.source);
+
+    close (file_fd);
+
+    return join_success;
+}
+
+static bool emit_slot (convert_sink * sink, window_unsigned_char * buffer, tar_owner_cache * owners, bool pax, tar_hardlink_table * hardlinks, uring_slot * slot, const char * name)
+{
+    if (slot->error)
+    {
+	errno = slot->error;
+	perror (slot->path);
+	return false;
+    }
+
+    tar_type type = TAR_ERROR;
+
+    sink->contents = &buffer->region.const_cast;
+
+    if (!tar_write_stat_header (.output = buffer,
+				.stat = &slot->stat,
+				.name = name,
+				.linkname = slot->linkname,
+				.detect_type = &type,
+				.owners = owners,
+				.pax = pax,
+				.hardlinks = hardlinks,
+				.path = slot->path))
+    {
+	return false;
+    }
+
+    if (type == TAR_FILE)
+    {
+	if (slot->preloaded)
+	{
+	    window_append_bytes (buffer, slot->contents.region.begin, slot->have);
+	}
+	else if (!stream_contents (sink, buffer, slot->path))
+	{
+	    return false;
+	}
+
+	sink->contents = &buffer->region.const_cast;
+
+	tar_write_padding (buffer, slot->stat.st_size);
+    }
+
+    bool error = false;
+
+    return convert_drain (&error, sink);
+}
+
+static bool write_paths_sync (convert_sink * sink, window_unsigned_char * buffer, const char * const * paths, const char * const * override_names, size_t count, tar_owner_cache * owners, bool pax, tar_hardlink_table * hardlinks)
+{
+    for (size_t index = 0; index < count; index++)
+    {
+	if (!tar_write_sink_path (.sink = sink,
+				  .buffer = buffer,
+				  .path = paths[index],
+				  .override_name = override_names ? override_names[index] : NULL,
+				  .owners = owners,
+				  .pax = pax,
+				  .hardlinks = hardlinks))
+	{
+	    log_error ("Failed to write %s to the tar", paths[index]);
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+keyargs_define(tar_write_sink_paths_uring)
+{
+    assert (args.sink);
+    assert (args.buffer);
+    assert (args.paths || !args.count);
+
+    if (!args.depth)
+    {
+	args.depth = DEFAULT_DEPTH;
+    }
+
+    if (!args.max_buffered_bytes)
+    {
+	args.max_buffered_bytes = DEFAULT_MAX_BUFFERED_BYTES;
+    }
+
+    uring_pipeline pipeline = {
+	.slot_count = args.depth,
+	.max_buffered_bytes = args.max_buffered_bytes,
+    };
+
+    // each slot has at most one operation in flight, so the rings never overflow
+
+    if (!ring_open (&pipeline.ring, args.depth))
+    {
+	return write_paths_sync (args.sink, args.buffer, args.paths, args.override_names, args.count, args.owners, args.pax, args.hardlinks);
+    }
+
+    tar_owner_cache local_owners = {0};
+    tar_owner_cache * owners = args.owners ? args.owners : &local_owners;
+
+    pipeline.slots = calloc (pipeline.slot_count, sizeof(*pipeline.slots));
+
+    size_t next_claim = 0;
+    size_t in_flight = 0;
+    bool success = true;
+
+    while (success && pipeline.emitted < args.count)
+    {
+	for (; next_claim < args.count && next_claim < pipeline.emitted + pipeline.slot_count; next_claim++)
+	{
+	    uring_slot * slot = pipeline.slots + next_claim % pipeline.slot_count;
+
+	    assert (slot->stage == SLOT_EMPTY);
+	    slot->path = args.paths[next_claim];
+	    slot->fd = -1;
+	    queue_statx (&pipeline.ring, slot);
+	}
+
+	for (size_t index = pipeline.emitted; index < next_claim; index++)
+	{
+	    uring_slot * slot = pipeline.slots + index % pipeline.slot_count;
+
+	    if (slot->stage == SLOT_WAIT)
+	    {
+		try_start_read (&pipeline, slot, index);
+	    }
+	}
+
+	bool emitted_any = false;
+
+	while (success && pipeline.emitted < next_claim)
+	{
+	    uring_slot * slot = pipeline.slots + pipeline.emitted % pipeline.slot_count;
+
+	    if (slot->stage != SLOT_READY)
+	    {
+		break;
+	    }
+
+	    const char * name = args.override_names && args.override_names[pipeline.emitted] ? args.override_names[pipeline.emitted] : slot->path;
+
+	    if (!emit_slot (args.sink, args.buffer, owners, args.pax, args.hardlinks, slot, name))
+	    {
+		log_error ("Failed to write %s to the tar", slot->path);
+		success = false;
+	    }
+
+	    if (slot->preloaded)
+	    {
+		pipeline.buffered_bytes -= slot->stat.st_size;
+	    }
+
+	    window_rewrite (slot->contents);
+	    slot->stage = SLOT_EMPTY;
+	    slot->error = 0;
+	    slot->preloaded = false;
+	    slot->linkname[0] = '\0';
+	    pipeline.emitted++;
+	    emitted_any = true;
+	}
+
+	if (!success || pipeline.emitted == args.count)
+	{
+	    break;
+	}
+
+	in_flight += pipeline.ring.queued;
+
+	if (emitted_any)
+	{
+	    // new slots may have been freed, so claim them before waiting
+
+	    if (!ring_submit (&pipeline.ring, 0))
+	    {
+		success = false;
+	    }
+
+	    continue;
+	}
+
+	assert (in_flight);
+
+	if (!ring_submit (&pipeline.ring, 1))
+	{
+	    success = false;
+	    break;
+	}
+
+	struct io_uring_cqe * cqe;
+
+	while ((cqe = ring_peek_cqe (&pipeline.ring)))
+	{
+	    uring_slot * slot = (uring_slot*) (uintptr_t) cqe->user_data;
+	    int result = cqe->res;
+
+	    ring_seen_cqe (&pipeline.ring);
+	    in_flight--;
+
+	    complete (&pipeline, slot, result);
+	}
+    }
+
+    // drain operations that are still in flight, so that no slot memory is written after it is freed
+
+    in_flight += pipeline.ring.queued;
+
+    while (in_flight && ring_submit (&pipeline.ring, 1))
+    {
+	struct io_uring_cqe * cqe;
+
+	while ((cqe = ring_peek_cqe (&pipeline.ring)))
+	{
+	    uring_slot * slot = (uring_slot*) (uintptr_t) cqe->user_data;
+
+	    if (slot->stage == SLOT_OPEN && cqe->res >= 0)
+	    {
+		close (cqe->res);
+	    }
+	    else if (slot->stage == SLOT_READ)
+	    {
+		close (slot->fd);
+	    }
+
+	    ring_seen_cqe (&pipeline.ring);
+	    in_flight--;
+	}
+    }
+
+    for (size_t i = 0; i < pipeline.slot_count; i++)
+    {
+	window_clear (pipeline.slots[i].contents);
+    }
+
+    free (pipeline.slots);
+    tar_owner_cache_clear (&local_owners);
+    ring_close (&pipeline.ring);
+
+    return success;
+}
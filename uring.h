@@ -0,0 +1,45 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/sink.h"
+#include "../keyargs/keyargs.h"
+#include "common.h"
+#include "owner.h"
+#include "hardlink.h"
+#endif
+
+/**
+   @file tar/uring.h
+   Describes an io_uring backend that writes many paths into a tar. Instead of blocking on an lstat, open, read and close for each path in turn, the calling thread keeps a window of upcoming paths in flight on a single io_uring, submitting their statx, openat, read and close operations in batches, and writes each header and its contents to the sink as soon as every earlier path has been written. The output is identical to calling tar_write_sink_path for each path in turn.
+   If io_uring is unavailable, for example because the kernel is too old or the call is blocked by a seccomp filter, the paths are written with tar_write_sink_path instead.
+*/
+
+keyargs_declare(bool,tar_write_sink_paths_uring,
+		convert_sink * sink;
+		window_unsigned_char * buffer;
+		const char * const * paths;
+		const char * const * override_names;
+		size_t count;
+		unsigned int depth;
+		size_t max_buffered_bytes;
+		tar_owner_cache * owners;
+		bool pax;
+		tar_hardlink_table * hardlinks;);
+#define tar_write_sink_paths_uring(...) keyargs_call(tar_write_sink_paths_uring, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that writes the headers and contents of a list of paths to a sink using io_uring.
+   @return True if successful, false otherwise
+   @param sink The sink to write the tar to
+   @param buffer A buffer used to hold headers and file contents on their way to the sink
+   @param paths The paths to be written, in the order they should appear in the tar
+   @param override_names If non-null, this gives the name to be used in the tar for each path. Individual names may be null to use the path itself.
+   @param count The number of paths to write
+   @param depth The number of paths that may be in flight at once. If 0, a default of 64 is used.
+   @param max_buffered_bytes The number of bytes of file contents that may be read ahead of the sink. Files larger than this are read by the calling thread as they are written. If 0, a default of 64 MiB is used.
+   @param owners An optional cache for user and group names, as in tar_write_header. If null, a cache is kept for the duration of this call.
+   @param pax If true, headers are written in pax format as in tar_write_stat_header
+   @param hardlinks An optional table of inodes that have been written, as in tar_write_stat_header. Files that are written as hardlinks have no contents in the tar.
+*/
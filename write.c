@@ -1,4 +1,4 @@
-#define _XOPEN_SOURCE 500
+#define _GNU_SOURCE
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,26 +6,31 @@
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
-#include <pwd.h>
-#include <grp.h>
 #include <sys/stat.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/sendfile.h>
 #define FLAT_INCLUDES
 #include "../range/def.h"
 #include "../window/def.h"
 #include "../window/alloc.h"
+#include "../window/printf.h"
 #include "../keyargs/keyargs.h"
 #include "../convert/sink.h"
 #include "../convert/source.h"
 #include "../convert/duplex.h"
 #include "../convert/fd/source.h"
+#include "../convert/fd/sink.h"
 #include "common.h"
+#include "owner.h"
+#include "hardlink.h"
 #include "write.h"
 #include "internal/spec.h"
 #include "../log/log.h"
 
 #define PATH_SEPARATOR '/'
+#define EXTENT_CHUNK_SIZE (1024 * 1024)
 
 inline static bool convert_type(char * output, tar_type input)
 {
@@ -55,6 +60,14 @@ inline static bool convert_type(char * output, tar_type input)
 	*output = GNUTYPE_LONGNAME;
 	return true;
 
+    case TAR_PAX:
+	*output = XHDTYPE;
+	return true;
+
+    case TAR_PAX_GLOBAL:
+	*output = XGLTYPE;
+	return true;
+
     default:
 	log_fatal ("Invalid tar item type");
     }
@@ -63,6 +76,124 @@ fail:
     return false;
 }
 
+static bool fits_octal (size_t field_size, unsigned long long value)
+{
+    return value >> (3 * (field_size - 1)) == 0;
+}
+
+static void write_numeric (char * field, size_t size, unsigned long long value)
+{
+    // octal with a terminating null when it fits, otherwise GNU base 256: a leading 0x80 byte followed by big endian bytes
+    
+    if (fits_octal (size, value))
+    {
+	snprintf (field, size, "%0*llo", (int) size - 1, value);
+	return;
+    }
+
+    memset (field, 0, size);
+    field[0] = (char) 0x80;
+
+    for (size_t i = size - 1; i > 0 && value; i--)
+    {
+	field[i] = value & 0xff;
+	value >>= 8;
+    }
+}
+
+static void write_header_numeric (char * field, size_t size, unsigned long long value, bool pax)
+{
+    // with pax the real value is in an extended record, so the field is clamped to the largest octal value rather than using the GNU form
+
+    if (pax && !fits_octal (size, value))
+    {
+	memset (field, '7', size - 1);
+	field[size - 1] = '\0';
+	return;
+    }
+
+    write_numeric (field, size, value);
+}
+
+static void append_pax_record (window_unsigned_char * records, const char * key, const char * value, size_t value_size)
+{
+    // the length at the start of a record counts every byte of the record, including its own digits
+    
+    size_t body_size = 1 + strlen (key) + 1 + value_size + 1;
+    size_t length = body_size;
+
+    for (int digits = 1; digits < 20; digits++)
+    {
+	length = body_size + digits;
+
+	if (snprintf (NULL, 0, "%zu", length) == digits)
+	{
+	    break;
+	}
+    }
+
+    char prefix[24];
+    int prefix_size = snprintf (prefix, sizeof(prefix), "%zu ", length);
+
+    window_append_bytes (records, (const unsigned char*) prefix, prefix_size);
+    window_append_bytes (records, (const unsigned char*) key, strlen (key));
+    *window_push (*records) = '=';
+    window_append_bytes (records, (const unsigned char*) value, value_size);
+    *window_push (*records) = '\n';
+}
+
+static void append_pax_number (window_unsigned_char * records, const char * key, unsigned long long value)
+{
+    char text[24];
+    int size = snprintf (text, sizeof(text), "%llu", value);
+    append_pax_record (records, key, text, size);
+}
+
+static size_t sparse_entry_count (const range_tar_sparse_extent * map, unsigned long long size)
+{
+    // like GNU tar, a file that ends in a hole gets a final empty extent at its end, so that readers which ignore the real size still recreate it
+    
+    size_t count = range_count (*map);
+
+    return count && map->end[-1].offset + map->end[-1].size == size ? count : count + 1;
+}
+
+static tar_sparse_extent sparse_entry (const range_tar_sparse_extent * map, unsigned long long size, size_t i)
+{
+    return i < (size_t) range_count (*map) ? map->begin[i] : (tar_sparse_extent){ .offset = size };
+}
+
+static void write_sparse_entries (struct sparse * entries, size_t entries_count, const range_tar_sparse_extent * map, unsigned long long size, size_t * i)
+{
+    size_t count = sparse_entry_count (map, size);
+    
+    for (size_t j = 0; j < entries_count && *i < count; j++, (*i)++)
+    {
+	tar_sparse_extent extent = sparse_entry (map, size, *i);
+	write_numeric (entries[j].offset, sizeof(entries[j].offset), extent.offset);
+	write_numeric (entries[j].numbytes, sizeof(entries[j].numbytes), extent.size);
+    }
+}
+
+static void append_sparse_map (window_unsigned_char * output, const range_tar_sparse_extent * map, unsigned long long size)
+{
+    // the GNU pax format 1.0 map is a list of newline terminated decimal numbers at the start of the contents, padded to a whole block
+    
+    size_t count = sparse_entry_count (map, size);
+    char line[24];
+
+    window_append_bytes (output, (const unsigned char*) line, snprintf (line, sizeof(line), "%zu\n", count));
+
+    for (size_t i = 0; i < count; i++)
+    {
+	tar_sparse_extent extent = sparse_entry (map, size, i);
+	window_append_bytes (output, (const unsigned char*) line, snprintf (line, sizeof(line), "%llu\n", extent.offset));
+	window_append_bytes (output, (const unsigned char*) line, snprintf (line, sizeof(line), "%llu\n", extent.size));
+    }
+
+    tar_write_padding (output, range_count (output->region));
+}
+
 static bool ends_with (const char * string, char c)
 {
     if (!*string)
@@ -91,31 +222,143 @@ keyargs_define(tar_write_header)
     //memset (header.bytes + sizeof(header.posix), ' ', sizeof(header) - sizeof(header.posix));
     
 
-    struct passwd * passwd = args.uname ? getpwnam (args.uname) : getpwuid(args.uid);
+    tar_owner_cache local_owners = {0};
+    tar_owner_cache * owners = args.owners ? args.owners : &local_owners;
 
-    if (!passwd)
-    {
-	log_fatal ("Failed to lookup passwd entry for tar file's user");
-    }
-    
-    struct group * group = args.gname ? getgrnam(args.gname) : getgrgid(args.gid);
+    // the resolved names point into the cache, which may grow while the extended headers before this one are written, so they are copied out at once
 
-    if (!group)
-    {
-	log_fatal ("Failed to lookup group entry for tar file's group");
-    }
+    unsigned int uid = args.uid;
+    const char * resolved_uname = args.uname;
+    tar_owner_resolve_user (owners, &uid, &resolved_uname);
+    char uname[TAR_OWNER_NAME_SIZE + 1] = {0};
+    strncpy (uname, resolved_uname, TAR_OWNER_NAME_SIZE);
+
+    unsigned int gid = args.gid;
+    const char * resolved_gname = args.gname;
+    tar_owner_resolve_group (owners, &gid, &resolved_gname);
+    char gname[TAR_OWNER_NAME_SIZE + 1] = {0};
+    strncpy (gname, resolved_gname, TAR_OWNER_NAME_SIZE);
 
     assert (args.name);
+    assert (args.type == TAR_DIR || !args.deleted || !range_count (*args.deleted));
 
     while (*args.name == PATH_SEPARATOR)
     {
 	args.name++;
     }
 
+    const char * sparse_name = args.name;
+    unsigned long long sparse_size = args.size;
+    window_unsigned_char sparse_map = {0};
+    window_char sparse_path = {0};
+
+    if (args.sparse)
+    {
+	assert (args.type == TAR_FILE);
+
+	args.size = 0;
+
+	for (const tar_sparse_extent * extent = args.sparse->begin; extent < args.sparse->end; extent++)
+	{
+	    args.size += extent->size;
+	}
+
+	if (args.pax)
+	{
+	    // as GNU tar does, the ustar name is moved into a GNUSparseFile directory so that readers unaware of the sparse records do not overwrite the real file with the map and data
+
+	    const char * base = strrchr (args.name, PATH_SEPARATOR);
+	    base = base ? base + 1 : args.name;
+
+	    window_printf (&sparse_path, "%.*sGNUSparseFile.0/%s", (int) (base - args.name), args.name, base);
+	    args.name = sparse_path.region.begin;
+
+	    append_sparse_map (&sparse_map, args.sparse, sparse_size);
+	    args.size += range_count (sparse_map.region);
+	}
+    }
+
     unsigned long long size = strlen (args.name) + 1;
     bool add_sep = args.type == TAR_DIR && !ends_with (args.name, PATH_SEPARATOR);
+    bool name_fits = size + (add_sep ? 1 : 0) < sizeof(header.posix.name);
+
+    window_unsigned_char records = {0};
+
+    if (args.pax)
+    {
+	if (args.sparse)
+	{
+	    append_pax_number (&records, "GNU.sparse.major", 1);
+	    append_pax_number (&records, "GNU.sparse.minor", 0);
+	    append_pax_record (&records, "GNU.sparse.name", sparse_name, strlen (sparse_name));
+	    append_pax_number (&records, "GNU.sparse.realsize", sparse_size);
+	}
+
+	if (!name_fits)
+	{
+	    window_char path = {0};
+	    window_printf (&path, "%s%s", args.name, add_sep ? (char[]){ PATH_SEPARATOR, '\0' } : "");
+	    append_pax_record (&records, "path", path.region.begin, strlen (path.region.begin));
+	    window_clear (path);
+	}
+
+	if (args.linkname && strlen (args.linkname) >= sizeof(header.posix.linkname))
+	{
+	    append_pax_record (&records, "linkpath", args.linkname, strlen (args.linkname));
+	}
+
+	if (!fits_octal (sizeof(header.posix.size), args.size))
+	{
+	    append_pax_number (&records, "size", args.size);
+	}
+
+	if (!fits_octal (sizeof(header.posix.uid), uid))
+	{
+	    append_pax_number (&records, "uid", uid);
+	}
+
+	if (!fits_octal (sizeof(header.posix.gid), gid))
+	{
+	    append_pax_number (&records, "gid", gid);
+	}
+
+	if (args.mtime_nsec)
+	{
+	    char mtime[48];
+	    int mtime_size = snprintf (mtime, sizeof(mtime), "%llu.%09lu", args.mtime, args.mtime_nsec);
+	    append_pax_record (&records, "mtime", mtime, mtime_size);
+	}
+	else if (!fits_octal (sizeof(header.posix.mtime), args.mtime))
+	{
+	    append_pax_number (&records, "mtime", args.mtime);
+	}
+    }
+
+    // deletions are recorded in a pax record whatever the format, as they have no ustar or GNU form
+
+    if (args.deleted && range_count (*args.deleted))
+    {
+	append_pax_record (&records, TAR_PAX_DELETED, args.deleted->begin, range_count (*args.deleted));
+    }
+
+    size_t records_size = range_count (records.region);
+
+    if (records_size)
+    {
+	tar_write_header (.output = args.output,
+			  .name = "././@PaxHeader",
+			  .size = records_size,
+			  .type = TAR_PAX,
+			  .owners = args.owners,
+			  .pax = true);
+
+	window_append_bytes (args.output, records.region.begin, records_size);
+	tar_write_padding (args.output, records_size);
+    }
+
+    window_clear (records);
 
-    if (size + (add_sep ? 1 : 0) < sizeof(header.posix.name))
+    if (name_fits)
     {
 	memset (header.posix.name, 0, sizeof(header.posix.name));
 	strcpy (header.posix.name, args.name);
@@ -125,14 +368,23 @@ keyargs_define(tar_write_header)
 	    strcat (header.posix.name, (char[]){ PATH_SEPARATOR, '\0' });
 	}
     }
+    else if (args.pax)
+    {
+	// the ustar field keeps as much of the name as fits, for readers that ignore pax headers
+	
+	strncpy (header.posix.name, args.name, sizeof(header.posix.name) - 1);
+    }
     else
     {
+	size += add_sep ? 1 : 0;
+	
 	tar_write_header (.output = args.output,
 			  .name = "././@LongName",
 			  .size = size,
-			  .type = TAR_LONGNAME);
+			  .type = TAR_LONGNAME,
+			  .owners = args.owners);
 
-	window_append_bytes (args.output, (const unsigned char*) args.name, size);
+	window_append_bytes (args.output, (const unsigned char*) args.name, size - (add_sep ? 1 : 0));
 
 	if (add_sep)
 	{
@@ -145,19 +397,10 @@ keyargs_define(tar_write_header)
     }
 
     snprintf (header.posix.mode, sizeof(header.posix.mode), "%07o", args.mode);
-    snprintf (header.posix.uid, sizeof(header.posix.uid), "%07o", passwd->pw_uid);
-    snprintf (header.posix.gid, sizeof(header.posix.gid), "%07o", group->gr_gid);
-
-    if (args.size <= 077777777777)
-    {
-	snprintf (header.posix.size, sizeof(header.posix.size), "%011llo", args.size);
-    }
-    else
-    {
-	log_fatal ("Tar size exceeds maximum for octal sizes, base 256 is unimplemented");
-    }
-
-    snprintf (header.posix.mtime, sizeof(header.posix.mtime), "%011llo", args.mtime);
+    write_header_numeric (header.posix.uid, sizeof(header.posix.uid), uid, args.pax);
+    write_header_numeric (header.posix.gid, sizeof(header.posix.gid), gid, args.pax);
+    write_header_numeric (header.posix.size, sizeof(header.posix.size), args.size, args.pax);
+    write_header_numeric (header.posix.mtime, sizeof(header.posix.mtime), args.mtime, args.pax);
 
     if (!convert_type (&header.posix.typeflag, args.type))
     {
@@ -172,13 +415,18 @@ keyargs_define(tar_write_header)
 	{
 	    strcpy (header.posix.linkname, args.linkname);
 	}
+	else if (args.pax)
+	{
+	    strncpy (header.posix.linkname, args.linkname, sizeof(header.posix.linkname) - 1);
+	}
 	else
 	{
 	    tar_write_header (.output = args.output,
 			      .name = "././@LongLink",
 			      .size = size,
-			      .type = TAR_LONGLINK);
-	    window_append_bytes(args.output, (const unsigned char*) args.name, size);
+			      .type = TAR_LONGLINK,
+			      .owners = args.owners);
+	    window_append_bytes(args.output, (const unsigned char*) args.linkname, size);
 	    //buffer_append_n (*args.output, args.name, size);
 	    tar_write_padding(args.output, size);
 	}
@@ -189,25 +437,46 @@ keyargs_define(tar_write_header)
     }
 
     assert (sizeof(header.posix.magic) == 6);
-    memcpy(header.posix.magic, (char[]){ 'u', 's', 't', 'a', 'r', ' ' }, 6);
-
     assert (sizeof(header.posix.version) == 2);
-    memcpy(header.posix.version, (char[]){ ' ', 0 }, 2);
 
-    strncpy(header.posix.uname, passwd->pw_name, sizeof(header.posix.uname));
+    if (args.pax)
+    {
+	memcpy(header.posix.magic, TMAGIC, TMAGLEN);
+	memcpy(header.posix.version, TVERSION, TVERSLEN);
+    }
+    else
+    {
+	memcpy(header.posix.magic, (char[]){ 'u', 's', 't', 'a', 'r', ' ' }, 6);
+	memcpy(header.posix.version, (char[]){ ' ', 0 }, 2);
+    }
 
-    strncpy(header.posix.gname, group->gr_name, sizeof(header.posix.gname));
+    strncpy(header.posix.uname, uname, sizeof(header.posix.uname));
+
+    strncpy(header.posix.gname, gname, sizeof(header.posix.gname));
 
     memset (header.posix.devmajor, 0, sizeof(header.posix.devmajor));
     memset (header.posix.devminor, 0, sizeof(header.posix.devminor));
     memset (header.posix.chksum, ' ', sizeof(header.posix.chksum));
     memset (header.posix.prefix, 0, sizeof(header.posix.prefix));
+
+    struct oldgnu_header * oldgnu = (void*) header.bytes;
+    size_t sparse_written = 0;
+
+    if (args.sparse && !args.pax)
+    {
+	// the first entries of the map are kept in the old GNU header, which uses the space of the prefix field
+	
+	header.posix.typeflag = GNUTYPE_SPARSE;
+	write_numeric (oldgnu->realsize, sizeof(oldgnu->realsize), sparse_size);
+	write_sparse_entries (oldgnu->sp, SPARSES_IN_OLDGNU_HEADER, args.sparse, sparse_size, &sparse_written);
+	oldgnu->isextended = sparse_written < sparse_entry_count (args.sparse, sparse_size);
+    }
     
     unsigned int checksum = 0;
 
     for (unsigned int i = 0; i < sizeof(header); i++)
     {
-	checksum += header.bytes[i];
+	checksum += (unsigned char) header.bytes[i];
     }
 
     snprintf (header.posix.chksum, sizeof(header.posix.chksum), "%07o", checksum);
@@ -215,9 +484,30 @@ keyargs_define(tar_write_header)
     window_append_bytes (args.output, (const unsigned char*) &header, sizeof(header));
     //buffer_append_n(*args.output, (char*)&header, sizeof(header));
 
+    if (args.sparse && !args.pax)
+    {
+	// the rest of the map follows in extension headers
+	
+	while (sparse_written < sparse_entry_count (args.sparse, sparse_size))
+	{
+	    struct sparse_header * extension = (void*) window_grow_bytes (args.output, TAR_BLOCK_SIZE);
+	    memset (extension, 0, TAR_BLOCK_SIZE);
+	    write_sparse_entries (extension->sp, SPARSES_IN_SPARSE_HEADER, args.sparse, sparse_size, &sparse_written);
+	    extension->isextended = sparse_written < sparse_entry_count (args.sparse, sparse_size);
+	}
+    }
+
+    window_append_bytes (args.output, sparse_map.region.begin, range_count (sparse_map.region));
+
+    window_clear (sparse_map);
+    window_clear (sparse_path);
+    tar_owner_cache_clear (&local_owners);
     return true;
     
 fail:
+    window_clear (sparse_map);
+    window_clear (sparse_path);
+    tar_owner_cache_clear (&local_owners);
     return false;
 }
 
@@ -256,33 +546,239 @@ void tar_write_end (window_unsigned_char * output)
     memset(window_grow_bytes (output, add_size), 0, add_size);
 }
 
-keyargs_define(tar_write_path_header)
+keyargs_define(tar_header_template_init)
+{
+    assert (args.template);
+
+    tar_header_template * template = args.template;
+    tar_owner_cache local_owners = {0};
+    tar_owner_cache * owners = args.owners ? args.owners : &local_owners;
+
+    *template = (tar_header_template){ .mode = args.mode, .uid = args.uid, .gid = args.gid, .owners = args.owners, .pax = args.pax };
+
+    const char * uname = args.uname;
+    tar_owner_resolve_user (owners, &template->uid, &uname);
+    strncpy (template->uname, uname, TAR_OWNER_NAME_SIZE);
+
+    const char * gname = args.gname;
+    tar_owner_resolve_group (owners, &template->gid, &gname);
+    strncpy (template->gname, gname, TAR_OWNER_NAME_SIZE);
+
+    tar_owner_cache_clear (&local_owners);
+
+    // the template is cut from a real header, so that its shared fields are exactly those tar_write_header writes
+
+    window_unsigned_char block = {0};
+
+    if (!tar_write_header (.output = &block,
+			   .name = "",
+			   .mode = template->mode,
+			   .uid = template->uid,
+			   .gid = template->gid,
+			   .type = TAR_FILE,
+			   .uname = template->uname,
+			   .gname = template->gname,
+			   .owners = template->owners,
+			   .pax = template->pax))
+    {
+	window_clear (block);
+	return false;
+    }
+
+    if (range_count (block.region) != TAR_BLOCK_SIZE)
+    {
+	// the shared fields need a pax header of their own
+	template->fallback = true;
+	window_clear (block);
+	return true;
+    }
+
+    memcpy (template->block, block.region.begin, TAR_BLOCK_SIZE);
+    window_clear (block);
+
+    struct posix_header * header = (void*) template->block;
+
+    memset (header->size, 0, sizeof(header->size));
+    memset (header->mtime, 0, sizeof(header->mtime));
+    memset (header->chksum, ' ', sizeof(header->chksum));
+    header->typeflag = 0;
+
+    template->checksum = 0;
+
+    for (unsigned int i = 0; i < sizeof(template->block); i++)
+    {
+	template->checksum += template->block[i];
+    }
+
+    return true;
+}
+
+static unsigned int write_octal_digits (char * field, size_t digits, unsigned long long value)
+{
+    unsigned int sum = 0;
+
+    for (size_t i = digits; i > 0; i--)
+    {
+	field[i - 1] = '0' + (value & 7);
+	sum += (unsigned char) field[i - 1];
+	value >>= 3;
+    }
+
+    return sum;
+}
+
+keyargs_define(tar_write_template_header)
 {
-    assert (args.path);
     assert (args.output);
-    
-    struct stat s;
+    assert (args.template);
+    assert (args.name);
 
-    if (-1 == lstat (args.path, &s))
+    const tar_header_template * template = args.template;
+    struct posix_header * header;
+
+    while (*args.name == PATH_SEPARATOR)
     {
-	perror (args.path);
-	log_fatal ("Failed to stat %s", args.path);
+	args.name++;
+    }
+
+    size_t name_size = strlen (args.name);
+    bool add_sep = args.type == TAR_DIR && !ends_with (args.name, PATH_SEPARATOR);
+
+    if (template->fallback
+	|| args.linkname
+	|| (args.type != TAR_FILE && args.type != TAR_DIR)
+	|| name_size + 1 + (add_sep ? 1 : 0) >= sizeof(header->name)
+	|| !fits_octal (sizeof(header->size), args.size)
+	|| !fits_octal (sizeof(header->mtime), args.mtime))
+    {
+	return tar_write_header (.output = args.output,
+				 .name = args.name,
+				 .mode = template->mode,
+				 .uid = template->uid,
+				 .gid = template->gid,
+				 .size = args.size,
+				 .mtime = args.mtime,
+				 .type = args.type,
+				 .linkname = args.linkname,
+				 .uname = template->uname,
+				 .gname = template->gname,
+				 .owners = template->owners,
+				 .pax = template->pax);
+    }
+
+    header = window_grow_bytes (args.output, TAR_BLOCK_SIZE);
+    memcpy (header, template->block, TAR_BLOCK_SIZE);
+
+    unsigned int checksum = template->checksum;
+
+    for (size_t i = 0; i < name_size; i++)
+    {
+	header->name[i] = args.name[i];
+	checksum += (unsigned char) args.name[i];
+    }
+
+    if (add_sep)
+    {
+	header->name[name_size] = PATH_SEPARATOR;
+	checksum += PATH_SEPARATOR;
     }
 
+    // the fields keep the terminating null of the template, as write_numeric would leave it
+
+    checksum += write_octal_digits (header->size, sizeof(header->size) - 1, args.size);
+    checksum += write_octal_digits (header->mtime, sizeof(header->mtime) - 1, args.mtime);
+
+    header->typeflag = args.type == TAR_DIR ? DIRTYPE : REGTYPE;
+    checksum += (unsigned char) header->typeflag;
+
+    // the checksum field is seven octal digits and a null, which replace the spaces that were counted in the sum
+
+    write_octal_digits (header->chksum, sizeof(header->chksum) - 1, checksum);
+    header->chksum[sizeof(header->chksum) - 1] = '\0';
+
+    return true;
+}
+
+keyargs_define(tar_write_stat_header)
+{
+    assert (args.stat);
+    assert (args.name);
+    assert (args.output);
+
     tar_type type =
-	S_ISREG(s.st_mode) ? TAR_FILE
-	: S_ISDIR(s.st_mode) ? TAR_DIR
-	: S_ISLNK(s.st_mode) ? TAR_SYMLINK
+	S_ISREG(args.stat->st_mode) ? TAR_FILE
+	: S_ISDIR(args.stat->st_mode) ? TAR_DIR
+	: S_ISLNK(args.stat->st_mode) ? TAR_SYMLINK
 	: TAR_ERROR;
 
     if (type == TAR_ERROR)
     {
-	log_fatal ("Could not identify a tar entry type for %s", args.path);
+	log_fatal ("Could not identify a tar entry type for %s", args.name);
+    }
+
+    if (type == TAR_SYMLINK && !args.linkname)
+    {
+	log_fatal ("No link target was given for symlink %s", args.name);
+    }
+
+    const char * linkname = type == TAR_SYMLINK ? args.linkname : NULL;
+
+    if (type == TAR_FILE && args.hardlinks)
+    {
+	const char * target = tar_hardlink_lookup (args.hardlinks, args.stat, args.path, args.name);
+
+	if (target)
+	{
+	    type = TAR_HARDLINK;
+	    linkname = target;
+	}
+    }
+    
+    if (!tar_write_header (.output = args.output,
+			   .name = args.name,
+			   .mode = args.stat->st_mode,
+			   .uid = args.stat->st_uid,
+			   .gid = args.stat->st_gid,
+			   .size = type == TAR_FILE ? args.stat->st_size : 0,
+			   .mtime = args.stat->st_mtime,
+			   .mtime_nsec = args.pax ? args.stat->st_mtim.tv_nsec : 0,
+			   .type = type,
+			   .linkname = linkname,
+			   .owners = args.owners,
+			   .pax = args.pax,
+			   .sparse = type == TAR_FILE ? args.sparse : NULL,
+			   .deleted = type == TAR_DIR ? args.deleted : NULL))
+    {
+	log_fatal ("Failed to write tar header");
+    }
+
+    if (args.detect_type)
+    {
+	*args.detect_type = type;
+    }
+
+    return true;
+
+fail:
+    return false;
+}
+
+keyargs_define(tar_write_path_header)
+{
+    assert (args.path);
+    assert (args.output);
+    
+    struct stat s;
+
+    if (-1 == lstat (args.path, &s))
+    {
+	perror (args.path);
+	log_fatal ("Failed to stat %s", args.path);
     }
 
     char linkname[PATH_MAX + 1] = {0};
 
-    if (type == TAR_SYMLINK)
+    if (S_ISLNK(s.st_mode))
     {
 	int linkname_length = readlink(args.path, linkname, sizeof(linkname));
 	
@@ -299,21 +795,17 @@ keyargs_define(tar_write_path_header)
 	linkname[linkname_length] = '\0';
     }
     
-    if (!tar_write_header (.output = args.output,
-			   .name = args.override_name ? args.override_name : args.path,
-			   .mode = s.st_mode,
-			   .uid = s.st_uid,
-			   .gid = s.st_gid,
-			   .size = s.st_size,
-			   .type = type,
-			   .linkname = (type == TAR_SYMLINK) ? linkname : NULL))
+    if (!tar_write_stat_header (.output = args.output,
+				.stat = &s,
+				.name = args.override_name ? args.override_name : args.path,
+				.linkname = linkname,
+				.detect_type = args.detect_type,
+				.owners = args.owners,
+				.pax = args.pax,
+				.hardlinks = args.hardlinks,
+				.path = args.path))
     {
-	log_fatal ("Failed to write tar header");
-    }
-
-    if (args.detect_type)
-    {
-	*args.detect_type = type;
+	return false;
     }
 
     if (args.detect_size)
@@ -327,20 +819,220 @@ fail:
     return false;
 }
 
+typedef enum {
+    COPY_DONE,
+    COPY_UNSUPPORTED,
+    COPY_FAILED,
+}
+    copy_result;
+
+static bool copy_unsupported (int error)
+{
+    return error == EINVAL || error == ENOSYS || error == EXDEV || error == EOPNOTSUPP || error == EBADF;
+}
+
+static copy_result copy_in_kernel (int output_fd, int input_fd, const char * path, unsigned long long size)
+{
+    // copy_file_range can share extents between files on the same filesystem, sendfile covers sockets and pipes. Either may be refused before anything is copied, in which case the caller falls back to copying through user space from the same file position.
+    
+    bool use_copy_file_range = true;
+    unsigned long long remaining = size;
+
+    while (remaining)
+    {
+	size_t want = remaining < SSIZE_MAX ? remaining : SSIZE_MAX;
+	
+	ssize_t copied = use_copy_file_range
+	    ? copy_file_range (input_fd, NULL, output_fd, NULL, want, 0)
+	    : sendfile (output_fd, input_fd, NULL, want);
+
+	if (copied < 0)
+	{
+	    if (errno == EINTR || errno == EAGAIN)
+	    {
+		continue;
+	    }
+
+	    if (remaining == size && copy_unsupported (errno))
+	    {
+		if (use_copy_file_range)
+		{
+		    use_copy_file_range = false;
+		    continue;
+		}
+
+		return COPY_UNSUPPORTED;
+	    }
+
+	    perror (path);
+	    return COPY_FAILED;
+	}
+
+	if (copied == 0)
+	{
+	    log_error ("%s was truncated while it was being written", path);
+	    return COPY_FAILED;
+	}
+
+	remaining -= copied;
+    }
+
+    return COPY_DONE;
+}
+
+static bool find_data_extents (window_tar_sparse_extent * map, int fd, unsigned long long size)
+{
+    // returns false if the filesystem cannot report holes, in which case the file is written whole
+    
+    off_t data = 0;
+
+    while ((unsigned long long) data < size)
+    {
+	data = lseek (fd, data, SEEK_DATA);
+
+	if (data < 0)
+	{
+	    // ENXIO means that the rest of the file is a hole
+	    
+	    return errno == ENXIO;
+	}
+
+	if ((unsigned long long) data >= size)
+	{
+	    break;
+	}
+
+	off_t hole = lseek (fd, data, SEEK_HOLE);
+
+	if (hole < 0)
+	{
+	    return false;
+	}
+
+	if ((unsigned long long) hole > size)
+	{
+	    hole = size;
+	}
+
+	*window_push (*map) = (tar_sparse_extent){ .offset = data, .size = hole - data };
+	data = hole;
+    }
+
+    return true;
+}
+
+static bool copy_extent_through_buffer (convert_sink * sink, window_unsigned_char * buffer, int fd, const char * path, const tar_sparse_extent * extent)
+{
+    unsigned long long done = 0;
+    bool error = false;
+
+    while (done < extent->size)
+    {
+	size_t want = extent->size - done < EXTENT_CHUNK_SIZE ? extent->size - done : EXTENT_CHUNK_SIZE;
+	unsigned char * chunk = window_grow_bytes (buffer, want);
+	ssize_t got = pread (fd, chunk, want, extent->offset + done);
+
+	if (got <= 0)
+	{
+	    buffer->region.end -= want;
+
+	    if (got < 0 && errno == EINTR)
+	    {
+		continue;
+	    }
+
+	    if (got < 0)
+	    {
+		perror (path);
+	    }
+	    else
+	    {
+		log_error ("%s was truncated while it was being written", path);
+	    }
+
+	    return false;
+	}
+
+	buffer->region.end -= want - got;
+	done += got;
+
+	if (!convert_drain (&error, sink))
+	{
+	    return false;
+	}
+
+	window_rewrite (*buffer);
+    }
+
+    return true;
+}
+
+static bool copy_extents (convert_sink * sink, window_unsigned_char * buffer, fd_sink * direct, int fd, const char * path, const range_tar_sparse_extent * map)
+{
+    // each extent is copied by the kernel from its own file position, until the kernel refuses a pair of files, after which extents are read through buffer
+    
+    bool in_kernel = direct != NULL;
+    bool error = false;
+
+    if (in_kernel && !convert_drain (&error, sink))
+    {
+	return false;
+    }
+
+    for (const tar_sparse_extent * extent = map->begin; extent < map->end; extent++)
+    {
+	copy_result copied = COPY_UNSUPPORTED;
+	
+	if (in_kernel)
+	{
+	    if ((off_t) -1 == lseek (fd, extent->offset, SEEK_SET))
+	    {
+		perror (path);
+		return false;
+	    }
+	    
+	    copied = copy_in_kernel (direct->fd, fd, path, extent->size);
+	    in_kernel = copied != COPY_UNSUPPORTED;
+	}
+
+	if (copied == COPY_UNSUPPORTED)
+	{
+	    copied = copy_extent_through_buffer (sink, buffer, fd, path, extent) ? COPY_DONE : COPY_FAILED;
+	}
+
+	if (copied != COPY_DONE)
+	{
+	    return false;
+	}
+    }
+
+    return true;
+}
+
 keyargs_define(tar_write_sink_path)
 {
     assert (args.buffer);
+
+    if (!args.sink && args.direct)
+    {
+	args.sink = &args.direct->sink;
+    }
+    
     assert (args.sink);
     
     args.sink->contents = &args.buffer->region.const_cast;
-    
+
+    size_t header_begin = range_count (args.buffer->region);
     tar_type type = TAR_ERROR;
     unsigned long long size = -1;
     if (!tar_write_path_header(.output = args.buffer,
 			       .detect_type = &type,
 			       .detect_size = &size,
 			       .path = args.path,
-			       .override_name = args.override_name))
+			       .override_name = args.override_name,
+			       .owners = args.owners,
+			       .pax = args.pax,
+			       .hardlinks = args.hardlinks))
     {
 	return false;
     }
@@ -355,9 +1047,11 @@ keyargs_define(tar_write_sink_path)
 	*args.detect_size = size;
     }
 
+    bool error = false;
+
     if (type != TAR_FILE)
     {
-	return true;
+	return convert_drain (&error, args.sink);
     }
     
     int file_fd = open (args.path, O_RDONLY);
@@ -368,20 +1062,99 @@ keyargs_define(tar_write_sink_path)
 	return false;
     }
 
-    fd_source fd_source = fd_source_init(.fd = file_fd, .contents = args.buffer);
+    window_tar_sparse_extent map = {0};
+    unsigned long long stored_size = 0;
+    bool has_holes = false;
+    struct stat file_stat;
 
-    bool join_success = convert_join (args.sink, &fd_source.source);
+    // a file with fewer blocks than its size needs may have holes, which is cheap to check before asking for its extents
     
-    convert_source_clear(&fd_source.source);
+    if (args.sparse && 0 == fstat (file_fd, &file_stat) && (unsigned long long) file_stat.st_blocks * 512 < (unsigned long long) file_stat.st_size && find_data_extents (&map, file_fd, file_stat.st_size))
+    {
+	for (const tar_sparse_extent * extent = map.region.begin; extent < map.region.end; extent++)
+	{
+	    stored_size += extent->size;
+	}
+
+	has_holes = stored_size < (unsigned long long) file_stat.st_size;
+    }
+
+    if (has_holes)
+    {
+	// the file has holes, so its header is replaced by one that carries the map
+	
+	args.buffer->region.end = args.buffer->region.begin + header_begin;
+	size = file_stat.st_size;
+
+	if (!tar_write_stat_header (.output = args.buffer,
+				    .stat = &file_stat,
+				    .name = args.override_name ? args.override_name : args.path,
+				    .owners = args.owners,
+				    .pax = args.pax,
+				    .sparse = &map.region))
+	{
+	    window_clear (map);
+	    close (file_fd);
+	    return false;
+	}
+
+	if (args.detect_size)
+	{
+	    *args.detect_size = size;
+	}
+
+	bool copied = copy_extents (args.sink, args.buffer, args.direct, file_fd, args.path, &map.region);
+
+	window_clear (map);
+	close (file_fd);
+
+	if (!copied)
+	{
+	    return false;
+	}
+
+	args.sink->contents = &args.buffer->region.const_cast;
+	tar_write_padding (args.buffer, stored_size);
+
+	return convert_drain (&error, args.sink);
+    }
+
+    window_clear (map);
+
+    copy_result copied = COPY_UNSUPPORTED;
+
+    if (args.direct)
+    {
+	if (!convert_drain (&error, args.sink))
+	{
+	    close (file_fd);
+	    return false;
+	}
+
+	copied = copy_in_kernel (args.direct->fd, file_fd, args.path, size);
+    }
+
+    if (copied == COPY_UNSUPPORTED)
+    {
+	fd_source fd_source = fd_source_init(.fd = file_fd, .contents = args.buffer);
+
+	bool join_success = convert_join (args.sink, &fd_source.source);
+    
+	convert_source_clear(&fd_source.source);
+
+	args.sink->contents = &args.buffer->region.const_cast;
+    
+	copied = join_success ? COPY_DONE : COPY_FAILED;
+    }
+
+    close (file_fd);
     
-    if (!join_success)
+    if (copied != COPY_DONE)
     {
 	return false;
     }
 
     tar_write_padding(args.buffer, size);
-	
-    bool error = false;
 
     return convert_drain (&error, args.sink);
 }
@@ -6,8 +6,11 @@
 #include "../window/def.h"
 #include "../convert/sink.h"
 #include "../convert/source.h"
+#include "../convert/fd/sink.h"
 #include "../keyargs/keyargs.h"
 #include "common.h"
+#include "owner.h"
+#include "hardlink.h"
 #endif
 
 /**
@@ -28,6 +31,11 @@ keyargs_declare(bool,tar_write_header,
 		const char * linkname;
 		const char * uname;
 		const char * gname;
+		tar_owner_cache * owners;
+		bool pax;
+		unsigned long mtime_nsec;
+		const range_tar_sparse_extent * sparse;
+		const range_const_char * deleted;
     );
 #define tar_write_header(...) keyargs_call(tar_write_header, __VA_ARGS__)
 /**<
@@ -40,10 +48,15 @@ keyargs_declare(bool,tar_write_header,
    @param gid This is the group id to be indicated by the new header. It can be left as 0 if gname is given as an argument.
    @param size If the new header is describing a file, longname, or longlink item, then this will indicate the size of the item. For other types of tar items, this should be left as 0.
    @param mtime The last time that the file was modified, in epoch seconds.
+   @param mtime_nsec The nanoseconds part of the modification time. This is only recorded when pax is set.
    @param type The type of this item - this argument accepts values enumerated in tar_type. However, TAR_ERROR and TAR_END may not be used here, and their use will result in an error.
    @param linkname If the new header is describing a hardlink or symlink, this indicates the destination it points to.
    @param uname This is the user name to be indicated by the new header. It overrides uid if both are given.
    @param gname This is the group name to be indicated by the new header. It overrides gid if both are given.
+   @param owners If non-null, user and group names are looked up through this cache, which should be kept for the life of the writer. If null, names are looked up for this header alone. Ids with no passwd or group entry are written with an empty name.
+   @param pax If true, names, link targets and numbers that do not fit in the ustar header are written in a preceding pax extended header rather than as GNU longname and longlink items or base-256 fields, and the header is marked as POSIX ustar. A number that does not fit then leaves its ustar field at the largest octal value the field holds.
+   @param sparse If non-null, the file is written as a sparse file whose data lies in these extents, and size gives its full size including holes. Only the contents of the extents, placed end to end, should then follow the header, and tar_write_padding should be given their total size. The map is written in the GNU sparse format, or in the GNU pax sparse format 1.0 if pax is set.
+   @param deleted If non-null and not empty, the header is for a directory from an incremental tar, and this holds the names of its entries that were deleted since the snapshot the tar was made against, each followed by a null as in a GNU dumpdir. The names are written in a TAR_PAX_DELETED record of a pax extended header, even when pax is not set. Readers that do not know the record ignore it, and see only the directory.
 */
 
 void tar_write_padding (window_unsigned_char * output, unsigned long long file_size);
@@ -56,18 +69,104 @@ void tar_write_end (window_unsigned_char * output);
    Writes a terminating sequence of tar sectors into the given output buffer, these will indicate the end of a tar file.
 */
 
+typedef struct tar_header_template tar_header_template;
+struct tar_header_template {
+    unsigned char block[TAR_BLOCK_SIZE]; ///< A header holding the shared fields, with the name, size, mtime and typeflag fields zeroed and the checksum field filled with spaces
+    unsigned int checksum; ///< The sum of the bytes of block
+    bool fallback; ///< True if the shared fields cannot be written in a single header block, in which case every header is written by tar_write_header
+    int mode; ///< The mode given to tar_header_template_init
+    unsigned int uid; ///< The resolved user id
+    unsigned int gid; ///< The resolved group id
+    char uname[TAR_OWNER_NAME_SIZE + 1]; ///< The resolved user name
+    char gname[TAR_OWNER_NAME_SIZE + 1]; ///< The resolved group name
+    tar_owner_cache * owners; ///< The cache given to tar_header_template_init
+    bool pax; ///< True if headers are written in pax format
+};
+/**< @struct tar_header_template
+   A header prepared by tar_header_template_init for many members that share a mode and owner, whose remaining fields are filled in by tar_write_template_header
+*/
+
+keyargs_declare(bool,tar_header_template_init,
+		tar_header_template * template;
+		int mode;
+		int uid;
+		int gid;
+		const char * uname;
+		const char * gname;
+		tar_owner_cache * owners;
+		bool pax;);
+#define tar_header_template_init(...) keyargs_call(tar_header_template_init, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that prepares a header template. The shared fields are formatted, and their bytes summed for the checksum, once for every header written from the template.
+   @return True if successful, false otherwise
+   @param template The template to prepare
+   @param mode, uid, gid, uname, gname, owners, pax These are as in tar_write_header. owners must outlive the template if it is given.
+*/
+
+keyargs_declare(bool,tar_write_template_header,
+		window_unsigned_char * output;
+		const tar_header_template * template;
+		const char * name;
+		unsigned long long size;
+		unsigned long long mtime;
+		tar_type type;
+		const char * linkname;);
+#define tar_write_template_header(...) keyargs_call(tar_write_template_header, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that writes a tar header from a template. It writes exactly what tar_write_header would for the same arguments and the template's shared fields, but a file or directory whose name, size and mtime fit in a ustar header is written by copying the template, filling in only those fields, and adding their bytes to the template's checksum. Other headers are written by tar_write_header.
+   @return True if successful, false otherwise
+   @param output, name, size, mtime, type, linkname These are as in tar_write_header
+   @param template A template prepared by tar_header_template_init
+*/
+
+struct stat;
+
+keyargs_declare(bool,tar_write_stat_header,
+		window_unsigned_char * output;
+		const struct stat * stat;
+		const char * name;
+		const char * linkname;
+		tar_type * detect_type;
+		tar_owner_cache * owners;
+		bool pax;
+		const range_tar_sparse_extent * sparse;
+		tar_hardlink_table * hardlinks;
+		const char * path;
+		const range_const_char * deleted;);
+#define tar_write_stat_header(...) keyargs_call(tar_write_stat_header, __VA_ARGS__)
+/**<
+   Generates a header for a file, directory, or symlink that has already been examined with lstat. tar_write_path_header uses this after examining the given path.
+   @param output The output buffer into which the new header will be written
+   @param stat The result of calling lstat on the entity to be described
+   @param name The name of the entity within the tar
+   @param linkname If the entity is a symlink, this is the destination it points to
+   @param detect_type If a non-null pointer is given here, its destination will be assigned to the detected tar_type of the entity.
+   @param owners An optional cache for user and group names, as in tar_write_header
+   @param pax If true, the header is written in pax format as in tar_write_header, including the sub-second part of the modification time
+   @param sparse If non-null, the entity is a file with these data extents, as in tar_write_header
+   @param hardlinks If non-null, a file with more than one link whose inode was already written through this table is written as a hardlink to the name it was first written under, and detect_type is set to TAR_HARDLINK. Otherwise, its inode is recorded in the table. If the table is in dedupe mode, a file whose contents match a file that was already written through it is also written as a hardlink to that file. The table should be kept for the life of the writer.
+   @param path The path of the entity, from which a file is read to compare its contents when hardlinks is in dedupe mode. If null, the file is not deduplicated.
+   @param deleted If the entity is a directory, the names of its entries that were deleted, as in tar_write_header
+*/
+
 keyargs_declare(bool,tar_write_path_header,
 		window_unsigned_char * output;
 		tar_type * detect_type;
 		unsigned long long * detect_size;
 		const char * path;
-		const char * override_name;);
+		const char * override_name;
+		tar_owner_cache * owners;
+		bool pax;
+		tar_hardlink_table * hardlinks;);
 #define tar_write_path_header(...) keyargs_call(tar_write_path_header, __VA_ARGS__)
 /**<
    Given a path to an existing file, directory, or symlink, this automatically generates a header based on the entity found at the given path.
    @param output The output buffer into which the new header will be written
    @param detect_type If a non-null pointer is given here, its destination will be assigned to the detected tar_type of the entity located at the given path.
    @param detect_size If a non-null pointer is given here, then its destination will be assigned to the size obtained from the stat function at the given path.
+   @param owners An optional cache for user and group names, as in tar_write_header
+   @param pax If true, the header is written in pax format as in tar_write_stat_header
+   @param hardlinks An optional table of inodes that have been written, as in tar_write_stat_header
 */
 
 keyargs_declare(bool,tar_write_sink_path,
@@ -76,8 +175,28 @@ keyargs_declare(bool,tar_write_sink_path,
 		tar_type * detect_type;
 		unsigned long long * detect_size;
 		const char * path;
-		const char * override_name;);
+		const char * override_name;
+		tar_owner_cache * owners;
+		bool pax;
+		fd_sink * direct;
+		bool sparse;
+		tar_hardlink_table * hardlinks;);
 #define tar_write_sink_path(...) keyargs_call(tar_write_sink_path, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that writes the header, contents and padding of an existing file, directory, or symlink to a sink.
+   @return True if successful, false otherwise
+   @param sink The sink to write to. This may be left null if direct is given.
+   @param buffer A buffer used to hold the header and padding, and the file contents when they are copied through user space
+   @param detect_type If non-null, its destination will be assigned to the detected tar_type of the entity
+   @param detect_size If non-null, its destination will be assigned to the size of the entity
+   @param path The path to the entity
+   @param override_name If non-null, this is the name used in the tar instead of the path
+   @param owners An optional cache for user and group names, as in tar_write_header
+   @param pax If true, the header is written in pax format as in tar_write_stat_header
+   @param direct If non-null, this is the fd_sink underlying sink. File contents are then moved from the file to its fd by the kernel with copy_file_range or sendfile, falling back to copying through buffer if neither is supported for the pair of files.
+   @param sparse If true, a file that occupies fewer blocks on disk than its size is searched for holes with SEEK_DATA and SEEK_HOLE. If it has any, it is written as a sparse file as in tar_write_header, so that its holes are neither read nor stored.
+   @param hardlinks An optional table of inodes that have been written, as in tar_write_stat_header. A file written as a hardlink has no contents, so it is not opened.
+*/
 
 bool tar_write_sink_end(convert_sink * sink);
 
@@ -0,0 +1,809 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zstd.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../window/alloc.h"
+#include "../keyargs/keyargs.h"
+#include "../convert/source.h"
+#include "../convert/sink.h"
+#include "zst.h"
+#include "../log/log.h"
+
+#define DEFAULT_BLOCK_SIZE (4 * 1024 * 1024)
+#define SEEKABLE_MAX_BLOCK_SIZE (1024 * 1024 * 1024)
+#define SKIPPABLE_MAGIC 0x184D2A5E
+#define SEEKABLE_MAGIC 0x8F92EAB1
+#define SEEK_TABLE_ENTRY_SIZE 8
+#define SEEK_TABLE_FOOTER_SIZE 9
+#define SKIPPABLE_HEADER_SIZE 8
+
+static void write_le32 (unsigned char * output, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+	output[i] = value & 0xff;
+	value >>= 8;
+    }
+}
+
+static uint32_t read_le32 (const unsigned char * input)
+{
+    return input[0] | (uint32_t) input[1] << 8 | (uint32_t) input[2] << 16 | (uint32_t) input[3] << 24;
+}
+
+static bool zst_source_read (bool * error, convert_source * source)
+{
+    tar_zst_source * zst = (tar_zst_source*) source;
+
+    if (!zst->stream && !(zst->stream = ZSTD_createDStream()))
+    {
+	log_fatal ("Failed to initialize zstd decompression");
+    }
+
+    size_t chunk_size = ZSTD_DStreamOutSize();
+
+    while (!zst->finished)
+    {
+	// the decoder may hold output from earlier input, so it is run before more input is read
+	
+	window_unsigned_char * input_window = zst->input->contents;
+	
+	ZSTD_inBuffer input = { .src = input_window->region.begin, .size = range_count (input_window->region) };
+	ZSTD_outBuffer output = { .dst = window_grow_bytes (source->contents, chunk_size), .size = chunk_size };
+
+	size_t hint = ZSTD_decompressStream (zst->stream, &output, &input);
+
+	input_window->region.begin += input.pos;
+	source->contents->region.end -= chunk_size - output.pos;
+
+	if (ZSTD_isError (hint))
+	{
+	    log_fatal ("Zstd decompression failed: %s", ZSTD_getErrorName (hint));
+	}
+
+	// a hint of 0 means a frame was completed and flushed, so the input may end here
+	
+	zst->in_frame = hint != 0;
+
+	if (output.pos)
+	{
+	    return true;
+	}
+
+	if (range_is_empty (input_window->region) && !convert_fill (error, zst->input))
+	{
+	    if (*error)
+	    {
+		log_fatal ("Failed to read zstd input");
+	    }
+
+	    if (zst->in_frame)
+	    {
+		log_fatal ("Zstd input is truncated");
+	    }
+
+	    zst->finished = true;
+	}
+    }
+
+    return false;
+
+fail:
+    *error = true;
+    return false;
+}
+
+static void zst_source_clear (convert_source * source)
+{
+    tar_zst_source * zst = (tar_zst_source*) source;
+
+    ZSTD_freeDStream (zst->stream);
+    zst->stream = NULL;
+}
+
+keyargs_define(tar_zst_source_init)
+{
+    assert (args.input);
+    assert (args.contents);
+
+    return (tar_zst_source){
+	.source = { .contents = args.contents, .read = zst_source_read, .clear = zst_source_clear },
+	.input = args.input,
+    };
+}
+
+static bool zst_sink_compress (tar_zst_sink * zst, range_const_unsigned_char * contents, ZSTD_EndDirective mode)
+{
+    if (!zst->stream)
+    {
+	if (!(zst->stream = ZSTD_createCStream()))
+	{
+	    log_fatal ("Failed to initialize zstd compression");
+	}
+
+	if (ZSTD_isError (ZSTD_CCtx_setParameter (zst->stream, ZSTD_c_compressionLevel, zst->level ? zst->level : ZSTD_CLEVEL_DEFAULT)))
+	{
+	    log_fatal ("Invalid zstd compression level %d", zst->level);
+	}
+    }
+
+    size_t chunk_size = ZSTD_CStreamOutSize();
+    
+    ZSTD_inBuffer input = { .src = contents->begin, .size = range_count (*contents) };
+    size_t remaining;
+
+    do
+    {
+	ZSTD_outBuffer output = { .dst = window_grow_bytes (&zst->buffer, chunk_size), .size = chunk_size };
+
+	remaining = ZSTD_compressStream2 (zst->stream, &output, &input, mode);
+
+	zst->buffer.region.end -= chunk_size - output.pos;
+
+	if (ZSTD_isError (remaining))
+	{
+	    log_fatal ("Zstd compression failed: %s", ZSTD_getErrorName (remaining));
+	}
+    }
+    while (mode == ZSTD_e_end ? remaining != 0 : input.pos < input.size);
+
+    contents->begin += input.pos;
+
+    bool error = false;
+
+    zst->output->contents = &zst->buffer.region.const_cast;
+
+    if (!convert_drain (&error, zst->output))
+    {
+	log_fatal ("Failed to write zstd output");
+    }
+
+    window_rewrite (zst->buffer);
+
+    return true;
+
+fail:
+    return false;
+}
+
+static bool zst_sink_write (bool * error, convert_sink * sink)
+{
+    if (!zst_sink_compress ((tar_zst_sink*) sink, sink->contents, ZSTD_e_continue))
+    {
+	*error = true;
+	return false;
+    }
+
+    return true;
+}
+
+static void zst_sink_clear (convert_sink * sink)
+{
+    tar_zst_sink * zst = (tar_zst_sink*) sink;
+
+    ZSTD_freeCStream (zst->stream);
+    zst->stream = NULL;
+    window_clear (zst->buffer);
+}
+
+keyargs_define(tar_zst_sink_init)
+{
+    assert (args.output);
+
+    return (tar_zst_sink){
+	.sink = { .write = zst_sink_write, .clear = zst_sink_clear },
+	.output = args.output,
+	.level = args.level,
+    };
+}
+
+bool tar_zst_sink_finish (tar_zst_sink * sink)
+{
+    range_const_unsigned_char rest = {0};
+
+    if (sink->sink.contents)
+    {
+	rest = *sink->sink.contents;
+	sink->sink.contents->begin = sink->sink.contents->end;
+    }
+
+    return zst_sink_compress (sink, &rest, ZSTD_e_end);
+}
+
+typedef enum {
+    BLOCK_FILLING,
+    BLOCK_QUEUED,
+    BLOCK_COMPRESSING,
+    BLOCK_DONE,
+}
+    block_status;
+
+typedef struct zst_block zst_block;
+struct zst_block
+{
+    block_status status;
+    bool error;
+    window_unsigned_char input;
+    window_unsigned_char output;
+};
+
+struct tar_zst_pool
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pthread_t * threads;
+    unsigned int started;
+    int level;
+    zst_block * blocks;
+    size_t block_count;
+    size_t next_write; ///< The index of the oldest block that has not been written
+    size_t next_compress; ///< The index of the oldest block that has not been claimed by a thread
+    size_t filling; ///< The index of the block being filled by the writer
+    bool stop;
+    window_unsigned_char seek_table; ///< The seek table entries of the frames written so far
+};
+
+static void * compress_thread (void * arg)
+{
+    tar_zst_pool * pool = arg;
+    ZSTD_CCtx * context = ZSTD_createCCtx();
+
+    if (context)
+    {
+	ZSTD_CCtx_setParameter (context, ZSTD_c_compressionLevel, pool->level);
+    }
+
+    pthread_mutex_lock (&pool->mutex);
+
+    while (true)
+    {
+	while (!pool->stop && pool->next_compress == pool->filling)
+	{
+	    pthread_cond_wait (&pool->changed, &pool->mutex);
+	}
+
+	if (pool->stop)
+	{
+	    break;
+	}
+
+	zst_block * block = pool->blocks + pool->next_compress++ % pool->block_count;
+
+	assert (block->status == BLOCK_QUEUED);
+	block->status = BLOCK_COMPRESSING;
+
+	pthread_mutex_unlock (&pool->mutex);
+
+	size_t input_size = range_count (block->input.region);
+	size_t bound = ZSTD_compressBound (input_size);
+
+	window_rewrite (block->output);
+	
+	size_t size = context
+	    ? ZSTD_compress2 (context, window_grow_bytes (&block->output, bound), bound, block->input.region.begin, input_size)
+	    : (size_t) -1;
+
+	block->output.region.end -= bound;
+
+	if (!context || ZSTD_isError (size))
+	{
+	    block->error = true;
+	}
+	else
+	{
+	    block->output.region.end += size;
+	}
+
+	pthread_mutex_lock (&pool->mutex);
+
+	block->status = BLOCK_DONE;
+	pthread_cond_broadcast (&pool->changed);
+    }
+
+    pthread_mutex_unlock (&pool->mutex);
+
+    ZSTD_freeCCtx (context);
+
+    return NULL;
+}
+
+static void pool_stop (tar_zst_pool * pool)
+{
+    pthread_mutex_lock (&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast (&pool->changed);
+    pthread_mutex_unlock (&pool->mutex);
+
+    for (unsigned int i = 0; i < pool->started; i++)
+    {
+	pthread_join (pool->threads[i], NULL);
+    }
+
+    pool->started = 0;
+}
+
+static tar_zst_pool * pool_start (tar_zst_parallel_sink * sink)
+{
+    tar_zst_pool * pool = calloc (1, sizeof(*pool));
+
+    *pool = (tar_zst_pool){
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.changed = PTHREAD_COND_INITIALIZER,
+	.level = sink->level ? sink->level : ZSTD_CLEVEL_DEFAULT,
+	.block_count = sink->max_blocks,
+    };
+
+    pool->blocks = calloc (pool->block_count, sizeof(*pool->blocks));
+    pool->threads = calloc (sink->threads, sizeof(*pool->threads));
+
+    for (; pool->started < sink->threads; pool->started++)
+    {
+	if (pthread_create (pool->threads + pool->started, NULL, compress_thread, pool))
+	{
+	    break;
+	}
+    }
+
+    if (!pool->started)
+    {
+	log_error ("Failed to start zstd compression threads");
+	free (pool->threads);
+	free (pool->blocks);
+	free (pool);
+	return NULL;
+    }
+
+    return pool;
+}
+
+static bool write_block (tar_zst_parallel_sink * sink, zst_block * block)
+{
+    if (block->error)
+    {
+	log_error ("Zstd compression failed");
+	return false;
+    }
+
+    bool error = false;
+
+    sink->output->contents = &block->output.region.const_cast;
+
+    return convert_drain (&error, sink->output);
+}
+
+static bool write_done_blocks (tar_zst_parallel_sink * sink, size_t until, bool wait)
+{
+    // writes blocks in order until the index 'until', waiting for them to be compressed only if 'wait' is set
+
+    tar_zst_pool * pool = sink->pool;
+
+    pthread_mutex_lock (&pool->mutex);
+
+    while (pool->next_write < until)
+    {
+	zst_block * block = pool->blocks + pool->next_write % pool->block_count;
+
+	if (block->status != BLOCK_DONE)
+	{
+	    if (!wait)
+	    {
+		break;
+	    }
+	    
+	    pthread_cond_wait (&pool->changed, &pool->mutex);
+	    continue;
+	}
+
+	pthread_mutex_unlock (&pool->mutex);
+
+	if (sink->seekable)
+	{
+	    unsigned char * entry = window_grow_bytes (&pool->seek_table, SEEK_TABLE_ENTRY_SIZE);
+	    write_le32 (entry, range_count (block->output.region));
+	    write_le32 (entry + 4, range_count (block->input.region));
+	}
+
+	bool written = write_block (sink, block);
+
+	pthread_mutex_lock (&pool->mutex);
+
+	if (!written)
+	{
+	    pthread_mutex_unlock (&pool->mutex);
+	    return false;
+	}
+
+	window_rewrite (block->input);
+	block->status = BLOCK_FILLING;
+	pool->next_write++;
+    }
+
+    pthread_mutex_unlock (&pool->mutex);
+
+    return true;
+}
+
+static bool submit_block (tar_zst_parallel_sink * sink)
+{
+    tar_zst_pool * pool = sink->pool;
+
+    pthread_mutex_lock (&pool->mutex);
+    pool->blocks[pool->filling % pool->block_count].status = BLOCK_QUEUED;
+    pool->filling++;
+    pthread_cond_broadcast (&pool->changed);
+    pthread_mutex_unlock (&pool->mutex);
+
+    if (!write_done_blocks (sink, pool->filling, false))
+    {
+	return false;
+    }
+
+    // the next block to fill must have been written before it is reused
+    
+    return pool->filling < pool->block_count || write_done_blocks (sink, pool->filling + 1 - pool->block_count, true);
+}
+
+static bool zst_parallel_sink_write (bool * error, convert_sink * sink)
+{
+    tar_zst_parallel_sink * parallel = (tar_zst_parallel_sink*) sink;
+
+    if (!parallel->pool && !(parallel->pool = pool_start (parallel)))
+    {
+	*error = true;
+	return false;
+    }
+
+    tar_zst_pool * pool = parallel->pool;
+
+    while (!range_is_empty (*sink->contents))
+    {
+	zst_block * block = pool->blocks + pool->filling % pool->block_count;
+
+	size_t want = parallel->block_size - range_count (block->input.region);
+	size_t have = range_count (*sink->contents);
+	size_t take = want < have ? want : have;
+
+	window_append_bytes (&block->input, sink->contents->begin, take);
+	sink->contents->begin += take;
+
+	if ((size_t) range_count (block->input.region) == parallel->block_size && !submit_block (parallel))
+	{
+	    *error = true;
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+static void zst_parallel_sink_clear (convert_sink * sink)
+{
+    tar_zst_parallel_sink * parallel = (tar_zst_parallel_sink*) sink;
+    tar_zst_pool * pool = parallel->pool;
+
+    if (!pool)
+    {
+	return;
+    }
+
+    pool_stop (pool);
+
+    for (size_t i = 0; i < pool->block_count; i++)
+    {
+	window_clear (pool->blocks[i].input);
+	window_clear (pool->blocks[i].output);
+    }
+
+    window_clear (pool->seek_table);
+    pthread_mutex_destroy (&pool->mutex);
+    pthread_cond_destroy (&pool->changed);
+    free (pool->threads);
+    free (pool->blocks);
+    free (pool);
+    parallel->pool = NULL;
+}
+
+keyargs_define(tar_zst_parallel_sink_init)
+{
+    assert (args.output);
+
+    if (!args.threads)
+    {
+	long online = sysconf (_SC_NPROCESSORS_ONLN);
+	args.threads = online > 0 ? online : 1;
+    }
+
+    if (!args.block_size)
+    {
+	args.block_size = DEFAULT_BLOCK_SIZE;
+    }
+
+    if (!args.max_blocks)
+    {
+	args.max_blocks = 2 * args.threads;
+    }
+
+    if (args.max_blocks < 2)
+    {
+	args.max_blocks = 2;
+    }
+
+    if (args.seekable && args.block_size > SEEKABLE_MAX_BLOCK_SIZE)
+    {
+	args.block_size = SEEKABLE_MAX_BLOCK_SIZE;
+    }
+
+    return (tar_zst_parallel_sink){
+	.sink = { .write = zst_parallel_sink_write, .clear = zst_parallel_sink_clear },
+	.output = args.output,
+	.level = args.level,
+	.threads = args.threads,
+	.block_size = args.block_size,
+	.max_blocks = args.max_blocks,
+	.seekable = args.seekable,
+    };
+}
+
+static bool write_seek_table (tar_zst_parallel_sink * sink)
+{
+    window_unsigned_char table = {0};
+
+    size_t entries_size = sink->pool ? range_count (sink->pool->seek_table.region) : 0;
+    
+    unsigned char * header = window_grow_bytes (&table, SKIPPABLE_HEADER_SIZE);
+    write_le32 (header, SKIPPABLE_MAGIC);
+    write_le32 (header + 4, entries_size + SEEK_TABLE_FOOTER_SIZE);
+
+    if (entries_size)
+    {
+	window_append_bytes (&table, sink->pool->seek_table.region.begin, entries_size);
+    }
+
+    unsigned char * footer = window_grow_bytes (&table, SEEK_TABLE_FOOTER_SIZE);
+    write_le32 (footer, entries_size / SEEK_TABLE_ENTRY_SIZE);
+    footer[4] = 0; // no checksums
+    write_le32 (footer + 5, SEEKABLE_MAGIC);
+
+    bool error = false;
+
+    sink->output->contents = &table.region.const_cast;
+
+    bool retval = convert_drain (&error, sink->output);
+
+    window_clear (table);
+
+    return retval;
+}
+
+bool tar_zst_parallel_sink_end_frame (tar_zst_parallel_sink * sink)
+{
+    bool error = false;
+
+    if (sink->sink.contents && !range_is_empty (*sink->sink.contents) && !zst_parallel_sink_write (&error, &sink->sink))
+    {
+	return false;
+    }
+
+    if (!sink->pool || range_is_empty (sink->pool->blocks[sink->pool->filling % sink->pool->block_count].input.region))
+    {
+	return true;
+    }
+
+    return submit_block (sink);
+}
+
+bool tar_zst_parallel_sink_finish (tar_zst_parallel_sink * sink)
+{
+    if (!tar_zst_parallel_sink_end_frame (sink))
+    {
+	return false;
+    }
+
+    if (sink->pool && !write_done_blocks (sink, sink->pool->filling, true))
+    {
+	return false;
+    }
+
+    return !sink->seekable || write_seek_table (sink);
+}
+
+bool tar_zst_seek_table_load (tar_zst_seek_table * table, int fd)
+{
+    window_rewrite (table->frames);
+    
+    off_t file_size = lseek (fd, 0, SEEK_END);
+    unsigned char footer[SEEK_TABLE_FOOTER_SIZE];
+
+    if (file_size < SKIPPABLE_HEADER_SIZE + SEEK_TABLE_FOOTER_SIZE
+	|| sizeof(footer) != pread (fd, footer, sizeof(footer), file_size - sizeof(footer))
+	|| read_le32 (footer + 5) != SEEKABLE_MAGIC)
+    {
+	log_fatal ("File is not a seekable zstd file");
+    }
+
+    if (footer[4] & 0x7c)
+    {
+	log_fatal ("Seek table descriptor has reserved bits set");
+    }
+
+    size_t entry_size = footer[4] & 0x80 ? SEEK_TABLE_ENTRY_SIZE + 4 : SEEK_TABLE_ENTRY_SIZE;
+    uint64_t count = read_le32 (footer);
+    uint64_t table_size = SKIPPABLE_HEADER_SIZE + count * entry_size + SEEK_TABLE_FOOTER_SIZE;
+
+    if (table_size > (uint64_t) file_size)
+    {
+	log_fatal ("Seek table is larger than its file");
+    }
+
+    window_unsigned_char entries = {0};
+    unsigned char * input = window_grow_bytes (&entries, table_size);
+
+    if ((ssize_t) table_size != pread (fd, input, table_size, file_size - table_size))
+    {
+	window_clear (entries);
+	log_fatal ("Failed to read seek table");
+    }
+
+    if (read_le32 (input) != SKIPPABLE_MAGIC || read_le32 (input + 4) != table_size - SKIPPABLE_HEADER_SIZE)
+    {
+	window_clear (entries);
+	log_fatal ("Seek table frame header is invalid");
+    }
+
+    tar_zst_frame position = {0};
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+	const unsigned char * entry = input + SKIPPABLE_HEADER_SIZE + i * entry_size;
+	
+	*window_push (table->frames) = position;
+	position.compressed_offset += read_le32 (entry);
+	position.offset += read_le32 (entry + 4);
+    }
+
+    *window_push (table->frames) = position;
+
+    window_clear (entries);
+
+    if (position.compressed_offset != (uint64_t) file_size - table_size)
+    {
+	log_fatal ("Seek table does not match the size of its file");
+    }
+
+    return true;
+
+fail:
+    return false;
+}
+
+size_t tar_zst_seek_table_find (const tar_zst_seek_table * table, unsigned long long offset)
+{
+    // binary search for the last frame that starts at or before offset, ignoring the final entry that marks the end
+
+    const tar_zst_frame * frames = table->frames.region.begin;
+    size_t count = range_count (table->frames.region) - 1;
+
+    if (offset >= frames[count].offset)
+    {
+	return count;
+    }
+    
+    size_t begin = 0;
+    size_t end = count;
+
+    while (end - begin > 1)
+    {
+	size_t middle = begin + (end - begin) / 2;
+
+	if (frames[middle].offset <= offset)
+	{
+	    begin = middle;
+	}
+	else
+	{
+	    end = middle;
+	}
+    }
+
+    return begin;
+}
+
+bool tar_zst_read_frame (window_unsigned_char * output, int fd, const tar_zst_seek_table * table, size_t frame)
+{
+    const tar_zst_frame * begin = table->frames.region.begin + frame;
+    const tar_zst_frame * end = begin + 1;
+
+    assert (end < table->frames.region.end);
+
+    size_t compressed_size = end->compressed_offset - begin->compressed_offset;
+    size_t size = end->offset - begin->offset;
+
+    unsigned char * compressed = malloc (compressed_size);
+
+    if (!compressed)
+    {
+	log_fatal ("Failed to allocate a buffer for a zstd frame");
+    }
+
+    if ((ssize_t) compressed_size != pread (fd, compressed, compressed_size, begin->compressed_offset))
+    {
+	free (compressed);
+	log_fatal ("Failed to read zstd frame %zu", frame);
+    }
+
+    size_t result = ZSTD_decompress (window_grow_bytes (output, size), size, compressed, compressed_size);
+
+    free (compressed);
+
+    if (ZSTD_isError (result) || result != size)
+    {
+	output->region.end -= size;
+	log_fatal ("Failed to decompress zstd frame %zu: %s", frame, ZSTD_isError (result) ? ZSTD_getErrorName (result) : "wrong size");
+    }
+
+    return true;
+
+fail:
+    return false;
+}
+
+void tar_zst_seek_table_clear (tar_zst_seek_table * table)
+{
+    window_clear (table->frames);
+}
+
+static bool zst_seekable_source_read (bool * error, convert_source * source)
+{
+    tar_zst_seekable_source * seekable = (tar_zst_seekable_source*) source;
+
+    if (seekable->frame + 1 >= (size_t) range_count (seekable->table->frames.region))
+    {
+	return false;
+    }
+
+    size_t had = range_count (source->contents->region);
+
+    if (!tar_zst_read_frame (source->contents, seekable->fd, seekable->table, seekable->frame))
+    {
+	*error = true;
+	return false;
+    }
+
+    seekable->frame++;
+
+    if (seekable->skip)
+    {
+	unsigned char * frame_begin = source->contents->region.begin + had;
+	size_t frame_size = range_count (source->contents->region) - had;
+	
+	memmove (frame_begin, frame_begin + seekable->skip, frame_size - seekable->skip);
+	source->contents->region.end -= seekable->skip;
+	seekable->skip = 0;
+    }
+
+    return true;
+}
+
+keyargs_define(tar_zst_seekable_source_init)
+{
+    assert (args.table);
+    assert (args.contents);
+
+    size_t frame = tar_zst_seek_table_find (args.table, args.offset);
+
+    return (tar_zst_seekable_source){
+	.source = { .contents = args.contents, .read = zst_seekable_source_read },
+	.fd = args.fd,
+	.table = args.table,
+	.frame = frame,
+	.skip = frame + 1 < (size_t) range_count (args.table->frames.region) ? args.offset - args.table->frames.region.begin[frame].offset : 0,
+    };
+}
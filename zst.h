@@ -0,0 +1,183 @@
+#ifndef FLAT_INCLUDES
+#include <stdio.h>
+#include <stdbool.h>
+#include <zstd.h>
+#define FLAT_INCLUDES
+#include "../range/def.h"
+#include "../window/def.h"
+#include "../convert/source.h"
+#include "../convert/sink.h"
+#include "../keyargs/keyargs.h"
+#endif
+
+/**
+   @file tar/zst.h
+   Describes a zstd decompressing source and a zstd compressing sink, so that a .tar.zst can be read or written in one process. The source reads compressed bytes from another source and may be given to tar_state.source. The sink compresses the bytes given to it and writes them to another sink, and may be given to tar_write_sink_path, tar_write_sink_paths, and tar_write_sink_end.
+*/
+
+typedef struct tar_zst_source tar_zst_source;
+struct tar_zst_source {
+    convert_source source; ///< The decompressed contents, to be read through convert functions
+    convert_source * input; ///< The source of compressed contents
+    ZSTD_DStream * stream; ///< The zstd state, which is created on the first read
+    bool finished; ///< True if the compressed input has ended
+    bool in_frame; ///< True if a frame has been started but not yet completed
+};
+/**< @struct tar_zst_source
+   A source that decompresses zstd data read from another source. Concatenated zstd frames are decompressed as one stream.
+*/
+
+keyargs_declare(tar_zst_source,tar_zst_source_init,
+		convert_source * input;
+		window_unsigned_char * contents;);
+#define tar_zst_source_init(...) keyargs_call(tar_zst_source_init, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that creates a zstd decompressing source. It must be cleared with convert_source_clear.
+   @param input The source of compressed contents
+   @param contents The buffer into which decompressed contents are written
+*/
+
+typedef struct tar_zst_sink tar_zst_sink;
+struct tar_zst_sink {
+    convert_sink sink; ///< Accepts the uncompressed contents through convert functions
+    convert_sink * output; ///< The sink to which compressed contents are written
+    window_unsigned_char buffer; ///< Holds compressed contents on their way to output
+    ZSTD_CStream * stream; ///< The zstd state, which is created on the first write
+    int level; ///< The compression level
+};
+/**< @struct tar_zst_sink
+   A sink that compresses its contents with zstd and writes them to another sink.
+*/
+
+keyargs_declare(tar_zst_sink,tar_zst_sink_init,
+		convert_sink * output;
+		int level;);
+#define tar_zst_sink_init(...) keyargs_call(tar_zst_sink_init, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that creates a zstd compressing sink. It must be finished with tar_zst_sink_finish and then cleared with convert_sink_clear.
+   @param output The sink to which compressed contents are written
+   @param level The zstd compression level. If 0, zstd's default level is used.
+*/
+
+bool tar_zst_sink_finish (tar_zst_sink * sink);
+/**<
+   @brief Compresses anything still held by the sink, ends the zstd frame, and drains it to the output. Call this after tar_write_sink_end.
+   @return True if successful, false otherwise
+*/
+
+typedef struct tar_zst_pool tar_zst_pool;
+
+typedef struct tar_zst_parallel_sink tar_zst_parallel_sink;
+struct tar_zst_parallel_sink {
+    convert_sink sink; ///< Accepts the uncompressed contents through convert functions
+    convert_sink * output; ///< The sink to which compressed frames are written
+    int level; ///< The compression level
+    unsigned int threads; ///< The number of compressing threads
+    size_t block_size; ///< The number of uncompressed bytes in each frame
+    unsigned int max_blocks; ///< The number of blocks that may be filling, compressing, or waiting to be written at once
+    bool seekable; ///< True if a seek table is written after the frames
+    tar_zst_pool * pool; ///< The threads and blocks, which are created on the first write
+};
+/**< @struct tar_zst_parallel_sink
+   A sink that splits its contents into fixed size blocks and compresses each block into an independent zstd frame on a pool of threads. The frames are written to the output in order by the thread that writes to this sink, so the output is one valid zstd stream that any zstd decoder, including tar_zst_source, reads as a whole. Because blocks do not share history, the output is somewhat larger than that of tar_zst_sink at the same level.
+*/
+
+keyargs_declare(tar_zst_parallel_sink,tar_zst_parallel_sink_init,
+		convert_sink * output;
+		int level;
+		unsigned int threads;
+		size_t block_size;
+		unsigned int max_blocks;
+		bool seekable;);
+#define tar_zst_parallel_sink_init(...) keyargs_call(tar_zst_parallel_sink_init, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that creates a multithreaded zstd compressing sink. It must be finished with tar_zst_parallel_sink_finish and then cleared with convert_sink_clear.
+   @param output The sink to which compressed frames are written
+   @param level The zstd compression level. If 0, zstd's default level is used.
+   @param threads The number of compressing threads. If 0, one thread per online processor is used.
+   @param block_size The number of uncompressed bytes in each frame. If 0, a default of 4 MiB is used.
+   @param max_blocks The number of blocks in flight, which bounds memory use to about twice this many blocks. Writes to the sink wait for earlier frames to be written once this many are in flight. If 0, twice the number of threads is used.
+   @param seekable If true, the output is written in the zstd seekable format: tar_zst_parallel_sink_finish appends a seek table, in a skippable frame that other zstd decoders ignore, which gives the compressed and uncompressed size of every frame. block_size is limited to 1 GiB in this mode, so that sizes fit the table.
+*/
+
+bool tar_zst_parallel_sink_end_frame (tar_zst_parallel_sink * sink);
+/**<
+   @brief Ends the current frame early, so that the next byte written to the sink starts a new frame. Calling this after each member is written gives a seekable archive in which every member starts on a frame boundary, at some cost in compression.
+   @return True if successful, false otherwise
+*/
+
+bool tar_zst_parallel_sink_finish (tar_zst_parallel_sink * sink);
+/**<
+   @brief Compresses the final partial block, waits for every frame to be compressed, and writes them to the output. Call this after tar_write_sink_end.
+   @return True if successful, false otherwise
+*/
+
+typedef struct tar_zst_frame tar_zst_frame;
+struct tar_zst_frame {
+    unsigned long long compressed_offset; ///< The offset of the frame in the compressed file
+    unsigned long long offset; ///< The offset of the frame's first byte in the uncompressed stream
+};
+/**< @struct tar_zst_frame
+   The location of a frame in a seekable zstd file
+*/
+
+range_typedef(tar_zst_frame, tar_zst_frame);
+window_typedef(tar_zst_frame, tar_zst_frame);
+
+typedef struct tar_zst_seek_table tar_zst_seek_table;
+struct tar_zst_seek_table {
+    window_tar_zst_frame frames; ///< Every frame in order, followed by one more entry giving the end of the last frame
+};
+/**< @struct tar_zst_seek_table
+   The seek table of a seekable zstd file
+*/
+
+bool tar_zst_seek_table_load (tar_zst_seek_table * table, int fd);
+/**<
+   @brief Reads the seek table from the end of a seekable zstd file.
+   @return True if successful, false if the file has no valid seek table
+*/
+
+size_t tar_zst_seek_table_find (const tar_zst_seek_table * table, unsigned long long offset);
+/**<
+   @brief Finds the frame that holds a given offset in the uncompressed stream.
+   @return The index of the frame, or the number of frames if the offset is past the end of the stream
+*/
+
+bool tar_zst_read_frame (window_unsigned_char * output, int fd, const tar_zst_seek_table * table, size_t frame);
+/**<
+   @brief Decompresses a single frame of a seekable zstd file and appends it to output. This reads the file with pread and keeps no state between calls, so different frames may be decompressed on different threads at once.
+   @return True if successful, false otherwise
+*/
+
+void tar_zst_seek_table_clear (tar_zst_seek_table * table);
+/**<
+   @brief Frees the memory held by a seek table.
+*/
+
+typedef struct tar_zst_seekable_source tar_zst_seekable_source;
+struct tar_zst_seekable_source {
+    convert_source source; ///< The decompressed contents, to be read through convert functions
+    int fd; ///< The seekable zstd file
+    const tar_zst_seek_table * table; ///< The seek table of fd
+    size_t frame; ///< The next frame to be decompressed
+    size_t skip; ///< The number of bytes at the start of the next frame that come before the requested offset
+};
+/**< @struct tar_zst_seekable_source
+   A source that decompresses a seekable zstd file starting from any offset in the uncompressed stream, by decompressing only the frames from the one that holds that offset onwards.
+*/
+
+keyargs_declare(tar_zst_seekable_source,tar_zst_seekable_source_init,
+		int fd;
+		const tar_zst_seek_table * table;
+		window_unsigned_char * contents;
+		unsigned long long offset;);
+#define tar_zst_seekable_source_init(...) keyargs_call(tar_zst_seekable_source_init, __VA_ARGS__)
+/**<
+   @brief This is a keyargs function that creates a source that reads a seekable zstd file from a given offset.
+   To read a single member of a tar, give this the header_offset of its tar_index_entry, and use the result as the source of a new tar_state whose offset.position is set to the same offset. tar_update then reads the member's headers as usual.
+   @param fd The seekable zstd file
+   @param table The seek table of fd, as read by tar_zst_seek_table_load
+   @param contents The buffer into which decompressed contents are written
+   @param offset The offset in the uncompressed stream at which reading begins
+*/